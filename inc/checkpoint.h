@@ -0,0 +1,121 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! flag to indicate that the checkpointed output is valid */
+#define CHECKPOINT_VALID    ( 1 << 0 )
+
+/*! checkpointed render cache entry */
+typedef struct checkpointEntry
+{
+    /*! name of the file variable */
+    char *pName;
+
+    /*! entry flags */
+    uint32_t flags;
+
+    /*! fingerprint of the template and the values it depends on */
+    uint64_t fingerprint;
+
+    /*! hash of the rendered output */
+    uint64_t hash;
+
+    /*! output generation counter */
+    uint32_t generation;
+
+    /*! number of times the file variable was printed */
+    uint64_t reads;
+
+    /*! decayed access frequency of the file variable */
+    uint64_t heat;
+
+    /*! rendered output */
+    const char *pOutput;
+
+    /*! length of the rendered output */
+    size_t outputLen;
+
+} CheckpointEntry;
+
+/*! render cache checkpoint handle */
+typedef struct checkpoint
+{
+    /*! name of the checkpoint file */
+    char *pFileName;
+
+    /*! name of the temporary file which is written to */
+    char *pTempName;
+
+    /*! file descriptor of the temporary file being written */
+    int fd;
+
+    /*! number of entries in the checkpoint */
+    uint32_t nEntries;
+
+    /*! read-only mapping of a checkpoint file being restored */
+    const uint8_t *pBase;
+
+    /*! size of the checkpoint file being restored */
+    size_t size;
+
+    /*! records of the checkpoint file being restored, sorted by name */
+    const void **ppRecords;
+
+    /*! number of indexed records */
+    uint32_t nRecords;
+
+} Checkpoint;
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+Checkpoint *CHECKPOINT_Create( char *pFileName );
+
+int CHECKPOINT_Add( Checkpoint *pCheckpoint, const CheckpointEntry *pEntry );
+
+int CHECKPOINT_Commit( Checkpoint *pCheckpoint );
+
+Checkpoint *CHECKPOINT_Open( char *pFileName );
+
+int CHECKPOINT_Find( Checkpoint *pCheckpoint,
+                     char *pName,
+                     CheckpointEntry *pEntry );
+
+void CHECKPOINT_Close( Checkpoint *pCheckpoint );
+
+#endif
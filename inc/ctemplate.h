@@ -0,0 +1,366 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef CTEMPLATE_H
+#define CTEMPLATE_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <varserver/varserver.h>
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! compiled template image magic number ( 'FVCT' ) */
+#define CTEMPLATE_MAGIC     ( 0x46564354 )
+
+/*! compiled template image version, incremented whenever the compiled
+    template representation changes */
+#define CTEMPLATE_VERSION   ( 4 )
+
+/*! maximum nesting depth of template includes */
+#define CTEMPLATE_MAX_INCLUDE_DEPTH ( 16 )
+
+/*! compiled template segment types */
+typedef enum segmentType
+{
+    /*! literal text which is copied verbatim to the output */
+    SEGMENT_LITERAL = 0,
+
+    /*! variable reference which is replaced with the variable value */
+    SEGMENT_VAR,
+
+    /*! start of a conditional section, which is rendered if its
+        condition variable is true */
+    SEGMENT_IF,
+
+    /*! start of the branch of a conditional section which is rendered
+        if its condition variable is false */
+    SEGMENT_ELSE,
+
+    /*! end of a conditional section */
+    SEGMENT_ENDIF,
+
+    /*! start of a loop, whose body is rendered once for each variable
+        matching its pattern */
+    SEGMENT_FOR,
+
+    /*! end of a loop */
+    SEGMENT_ENDFOR,
+
+    /*! name of the current variable of the innermost loop */
+    SEGMENT_NAME,
+
+    /*! value of the current variable of the innermost loop */
+    SEGMENT_VALUE,
+
+    /*! sum of the variables matching a pattern */
+    SEGMENT_SUM,
+
+    /*! minimum of the variables matching a pattern */
+    SEGMENT_MIN,
+
+    /*! maximum of the variables matching a pattern */
+    SEGMENT_MAX,
+
+    /*! number of variables matching a pattern */
+    SEGMENT_COUNT,
+
+    /*! average of the variables matching a pattern */
+    SEGMENT_AVG
+
+} SegmentType;
+
+/*! check if a segment is an aggregate */
+#define CTEMPLATE_IS_AGGREGATE( pSegment ) \
+    ( ( (pSegment)->type >= SEGMENT_SUM ) && \
+      ( (pSegment)->type <= SEGMENT_AVG ) )
+
+/*! size of the formatted result of an aggregate */
+#define CTEMPLATE_AGGREGATE_LEN ( 48 )
+
+/*! variable matching the pattern of a loop or aggregate */
+typedef struct loopMatch
+{
+    /*! handle of the matching variable */
+    VAR_HANDLE hVar;
+
+    /*! name of the matching variable */
+    char *pName;
+
+    /*! last known numeric value of an aggregate input */
+    long double value;
+
+    /*! flag to indicate that the aggregate input has a numeric value */
+    bool numeric;
+
+} LoopMatch;
+
+/*! running state of an aggregate */
+typedef struct cTemplateAggregate
+{
+    /*! sum of the numeric inputs */
+    long double sum;
+
+    /*! minimum of the numeric inputs */
+    long double min;
+
+    /*! maximum of the numeric inputs */
+    long double max;
+
+    /*! number of numeric inputs */
+    size_t n;
+
+    /*! number of incremental updates since the result was recalculated */
+    size_t updates;
+
+    /*! formatted result of the aggregate */
+    char text[CTEMPLATE_AGGREGATE_LEN];
+
+    /*! length of the formatted result */
+    size_t len;
+
+} CTemplateAggregate;
+
+/*! compiled template segment */
+typedef struct segment
+{
+    /*! segment type */
+    SegmentType type;
+
+    /*! literal text, or the NUL terminated name of the referenced variable */
+    char *pText;
+
+    /*! length of the literal text or variable name */
+    size_t len;
+
+    /*! handle of the referenced variable (SEGMENT_VAR and SEGMENT_IF) */
+    VAR_HANDLE hVar;
+
+    /*! index of the segment to continue at when a SEGMENT_IF condition
+        is false, or when a SEGMENT_ELSE is reached, or of the
+        SEGMENT_ENDFOR of a SEGMENT_FOR */
+    size_t jump;
+
+    /*! variables matching the pattern of a loop, sorted by name, or of
+        an aggregate, sorted by handle */
+    LoopMatch *pMatches;
+
+    /*! number of variables matching the pattern */
+    size_t nMatches;
+
+    /*! running state of an aggregate, or NULL */
+    CTemplateAggregate *pAggregate;
+
+} Segment;
+
+/*! compiled template
+
+    A compiled template is the template file split into an array of
+    literal and variable reference segments so it can be rendered
+    without re-reading and re-parsing the template file */
+typedef struct cTemplate
+{
+    /*! name of the template file */
+    char *pFileName;
+
+    /*! template source buffer which the segments point into, or NULL
+        if the segments point into a serialized image */
+    char *pSource;
+
+    /*! literal text buffer which the segments point into once the
+        values of constant variables have been folded, or NULL */
+    char *pFolded;
+
+    /*! size of the template source */
+    size_t sourceLen;
+
+    /*! memory mapped image which the segments point into, or NULL.
+        The mapping is owned by the template and unmapped when it is
+        freed */
+    const void *pMapping;
+
+    /*! size of the memory mapped image */
+    size_t mappingLen;
+
+    /*! array of template segments */
+    Segment *pSegments;
+
+    /*! number of segments in the segment array */
+    size_t nSegments;
+
+    /*! number of variable references which could not be resolved */
+    size_t nMissing;
+
+    /*! number of loops in the template */
+    size_t nLoops;
+
+    /*! number of aggregates in the template */
+    size_t nAggregates;
+
+    /*! indices of the aggregate segments, or NULL if the template has
+        not been resolved */
+    size_t *pAggregates;
+
+} CTemplate;
+
+/*! piece of the output of a compiled template */
+typedef struct cTemplateStep
+{
+    /*! index of the segment which produced the step */
+    size_t idx;
+
+    /*! text to write, or NULL to write the value of the variable */
+    const char *pText;
+
+    /*! length of the text to write */
+    size_t len;
+
+    /*! handle of the variable whose value is written */
+    VAR_HANDLE hVar;
+
+    /*! flag to indicate that the variable is the current variable of a
+        loop, so it differs between the iterations of the segment */
+    bool loop;
+
+} CTemplateStep;
+
+/*! function called for each step of the output of a compiled template */
+typedef int (*CTemplateVisitor)( void *pArg, const CTemplateStep *pStep );
+
+/*! function called to check if the value of a variable never changes */
+typedef bool (*CTemplateConstant)( void *pArg, const char *pName );
+
+/*! serialized compiled template segment */
+typedef struct cTemplateImageSegment
+{
+    /*! segment type */
+    uint32_t type;
+
+    /*! offset of the segment text in the image text area */
+    uint32_t offset;
+
+    /*! length of the segment text */
+    uint32_t len;
+
+    /*! index of the segment to jump to (conditional sections only) */
+    uint32_t jump;
+
+} CTemplateImageSegment;
+
+/*! serialized compiled template
+
+    The serialized image is position independent.  The segment array
+    is followed by the text area, which holds the template source
+    with the variable names NUL terminated */
+typedef struct cTemplateImage
+{
+    /*! compiled template image magic number */
+    uint32_t magic;
+
+    /*! compiled template image version */
+    uint32_t version;
+
+    /*! hash of the template source content */
+    uint64_t contentHash;
+
+    /*! number of segments */
+    uint32_t nSegments;
+
+    /*! length of the text area */
+    uint32_t textLen;
+
+    /*! segment array */
+    CTemplateImageSegment segments[];
+
+} CTemplateImage;
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+CTemplate *CTEMPLATE_Compile( char *pFileName );
+
+CTemplate *CTEMPLATE_CompileBuffer( char *pFileName,
+                                    char *pSource,
+                                    size_t len );
+
+char *CTEMPLATE_ReadFile( char *pFileName, size_t *pLen );
+
+char *CTEMPLATE_ReadTemplate( char *pFileName, size_t *pLen );
+
+CTemplateImage *CTEMPLATE_Serialize( CTemplate *pTemplate,
+                                     uint64_t contentHash,
+                                     size_t *pLen );
+
+CTemplate *CTEMPLATE_Load( char *pFileName,
+                           const CTemplateImage *pImage,
+                           size_t len );
+
+int CTEMPLATE_Resolve( VARSERVER_HANDLE hVarServer, CTemplate *pTemplate );
+
+size_t CTEMPLATE_ResolveMissing( VARSERVER_HANDLE hVarServer,
+                                 CTemplate *pTemplate );
+
+size_t CTEMPLATE_Skip( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       size_t i );
+
+int CTEMPLATE_Render( VARSERVER_HANDLE hVarServer,
+                      CTemplate *pTemplate,
+                      int fd );
+
+int CTEMPLATE_Walk( VARSERVER_HANDLE hVarServer,
+                    CTemplate *pTemplate,
+                    CTemplateVisitor visitor,
+                    void *pArg );
+
+bool CTEMPLATE_Requery( VARSERVER_HANDLE hVarServer,
+                        Segment *pSegment,
+                        LoopMatch **ppPrevious,
+                        size_t *pnPrevious );
+
+bool CTEMPLATE_Update( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       VAR_HANDLE hVar );
+
+size_t CTEMPLATE_Fold( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       CTemplateConstant isConstant,
+                       void *pArg,
+                       int fd );
+
+void CTEMPLATE_FreeMatches( LoopMatch *pMatches, size_t n );
+
+void CTEMPLATE_Free( CTemplate *pTemplate );
+
+int CTEMPLATE_Write( int fd, const char *pBuf, size_t len );
+
+#endif
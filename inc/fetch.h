@@ -0,0 +1,128 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef FETCH_H
+#define FETCH_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <varserver/varserver.h>
+#include "ctemplate.h"
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! default number of variable fetch threads */
+#define FETCH_DEFAULT_THREADS   ( 4 )
+
+/*! attributes of the variable fetch threads */
+typedef struct fetchAttr
+{
+    /*! number of fetch threads */
+    int nThreads;
+
+    /*! list of CPUs which the fetch threads run on, or NULL to run on
+        any CPU which the process could run on before it was pinned.
+        The list must remain valid for the lifetime of the pool */
+    char *pCPUList;
+
+    /*! scheduling policy of the fetch threads */
+    int policy;
+
+    /*! scheduling priority of the fetch threads */
+    int priority;
+
+    /*! flag to indicate that the fetch threads prefault their stacks */
+    bool prefault;
+
+} FetchAttr;
+
+/*! last known value of a template variable reference */
+typedef struct fetchValue
+{
+    /*! rendered value of the variable, or NULL if it was never fetched */
+    char *pData;
+
+    /*! length of the rendered value */
+    size_t len;
+
+} FetchValue;
+
+/*! request to render a template with the fetch thread pool */
+typedef struct fetchRender
+{
+    /*! variable server handle used to read the conditions of the
+        template's conditional sections */
+    VARSERVER_HANDLE hVarServer;
+
+    /*! compiled template to render */
+    CTemplate *pTemplate;
+
+    /*! last known values of the template segments, which are updated
+        with each fetched value */
+    FetchValue *pValues;
+
+    /*! text to substitute for a variable which is not fetched in time,
+        or NULL to substitute its last known value */
+    const char *pPlaceholder;
+
+    /*! render deadline in milliseconds, or 0 to wait for every variable */
+    int deadline;
+
+    /*! output file descriptor to render to */
+    int fd;
+
+    /*! file descriptor which also receives the output as it is
+        rendered, or -1 */
+    int streamfd;
+
+    /*! number of variables which were substituted */
+    size_t missed;
+
+    /*! monotonic time at which the first byte of output was written,
+        or zero if no output was written */
+    struct timespec firstByte;
+
+} FetchRender;
+
+/*! variable fetch thread pool */
+typedef struct fetchPool FetchPool;
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+FetchPool *FETCH_Create( const FetchAttr *pAttr );
+
+int FETCH_Render( FetchPool *pPool, FetchRender *pRender );
+
+void FETCH_FreeValues( FetchValue *pValues, size_t n );
+
+#endif
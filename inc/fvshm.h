@@ -0,0 +1,166 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef FVSHM_H
+#define FVSHM_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! default name of the shared render cache segment */
+#define FVSHM_DEFAULT_NAME      "/filevars"
+
+/*! default size of the data area of a shared render cache slot */
+#define FVSHM_DEFAULT_SLOT_SIZE ( 4096 )
+
+/*! largest output size of a shared render cache slot, which keeps the
+    slot with its header and name well within 32 bits */
+#define FVSHM_MAX_SLOT_SIZE     ( 16 * 1024 * 1024 )
+
+/*! shared render cache segment magic number ( 'FVSH' ) */
+#define FVSHM_MAGIC             ( 0x46565348 )
+
+/*! shared render cache layout version */
+#define FVSHM_VERSION           ( 1 )
+
+/*! maximum length of a variable name in a shared render cache slot */
+#define FVSHM_NAME_LEN          ( 256 )
+
+/*! slot flag indicating that the slot holds current rendered output */
+#define FVSHM_SLOT_VALID        ( 1 << 0 )
+
+/*! shared render cache segment header */
+typedef struct fvShmHeader
+{
+    /*! magic number, set once the segment is fully initialized */
+    uint32_t magic;
+
+    /*! layout version */
+    uint32_t version;
+
+    /*! number of slots in the segment */
+    uint32_t nSlots;
+
+    /*! size of the data area of each slot */
+    uint32_t slotSize;
+
+    /*! distance in bytes between consecutive slots */
+    uint32_t stride;
+
+    /*! process identifier of the filevars process which owns the segment */
+    uint32_t pid;
+
+} FVShmHeader;
+
+/*! shared render cache slot
+
+    Each slot is protected by a sequence lock.  The writer increments
+    the sequence number before and after updating the slot, so the
+    sequence number is odd while an update is in progress.  A reader
+    which sees the same even sequence number before and after copying
+    the slot has a consistent copy. */
+typedef struct fvShmSlot
+{
+    /*! sequence lock counter */
+    uint32_t seq;
+
+    /*! slot flags */
+    uint32_t flags;
+
+    /*! output generation counter */
+    uint32_t generation;
+
+    /*! length of the rendered output */
+    uint32_t len;
+
+    /*! hash of the rendered output */
+    uint64_t hash;
+
+    /*! name of the file variable which owns the slot */
+    char name[FVSHM_NAME_LEN];
+
+    /*! rendered output */
+    char data[];
+
+} FVShmSlot;
+
+/*! shared render cache mapping */
+typedef struct fvShm
+{
+    /*! name of the shared memory segment */
+    char *pName;
+
+    /*! pointer to the mapped segment */
+    FVShmHeader *pHeader;
+
+    /*! size of the mapped segment */
+    size_t size;
+
+    /*! flag to indicate that this process owns the segment */
+    bool owner;
+
+} FVShm;
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+FVShm *FVSHM_Create( char *pName,
+                     uint32_t nSlots,
+                     uint32_t slotSize,
+                     bool replace );
+
+int FVSHM_SetSlotName( FVShm *pShm, uint32_t slot, char *pName );
+
+int FVSHM_FindSlot( FVShm *pShm, char *pName );
+
+int FVSHM_Publish( FVShm *pShm,
+                   uint32_t slot,
+                   const char *pData,
+                   size_t len,
+                   uint64_t hash,
+                   uint32_t generation );
+
+int FVSHM_Invalidate( FVShm *pShm, uint32_t slot );
+
+FVShm *FVSHM_Open( char *pName );
+
+int FVSHM_Read( FVShm *pShm,
+                char *pName,
+                char *pBuf,
+                size_t size,
+                size_t *pLen );
+
+void FVSHM_Close( FVShm *pShm );
+
+#endif
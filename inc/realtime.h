@@ -0,0 +1,63 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! number of bytes of stack prefaulted for each thread */
+#define REALTIME_STACK_SIZE     ( 256 * 1024 )
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+void REALTIME_LimitArenas( void );
+
+int REALTIME_LockMemory( size_t heapSize );
+
+void REALTIME_PrefaultStack( void );
+
+size_t REALTIME_Touch( const void *p, size_t len );
+
+int REALTIME_GetCPU( char *pCPUList, int index );
+
+int REALTIME_SetAffinity( int cpu );
+
+int REALTIME_SetAffinityList( char *pCPUList );
+
+int REALTIME_GetPolicy( char *pName );
+
+int REALTIME_SetScheduler( int policy, int priority );
+
+#endif
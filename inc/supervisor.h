@@ -0,0 +1,51 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! SUPERVISOR_Run result if the worker processes could not be started */
+#define SUPERVISOR_FAILED       ( -1 )
+
+/*! SUPERVISOR_Run result if the workers handed over to a new instance */
+#define SUPERVISOR_HANDED_OVER  ( -2 )
+
+/*! SUPERVISOR_Run result if the workers were stopped by SIGTERM or SIGINT */
+#define SUPERVISOR_STOPPED      ( -3 )
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+int SUPERVISOR_Run( int n, void (*pfnReady)( void ) );
+
+void SUPERVISOR_Ready( void );
+
+void SUPERVISOR_Stop( void );
+
+#endif
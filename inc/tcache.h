@@ -0,0 +1,55 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef TCACHE_H
+#define TCACHE_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ctemplate.h"
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! suffix of the compiled template cache files */
+#define TCACHE_SUFFIX   ".fvct"
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+const CTemplateImage *TCACHE_Map( char *pDir,
+                                  uint64_t contentHash,
+                                  size_t *pLen );
+
+int TCACHE_Save( char *pDir, const CTemplateImage *pImage, size_t len );
+
+void TCACHE_Unmap( const CTemplateImage *pImage, size_t len );
+
+#endif
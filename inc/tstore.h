@@ -0,0 +1,81 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#ifndef TSTORE_H
+#define TSTORE_H
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ctemplate.h"
+
+/*============================================================================
+        Public definitions
+============================================================================*/
+
+/*! default name of the shared template store segment */
+#define TSTORE_DEFAULT_NAME     "/filevars.templates"
+
+/*! default size of the shared template store segment */
+#define TSTORE_DEFAULT_SIZE     ( 1024 * 1024 )
+
+/*! smallest size of the shared template store segment */
+#define TSTORE_MIN_SIZE         ( 4096 )
+
+/*! shared template store handle */
+typedef struct tStore
+{
+    /*! name of the shared memory segment */
+    char *pName;
+
+    /*! read-only mapping of the shared memory segment */
+    const uint8_t *pBase;
+
+    /*! size of the shared memory segment */
+    size_t size;
+
+} TStore;
+
+/*============================================================================
+        Public function declarations
+============================================================================*/
+
+TStore *TSTORE_Open( char *pName, size_t size );
+
+const CTemplateImage *TSTORE_Find( TStore *pStore,
+                                   char *pPath,
+                                   uint64_t contentHash,
+                                   size_t *pLen );
+
+const CTemplateImage *TSTORE_Add( TStore *pStore,
+                                  char *pPath,
+                                  const CTemplateImage *pImage,
+                                  size_t len );
+
+void TSTORE_Close( TStore *pStore );
+
+#endif
@@ -0,0 +1,657 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup checkpoint checkpoint
+ * @brief Render cache checkpoint
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file checkpoint.c
+
+    Render Cache Checkpoint
+
+    The Render Cache Checkpoint module saves the cached rendered output
+    and access statistics of the file variables into a checkpoint file
+    when filevars is terminated, so they can be restored when filevars
+    is restarted instead of starting with a cold cache.
+
+    The checkpoint is written to a temporary file which is renamed over
+    the checkpoint file once it is complete.  Each entry carries a
+    fingerprint of the template and the values of the variables it
+    depends on, which the caller uses to revalidate the entry before
+    serving it.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <varserver/varserver.h>
+#include "checkpoint.h"
+#include "ctemplate.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! checkpoint file magic number ( 'FVCP' ) */
+#define CHECKPOINT_MAGIC    ( 0x46564350 )
+
+/*! checkpoint file layout version */
+#define CHECKPOINT_VERSION  ( 2 )
+
+/*! alignment of the checkpoint records */
+#define CHECKPOINT_ALIGN( x )   ( ( (x) + 7 ) & ~( (size_t)7 ) )
+
+/*! checkpoint file header */
+typedef struct checkpointHeader
+{
+    /*! magic number */
+    uint32_t magic;
+
+    /*! layout version */
+    uint32_t version;
+
+    /*! number of records in the checkpoint file */
+    uint32_t nEntries;
+
+    /*! reserved for alignment */
+    uint32_t reserved;
+
+} CheckpointHeader;
+
+/*! checkpoint file record */
+typedef struct checkpointRecord
+{
+    /*! total length of the record including padding */
+    uint32_t recordLen;
+
+    /*! length of the file variable name including the NUL terminator */
+    uint32_t nameLen;
+
+    /*! output generation counter */
+    uint32_t generation;
+
+    /*! length of the rendered output */
+    uint32_t outputLen;
+
+    /*! record flags */
+    uint32_t flags;
+
+    /*! reserved for alignment */
+    uint32_t reserved;
+
+    /*! fingerprint of the template and its dependency values */
+    uint64_t fingerprint;
+
+    /*! hash of the rendered output */
+    uint64_t hash;
+
+    /*! number of times the file variable was printed */
+    uint64_t reads;
+
+    /*! decayed access frequency of the file variable */
+    uint64_t heat;
+
+    /*! file variable name followed by the rendered output */
+    char name[];
+
+} CheckpointRecord;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static int Index( Checkpoint *pCheckpoint );
+static int CompareRecords( const void *p1, const void *p2 );
+static int CompareName( const void *pKey, const void *p );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  CHECKPOINT_Create                                                         */
+/*!
+    Create a checkpoint
+
+    The CHECKPOINT_Create function creates a temporary file alongside
+    the checkpoint file which entries are added to.  The checkpoint
+    file is only replaced when the checkpoint is committed.
+
+    @param[in]
+       pFileName
+            name of the checkpoint file
+
+    @retval pointer to the checkpoint
+    @retval NULL if the checkpoint could not be created
+
+==============================================================================*/
+Checkpoint *CHECKPOINT_Create( char *pFileName )
+{
+    Checkpoint *pCheckpoint = NULL;
+    CheckpointHeader header;
+    size_t len;
+
+    if( pFileName != NULL )
+    {
+        pCheckpoint = calloc( 1, sizeof( Checkpoint ) );
+    }
+
+    if( pCheckpoint != NULL )
+    {
+        len = strlen( pFileName ) + sizeof( ".XXXXXX" );
+        pCheckpoint->pFileName = strdup( pFileName );
+        pCheckpoint->pTempName = malloc( len );
+        pCheckpoint->fd = -1;
+
+        if( pCheckpoint->pTempName != NULL )
+        {
+            snprintf( pCheckpoint->pTempName, len, "%s.XXXXXX", pFileName );
+            pCheckpoint->fd = mkstemp( pCheckpoint->pTempName );
+        }
+
+        /* the header is rewritten with the magic number on commit */
+        memset( &header, 0, sizeof( header ) );
+        if( ( pCheckpoint->fd < 0 ) ||
+            ( CTEMPLATE_Write( pCheckpoint->fd,
+                               (const char *)&header,
+                               sizeof( header ) ) != EOK ) )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot create checkpoint %s",
+                    pFileName );
+            CHECKPOINT_Close( pCheckpoint );
+            pCheckpoint = NULL;
+        }
+    }
+
+    return pCheckpoint;
+}
+
+/*============================================================================*/
+/*  CHECKPOINT_Add                                                            */
+/*!
+    Add an entry to a checkpoint
+
+    The CHECKPOINT_Add function appends a render cache entry to a
+    checkpoint created with CHECKPOINT_Create.
+
+    @param[in]
+       pCheckpoint
+            pointer to the checkpoint
+
+    @param[in]
+       pEntry
+            pointer to the entry to add
+
+    @retval EOK - the entry was added
+    @retval EINVAL - invalid arguments
+    @retval other error from write
+
+==============================================================================*/
+int CHECKPOINT_Add( Checkpoint *pCheckpoint, const CheckpointEntry *pEntry )
+{
+    int result = EINVAL;
+    CheckpointRecord record;
+    static const char padding[8] = { 0 };
+    size_t len;
+
+    if( ( pCheckpoint != NULL ) &&
+        ( pCheckpoint->fd >= 0 ) &&
+        ( pEntry != NULL ) &&
+        ( pEntry->pName != NULL ) &&
+        ( ( pEntry->pOutput != NULL ) || ( pEntry->outputLen == 0 ) ) )
+    {
+        memset( &record, 0, sizeof( record ) );
+        record.nameLen = strlen( pEntry->pName ) + 1;
+        record.generation = pEntry->generation;
+        record.flags = pEntry->flags;
+        record.outputLen = pEntry->outputLen;
+        record.fingerprint = pEntry->fingerprint;
+        record.hash = pEntry->hash;
+        record.reads = pEntry->reads;
+        record.heat = pEntry->heat;
+
+        len = sizeof( record ) + record.nameLen + record.outputLen;
+        record.recordLen = CHECKPOINT_ALIGN( len );
+
+        result = CTEMPLATE_Write( pCheckpoint->fd,
+                                  (const char *)&record,
+                                  sizeof( record ) );
+        if( result == EOK )
+        {
+            result = CTEMPLATE_Write( pCheckpoint->fd,
+                                      pEntry->pName,
+                                      record.nameLen );
+        }
+
+        if( result == EOK )
+        {
+            result = CTEMPLATE_Write( pCheckpoint->fd,
+                                      pEntry->pOutput,
+                                      record.outputLen );
+        }
+
+        if( result == EOK )
+        {
+            result = CTEMPLATE_Write( pCheckpoint->fd,
+                                      padding,
+                                      record.recordLen - len );
+        }
+
+        if( result == EOK )
+        {
+            pCheckpoint->nEntries++;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CHECKPOINT_Commit                                                         */
+/*!
+    Commit a checkpoint
+
+    The CHECKPOINT_Commit function completes the checkpoint header,
+    flushes the temporary file to storage, and renames it over the
+    checkpoint file.  The checkpoint is closed whether or not the
+    commit succeeds.
+
+    @param[in]
+       pCheckpoint
+            pointer to the checkpoint
+
+    @retval EOK - the checkpoint file was written
+    @retval EINVAL - invalid arguments
+    @retval other error from pwrite, fsync or rename
+
+==============================================================================*/
+int CHECKPOINT_Commit( Checkpoint *pCheckpoint )
+{
+    int result = EINVAL;
+    CheckpointHeader header;
+
+    if( ( pCheckpoint != NULL ) &&
+        ( pCheckpoint->fd >= 0 ) )
+    {
+        memset( &header, 0, sizeof( header ) );
+        header.magic = CHECKPOINT_MAGIC;
+        header.version = CHECKPOINT_VERSION;
+        header.nEntries = pCheckpoint->nEntries;
+
+        result = EOK;
+        if( ( pwrite( pCheckpoint->fd, &header, sizeof( header ), 0 ) !=
+                sizeof( header ) ) ||
+            ( fsync( pCheckpoint->fd ) != 0 ) ||
+            ( rename( pCheckpoint->pTempName,
+                      pCheckpoint->pFileName ) != 0 ) )
+        {
+            result = errno;
+            syslog( LOG_ERR,
+                    "filevars: cannot write checkpoint %s: %s",
+                    pCheckpoint->pFileName,
+                    strerror( result ) );
+        }
+        else
+        {
+            /* nothing left to clean up */
+            free( pCheckpoint->pTempName );
+            pCheckpoint->pTempName = NULL;
+        }
+    }
+
+    CHECKPOINT_Close( pCheckpoint );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CHECKPOINT_Open                                                           */
+/*!
+    Open a checkpoint file to restore it
+
+    The CHECKPOINT_Open function maps a checkpoint file read-only and
+    indexes its records by name, so each of its entries can be looked
+    up with CHECKPOINT_Find without scanning the file.  If the file is
+    corrupt, only the records before the corruption are indexed.
+
+    @param[in]
+       pFileName
+            name of the checkpoint file
+
+    @retval pointer to the checkpoint
+    @retval NULL if there is no valid checkpoint file
+
+==============================================================================*/
+Checkpoint *CHECKPOINT_Open( char *pFileName )
+{
+    Checkpoint *pCheckpoint = NULL;
+    const CheckpointHeader *pHeader;
+    struct stat sb;
+    void *p;
+    int fd = -1;
+
+    if( pFileName != NULL )
+    {
+        fd = open( pFileName, O_RDONLY | O_CLOEXEC );
+    }
+
+    if( fd >= 0 )
+    {
+        if( ( fstat( fd, &sb ) == 0 ) &&
+            ( (size_t)sb.st_size >= sizeof( CheckpointHeader ) ) )
+        {
+            p = mmap( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( p != MAP_FAILED )
+            {
+                pHeader = p;
+                if( ( pHeader->magic == CHECKPOINT_MAGIC ) &&
+                    ( pHeader->version == CHECKPOINT_VERSION ) )
+                {
+                    pCheckpoint = calloc( 1, sizeof( Checkpoint ) );
+                }
+
+                if( pCheckpoint != NULL )
+                {
+                    pCheckpoint->pFileName = strdup( pFileName );
+                    pCheckpoint->fd = -1;
+                    pCheckpoint->nEntries = pHeader->nEntries;
+                    pCheckpoint->pBase = p;
+                    pCheckpoint->size = sb.st_size;
+
+                    if( Index( pCheckpoint ) == ENOMEM )
+                    {
+                        CHECKPOINT_Close( pCheckpoint );
+                        pCheckpoint = NULL;
+                    }
+                }
+                else
+                {
+                    munmap( p, sb.st_size );
+                }
+            }
+        }
+
+        close( fd );
+    }
+
+    return pCheckpoint;
+}
+
+/*============================================================================*/
+/*  CHECKPOINT_Find                                                           */
+/*!
+    Find an entry in a checkpoint file
+
+    The CHECKPOINT_Find function looks up the entry of the named file
+    variable in the index of a checkpoint file opened with
+    CHECKPOINT_Open, with a binary search.  The entry name and output
+    point into the checkpoint file mapping, and are only valid until
+    the checkpoint is closed.
+
+    @param[in]
+       pCheckpoint
+            pointer to the checkpoint
+
+    @param[in]
+       pName
+            name of the file variable
+
+    @param[out]
+       pEntry
+            pointer to a location to store the entry
+
+    @retval EOK - the entry was found
+    @retval ENOENT - the file variable is not in the checkpoint
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int CHECKPOINT_Find( Checkpoint *pCheckpoint,
+                     char *pName,
+                     CheckpointEntry *pEntry )
+{
+    int result = EINVAL;
+    const CheckpointRecord * const *ppRecord;
+    const CheckpointRecord *pRecord;
+
+    if( ( pCheckpoint != NULL ) &&
+        ( pCheckpoint->pBase != NULL ) &&
+        ( pName != NULL ) &&
+        ( pEntry != NULL ) )
+    {
+        ppRecord = bsearch( pName,
+                            pCheckpoint->ppRecords,
+                            pCheckpoint->nRecords,
+                            sizeof( const void * ),
+                            CompareName );
+        if( ppRecord != NULL )
+        {
+            pRecord = *ppRecord;
+            pEntry->pName = (char *)pRecord->name;
+            pEntry->flags = pRecord->flags;
+            pEntry->fingerprint = pRecord->fingerprint;
+            pEntry->hash = pRecord->hash;
+            pEntry->generation = pRecord->generation;
+            pEntry->reads = pRecord->reads;
+            pEntry->heat = pRecord->heat;
+            pEntry->pOutput = &pRecord->name[pRecord->nameLen];
+            pEntry->outputLen = pRecord->outputLen;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CHECKPOINT_Close                                                          */
+/*!
+    Close a checkpoint
+
+    The CHECKPOINT_Close function releases a checkpoint.  The temporary
+    file of an uncommitted checkpoint is removed, and the mapping of a
+    restored checkpoint file is released.
+
+    @param[in]
+       pCheckpoint
+            pointer to the checkpoint
+
+==============================================================================*/
+void CHECKPOINT_Close( Checkpoint *pCheckpoint )
+{
+    if( pCheckpoint != NULL )
+    {
+        if( pCheckpoint->fd >= 0 )
+        {
+            close( pCheckpoint->fd );
+        }
+
+        if( pCheckpoint->pTempName != NULL )
+        {
+            unlink( pCheckpoint->pTempName );
+            free( pCheckpoint->pTempName );
+        }
+
+        if( pCheckpoint->pBase != NULL )
+        {
+            munmap( (void *)pCheckpoint->pBase, pCheckpoint->size );
+        }
+
+        free( pCheckpoint->ppRecords );
+        free( pCheckpoint->pFileName );
+        free( pCheckpoint );
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  Index                                                                     */
+/*!
+    Index the records of a checkpoint file
+
+    The Index function validates the records of a checkpoint file
+    opened with CHECKPOINT_Open in a single pass, and builds an array
+    of pointers to them sorted by file variable name.  Indexing stops
+    at the first corrupt record.
+
+    @param[in]
+       pCheckpoint
+            pointer to the checkpoint
+
+    @retval EOK - the checkpoint file was indexed
+    @retval EBADMSG - the checkpoint file is corrupt
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Index( Checkpoint *pCheckpoint )
+{
+    int result = EOK;
+    const CheckpointRecord *pRecord;
+    size_t offset = sizeof( CheckpointHeader );
+    uint32_t i;
+
+    if( pCheckpoint->nEntries > 0 )
+    {
+        pCheckpoint->ppRecords = calloc( pCheckpoint->nEntries,
+                                         sizeof( const void * ) );
+        if( pCheckpoint->ppRecords == NULL )
+        {
+            result = ENOMEM;
+        }
+    }
+
+    for( i = 0; ( i < pCheckpoint->nEntries ) && ( result == EOK ); i++ )
+    {
+        pRecord = (const CheckpointRecord *)&pCheckpoint->pBase[offset];
+        if( ( offset + sizeof( CheckpointRecord ) > pCheckpoint->size ) ||
+            ( pRecord->nameLen == 0 ) ||
+            ( pRecord->recordLen < sizeof( CheckpointRecord ) +
+                                   pRecord->nameLen +
+                                   pRecord->outputLen ) ||
+            ( offset + pRecord->recordLen > pCheckpoint->size ) ||
+            ( pRecord->name[pRecord->nameLen - 1] != '\0' ) )
+        {
+            syslog( LOG_ERR,
+                    "filevars: checkpoint %s is corrupt",
+                    pCheckpoint->pFileName );
+            result = EBADMSG;
+        }
+        else
+        {
+            pCheckpoint->ppRecords[pCheckpoint->nRecords++] = pRecord;
+            offset += pRecord->recordLen;
+        }
+    }
+
+    if( pCheckpoint->nRecords > 0 )
+    {
+        qsort( pCheckpoint->ppRecords,
+               pCheckpoint->nRecords,
+               sizeof( const void * ),
+               CompareRecords );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CompareRecords                                                            */
+/*!
+    Compare two checkpoint records by name
+
+    The CompareRecords function is the qsort comparison function used
+    to sort the checkpoint record index by file variable name.
+
+    @param[in]
+       p1
+            pointer to the first record pointer
+
+    @param[in]
+       p2
+            pointer to the second record pointer
+
+    @retval <0, 0 or >0 as the first name sorts before, equal to or
+            after the second
+
+==============================================================================*/
+static int CompareRecords( const void *p1, const void *p2 )
+{
+    const CheckpointRecord *pRecord1 = *(const CheckpointRecord * const *)p1;
+    const CheckpointRecord *pRecord2 = *(const CheckpointRecord * const *)p2;
+
+    return strcmp( pRecord1->name, pRecord2->name );
+}
+
+/*============================================================================*/
+/*  CompareName                                                               */
+/*!
+    Compare a file variable name with a checkpoint record
+
+    The CompareName function is the bsearch comparison function used
+    to look up a file variable name in the checkpoint record index.
+
+    @param[in]
+       pKey
+            pointer to the file variable name
+
+    @param[in]
+       p
+            pointer to the record pointer
+
+    @retval <0, 0 or >0 as the name sorts before, equal to or after
+            the name of the record
+
+==============================================================================*/
+static int CompareName( const void *pKey, const void *p )
+{
+    const CheckpointRecord *pRecord = *(const CheckpointRecord * const *)p;
+
+    return strcmp( (const char *)pKey, pRecord->name );
+}
+
+/*! @}
+ * end of checkpoint group */
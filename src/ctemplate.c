@@ -0,0 +1,3091 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup ctemplate ctemplate
+ * @brief Compiled variable templates
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file ctemplate.c
+
+    Compiled Templates
+
+    The Compiled Templates module splits a template file into an
+    array of literal and variable reference segments once, so that
+    the template can be rendered repeatedly without reading and
+    parsing the template file on every render.
+
+    Templates may include other template files with the
+    ${@include path} directive.  Includes are flattened into the
+    template source before it is parsed, so they cost nothing when
+    the template is rendered.
+
+    Conditional sections are enclosed in ${@if var} and ${@endif}
+    directives, with an optional ${@else}.  Each directive is compiled
+    into a segment which holds the index of the segment to jump to, so
+    the renderer only reads the condition variable, and never visits
+    the segments of the branch which is not taken.
+
+    Loops are enclosed in ${@for pattern} and ${@endfor} directives,
+    and render their body once for every variable whose name matches
+    the pattern, or which has the tag following a # character.  The
+    matching variables are found when the template is resolved, and
+    kept in the loop segment, so rendering a loop only prints the
+    values of the matching variables.
+
+    The ${@sum pattern}, ${@min pattern}, ${@max pattern},
+    ${@count pattern} and ${@avg pattern} aggregates match variables
+    in the same way.  Their result is kept up to date with
+    CTEMPLATE_Update as the matching variables change, so rendering
+    an aggregate only writes its formatted result.
+
+    References to variables whose values never change can be folded
+    into the literal text of the template with CTEMPLATE_Fold, so they
+    are not fetched when the template is rendered.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <syslog.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <varserver/varserver.h>
+#include "ctemplate.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! initial number of segments allocated for a compiled template */
+#define CTEMPLATE_INITIAL_SEGMENTS  ( 16 )
+
+/*! number of incremental updates after which an aggregate is recalculated
+    from its remembered inputs, to discard rounding errors in its sum */
+#define CTEMPLATE_AGGREGATE_RESCAN  ( 1024 )
+
+/*! template include directive */
+#define INCLUDE_DIRECTIVE   "${@include"
+
+/*! stack of the canonical names of the files being included */
+typedef struct includeStack
+{
+    /*! canonical names of the files being included, outermost first */
+    char *pNames[CTEMPLATE_MAX_INCLUDE_DEPTH];
+
+    /*! number of files being included */
+    size_t depth;
+
+} IncludeStack;
+
+/*! flattened template buffer */
+typedef struct includeBuffer
+{
+    /*! NUL terminated flattened template */
+    char *pBuf;
+
+    /*! length of the flattened template */
+    size_t len;
+
+    /*! allocated size of the buffer */
+    size_t size;
+
+} IncludeBuffer;
+
+/*! context of a serial template render */
+typedef struct renderContext
+{
+    /*! handle to the variable server */
+    VARSERVER_HANDLE hVarServer;
+
+    /*! output file descriptor */
+    int fd;
+
+} RenderContext;
+
+/*! value of a constant variable captured by CTEMPLATE_Fold */
+typedef struct foldValue
+{
+    /*! flag to indicate that the variable reference is folded */
+    bool folded;
+
+    /*! offset of the value in the capture buffer */
+    size_t offset;
+
+    /*! length of the value */
+    size_t len;
+
+} FoldValue;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static int Parse( CTemplate *pTemplate );
+static int AddSegment( CTemplate *pTemplate,
+                       size_t *pSize,
+                       SegmentType type,
+                       char *pText,
+                       size_t len );
+static int Include( char *pFileName,
+                    char *pSource,
+                    size_t len,
+                    IncludeStack *pStack,
+                    IncludeBuffer *pBuf );
+static int IncludeFile( char *pFileName,
+                        IncludeStack *pStack,
+                        IncludeBuffer *pBuf );
+static char *IncludePath( char *pFileName, char *pStart, char *pEnd );
+static int Append( IncludeBuffer *pBuf, const char *pText, size_t len );
+static int AddDirective( CTemplate *pTemplate,
+                         size_t *pSize,
+                         size_t *pOpen,
+                         char *pText );
+static bool Test( VARSERVER_HANDLE hVarServer, VAR_HANDLE hVar );
+static char *Argument( char *pText, size_t *pLen );
+static bool InLoop( CTemplate *pTemplate, size_t open );
+static int Walk( VARSERVER_HANDLE hVarServer,
+                 CTemplate *pTemplate,
+                 size_t from,
+                 size_t to,
+                 const LoopMatch *pMatch,
+                 CTemplateVisitor visitor,
+                 void *pArg );
+static int RenderStep( void *pArg, const CTemplateStep *pStep );
+static int Query( VARSERVER_HANDLE hVarServer,
+                  const char *pPattern,
+                  LoopMatch **ppMatches,
+                  size_t *pCount );
+static int CompareMatches( const void *p1, const void *p2 );
+static int CompareHandles( const void *p1, const void *p2 );
+static int Match( VARSERVER_HANDLE hVarServer,
+                  Segment *pSegment,
+                  LoopMatch **ppMatches,
+                  size_t *pCount );
+static bool CheckJump( const CTemplateImage *pImage, size_t i );
+static int Aggregate( VARSERVER_HANDLE hVarServer, Segment *pSegment );
+static void IndexAggregates( CTemplate *pTemplate );
+static bool Update( Segment *pSegment,
+                    LoopMatch *pMatch,
+                    long double value,
+                    bool numeric );
+static void Accumulate( CTemplateAggregate *pAggregate, long double value );
+static void Rescan( Segment *pSegment );
+static void Format( Segment *pSegment );
+static bool GetNumber( VARSERVER_HANDLE hVarServer,
+                       VAR_HANDLE hVar,
+                       long double *pValue );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  CTEMPLATE_Compile                                                         */
+/*!
+    Compile a template file
+
+    The CTEMPLATE_Compile function reads the specified template file,
+    flattens its includes, and splits it into literal and variable
+    reference segments.
+    Variable references are not resolved to variable handles until
+    CTEMPLATE_Resolve is called.
+
+    @param[in]
+       pFileName
+            pointer to the name of the template file to compile
+
+    @retval pointer to the compiled template
+    @retval NULL if the template could not be compiled
+
+==============================================================================*/
+CTemplate *CTEMPLATE_Compile( char *pFileName )
+{
+    CTemplate *pTemplate = NULL;
+    char *pSource;
+    size_t len;
+
+    if( pFileName != NULL )
+    {
+        pSource = CTEMPLATE_ReadTemplate( pFileName, &len );
+        if( pSource != NULL )
+        {
+            pTemplate = CTEMPLATE_CompileBuffer( pFileName, pSource, len );
+        }
+    }
+
+    return pTemplate;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_CompileBuffer                                                   */
+/*!
+    Compile a template which has already been read into memory
+
+    The CTEMPLATE_CompileBuffer function splits the template source
+    into literal and variable reference segments.  The compiled
+    template takes ownership of the source buffer, which must have
+    been allocated with malloc and be NUL terminated.
+
+    @param[in]
+       pFileName
+            pointer to the name of the template file
+
+    @param[in]
+       pSource
+            pointer to the NUL terminated template source
+
+    @param[in]
+       len
+            length of the template source
+
+    @retval pointer to the compiled template
+    @retval NULL if the template could not be compiled
+
+==============================================================================*/
+CTemplate *CTEMPLATE_CompileBuffer( char *pFileName,
+                                    char *pSource,
+                                    size_t len )
+{
+    CTemplate *pTemplate = NULL;
+
+    if( ( pFileName != NULL ) &&
+        ( pSource != NULL ) )
+    {
+        pTemplate = calloc( 1, sizeof( CTemplate ) );
+        if( pTemplate != NULL )
+        {
+            pTemplate->pFileName = strdup( pFileName );
+            pTemplate->pSource = pSource;
+            pTemplate->sourceLen = len;
+
+            if( Parse( pTemplate ) != EOK )
+            {
+                CTEMPLATE_Free( pTemplate );
+                pTemplate = NULL;
+            }
+        }
+        else
+        {
+            free( pSource );
+        }
+    }
+
+    return pTemplate;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Serialize                                                       */
+/*!
+    Serialize a compiled template
+
+    The CTEMPLATE_Serialize function flattens a compiled template into
+    a position independent image which can be stored in shared memory
+    or on disk, and loaded with CTEMPLATE_Load.  The image contains
+    the variable names, but not the variable handles, which are only
+    meaningful to the variable server connection which resolved them.
+    Templates whose constants have been folded cannot be serialized.
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to serialize
+
+    @param[in]
+       contentHash
+            hash of the template source content
+
+    @param[out]
+       pLen
+            pointer to a location to store the image length
+
+    @retval pointer to the serialized image allocated on the heap
+    @retval NULL if the template could not be serialized
+
+==============================================================================*/
+CTemplateImage *CTEMPLATE_Serialize( CTemplate *pTemplate,
+                                     uint64_t contentHash,
+                                     size_t *pLen )
+{
+    CTemplateImage *pImage = NULL;
+    CTemplateImageSegment *pImageSegment;
+    Segment *pSegment;
+    char *pText;
+    size_t len;
+    size_t textLen;
+    size_t i;
+
+    if( ( pTemplate != NULL ) &&
+        ( pTemplate->pSource != NULL ) &&
+        ( pTemplate->pFolded == NULL ) &&
+        ( pLen != NULL ) )
+    {
+        textLen = pTemplate->sourceLen + 1;
+        len = sizeof( CTemplateImage ) +
+              pTemplate->nSegments * sizeof( CTemplateImageSegment ) +
+              textLen;
+
+        pImage = calloc( 1, len );
+        if( pImage != NULL )
+        {
+            pImage->magic = CTEMPLATE_MAGIC;
+            pImage->version = CTEMPLATE_VERSION;
+            pImage->contentHash = contentHash;
+            pImage->nSegments = pTemplate->nSegments;
+            pImage->textLen = textLen;
+
+            pText = (char *)&pImage->segments[pImage->nSegments];
+            memcpy( pText, pTemplate->pSource, textLen );
+
+            for( i = 0; i < pTemplate->nSegments; i++ )
+            {
+                pSegment = &pTemplate->pSegments[i];
+                pImageSegment = &pImage->segments[i];
+                pImageSegment->type = pSegment->type;
+                pImageSegment->offset = pSegment->pText - pTemplate->pSource;
+                pImageSegment->len = pSegment->len;
+                pImageSegment->jump = pSegment->jump;
+            }
+
+            *pLen = len;
+        }
+    }
+
+    return pImage;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Load                                                            */
+/*!
+    Load a compiled template from a serialized image
+
+    The CTEMPLATE_Load function creates a compiled template from a
+    serialized image without parsing the template source.  The segments
+    point directly into the image, so the image must remain mapped for
+    the lifetime of the compiled template, and may be read-only.
+
+    Images are read from cache files and shared segments which other
+    processes can write, so the image is checked before it is used.
+    Every segment must lie within the text area, every variable name
+    must be NUL terminated, an @for must jump to its @endfor, an @else
+    to its @endif, and an @if to its @endif or past its @else.
+
+    @param[in]
+       pFileName
+            pointer to the name of the template file
+
+    @param[in]
+       pImage
+            pointer to the serialized image
+
+    @param[in]
+       len
+            length of the serialized image
+
+    @retval pointer to the compiled template
+    @retval NULL if the image is not valid
+
+==============================================================================*/
+CTemplate *CTEMPLATE_Load( char *pFileName,
+                           const CTemplateImage *pImage,
+                           size_t len )
+{
+    CTemplate *pTemplate = NULL;
+    const CTemplateImageSegment *pImageSegment;
+    char *pText;
+    size_t i;
+
+    /* the segment array and the text area must fit in the image */
+    if( ( pFileName != NULL ) &&
+        ( pImage != NULL ) &&
+        ( len >= sizeof( CTemplateImage ) ) &&
+        ( pImage->magic == CTEMPLATE_MAGIC ) &&
+        ( pImage->version == CTEMPLATE_VERSION ) &&
+        ( pImage->nSegments <= ( len - sizeof( CTemplateImage ) ) /
+                               sizeof( CTemplateImageSegment ) ) &&
+        ( pImage->textLen <=
+          len - sizeof( CTemplateImage ) -
+              pImage->nSegments * sizeof( CTemplateImageSegment ) ) )
+    {
+        pTemplate = calloc( 1, sizeof( CTemplate ) );
+        if( pTemplate != NULL )
+        {
+            pTemplate->pFileName = strdup( pFileName );
+            pTemplate->nSegments = pImage->nSegments;
+            pTemplate->pSegments = calloc( pImage->nSegments + 1,
+                                           sizeof( Segment ) );
+            if( pTemplate->pSegments == NULL )
+            {
+                CTEMPLATE_Free( pTemplate );
+                pTemplate = NULL;
+            }
+        }
+
+        pText = (char *)&pImage->segments[pImage->nSegments];
+        for( i = 0; ( pTemplate != NULL ) && ( i < pImage->nSegments ); i++ )
+        {
+            pImageSegment = &pImage->segments[i];
+            if( ( (size_t)pImageSegment->offset + pImageSegment->len >=
+                  pImage->textLen ) ||
+                ( pImageSegment->type > SEGMENT_AVG ) ||
+                ( ( ( pImageSegment->type == SEGMENT_VAR ) ||
+                    ( pImageSegment->type == SEGMENT_IF ) ||
+                    ( pImageSegment->type == SEGMENT_FOR ) ||
+                    ( pImageSegment->type >= SEGMENT_SUM ) ) &&
+                  ( pText[pImageSegment->offset + pImageSegment->len] !=
+                    '\0' ) ) ||
+                ( CheckJump( pImage, i ) == false ) )
+            {
+                /* corrupt image */
+                CTEMPLATE_Free( pTemplate );
+                pTemplate = NULL;
+                break;
+            }
+
+            pTemplate->pSegments[i].type = pImageSegment->type;
+            pTemplate->pSegments[i].pText = &pText[pImageSegment->offset];
+            pTemplate->pSegments[i].len = pImageSegment->len;
+            pTemplate->pSegments[i].jump = pImageSegment->jump;
+            pTemplate->pSegments[i].hVar = VAR_INVALID;
+
+            if( pImageSegment->type == SEGMENT_FOR )
+            {
+                pTemplate->nLoops++;
+            }
+            else if( CTEMPLATE_IS_AGGREGATE( &pTemplate->pSegments[i] ) )
+            {
+                pTemplate->nAggregates++;
+            }
+        }
+    }
+
+    return pTemplate;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Resolve                                                         */
+/*!
+    Resolve the variable references in a compiled template
+
+    The CTEMPLATE_Resolve function looks up the variable handle for
+    every variable reference in the compiled template.  References
+    to variables which do not exist are left as VAR_INVALID and
+    render as empty output, and are counted in the template's
+    missing reference count so they can be retried later with
+    CTEMPLATE_ResolveMissing.  The variables matching the pattern of
+    each loop and aggregate are looked up and kept in its segment, and
+    the result of each aggregate is calculated.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to resolve
+
+    @retval EOK - all variable references were resolved
+    @retval ENOENT - one or more variable references could not be resolved
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int CTEMPLATE_Resolve( VARSERVER_HANDLE hVarServer, CTemplate *pTemplate )
+{
+    int result = EINVAL;
+    Segment *pSegment;
+    size_t i;
+
+    if( ( hVarServer != NULL ) &&
+        ( pTemplate != NULL ) )
+    {
+        result = EOK;
+        pTemplate->nMissing = 0;
+
+        for( i = 0; i < pTemplate->nSegments; i++ )
+        {
+            pSegment = &pTemplate->pSegments[i];
+            if( ( pSegment->type == SEGMENT_VAR ) ||
+                ( pSegment->type == SEGMENT_IF ) )
+            {
+                pSegment->hVar = VAR_FindByName( hVarServer,
+                                                 pSegment->pText );
+                if( pSegment->hVar == VAR_INVALID )
+                {
+                    pTemplate->nMissing++;
+                    result = ENOENT;
+                }
+            }
+            else if( ( pSegment->type == SEGMENT_FOR ) ||
+                     ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) )
+            {
+                CTEMPLATE_FreeMatches( pSegment->pMatches,
+                                       pSegment->nMatches );
+                pSegment->pMatches = NULL;
+                pSegment->nMatches = 0;
+                Match( hVarServer,
+                       pSegment,
+                       &pSegment->pMatches,
+                       &pSegment->nMatches );
+                Aggregate( hVarServer, pSegment );
+            }
+        }
+
+        IndexAggregates( pTemplate );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_ResolveMissing                                                  */
+/*!
+    Retry the unresolved variable references in a compiled template
+
+    The CTEMPLATE_ResolveMissing function looks up the variable handle
+    of every variable reference in the compiled template which could
+    not be resolved before.  References which are already resolved are
+    not looked up again.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to resolve
+
+    @retval number of variable references which were newly resolved
+
+==============================================================================*/
+size_t CTEMPLATE_ResolveMissing( VARSERVER_HANDLE hVarServer,
+                                 CTemplate *pTemplate )
+{
+    Segment *pSegment;
+    size_t resolved = 0;
+    size_t i;
+
+    if( ( hVarServer != NULL ) &&
+        ( pTemplate != NULL ) &&
+        ( pTemplate->nMissing > 0 ) )
+    {
+        for( i = 0; i < pTemplate->nSegments; i++ )
+        {
+            pSegment = &pTemplate->pSegments[i];
+            if( ( ( pSegment->type == SEGMENT_VAR ) ||
+                  ( pSegment->type == SEGMENT_IF ) ) &&
+                ( pSegment->hVar == VAR_INVALID ) )
+            {
+                pSegment->hVar = VAR_FindByName( hVarServer,
+                                                 pSegment->pText );
+                if( pSegment->hVar != VAR_INVALID )
+                {
+                    resolved++;
+                }
+            }
+        }
+
+        pTemplate->nMissing -= resolved;
+    }
+
+    return resolved;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Render                                                          */
+/*!
+    Render a compiled template
+
+    The CTEMPLATE_Render function writes the literal segments of the
+    compiled template to the output file descriptor, and replaces
+    each variable reference with the value of the variable.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to render
+
+    @param[in]
+       fd
+            output file descriptor to render to
+
+    @retval EOK - the template was rendered successfully
+    @retval EINVAL - invalid arguments
+    @retval other error from write()
+
+==============================================================================*/
+int CTEMPLATE_Render( VARSERVER_HANDLE hVarServer,
+                      CTemplate *pTemplate,
+                      int fd )
+{
+    int result = EINVAL;
+    RenderContext context;
+
+    if( ( hVarServer != NULL ) &&
+        ( pTemplate != NULL ) &&
+        ( fd >= 0 ) )
+    {
+        context.hVarServer = hVarServer;
+        context.fd = fd;
+
+        result = CTEMPLATE_Walk( hVarServer,
+                                 pTemplate,
+                                 RenderStep,
+                                 &context );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Walk                                                            */
+/*!
+    Walk the output of a compiled template
+
+    The CTEMPLATE_Walk function calls the visitor function for each
+    piece of output of the compiled template in order, with the text
+    to write, or the handle of the variable whose value is to be
+    written.  Conditional sections are evaluated as they are reached,
+    and only the steps of the taken branches are visited.  The body
+    of each loop is visited once for each of its matching variables.
+    References to variables which do not exist are not visited.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to walk
+
+    @param[in]
+       visitor
+            function to call for each step of the output
+
+    @param[in]
+       pArg
+            opaque argument passed to the visitor function
+
+    @retval EOK - the template was walked
+    @retval EINVAL - invalid arguments
+    @retval other error returned by the visitor function
+
+==============================================================================*/
+int CTEMPLATE_Walk( VARSERVER_HANDLE hVarServer,
+                    CTemplate *pTemplate,
+                    CTemplateVisitor visitor,
+                    void *pArg )
+{
+    int result = EINVAL;
+
+    if( ( pTemplate != NULL ) &&
+        ( visitor != NULL ) )
+    {
+        result = Walk( hVarServer,
+                       pTemplate,
+                       0,
+                       pTemplate->nSegments,
+                       NULL,
+                       visitor,
+                       pArg );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Requery                                                         */
+/*!
+    Look up the variables matching a loop or aggregate again
+
+    The CTEMPLATE_Requery function runs the query of a loop or
+    aggregate segment again, to pick up variables which have been
+    created or deleted since the segment was resolved.  The match list
+    of the segment is only replaced if the set of matching variables
+    has changed, in which case the previous match list is handed back
+    to the caller, who must free it with CTEMPLATE_FreeMatches, and
+    the inputs of an aggregate are read again.  Otherwise the result of
+    an aggregate is recalculated from its remembered inputs, so the
+    rounding errors of its incremental updates do not build up.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pSegment
+            pointer to the loop or aggregate segment
+
+    @param[out]
+       ppPrevious
+            pointer to a location to store the previous match list
+
+    @param[out]
+       pnPrevious
+            pointer to a location to store the length of the previous
+            match list
+
+    @retval true - the match list has changed
+    @retval false - the match list has not changed
+
+==============================================================================*/
+bool CTEMPLATE_Requery( VARSERVER_HANDLE hVarServer,
+                        Segment *pSegment,
+                        LoopMatch **ppPrevious,
+                        size_t *pnPrevious )
+{
+    bool changed = false;
+    LoopMatch *pMatches = NULL;
+    size_t n = 0;
+    size_t i;
+
+    if( ( pSegment != NULL ) &&
+        ( ( pSegment->type == SEGMENT_FOR ) ||
+          ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) ) &&
+        ( ppPrevious != NULL ) &&
+        ( pnPrevious != NULL ) &&
+        ( Match( hVarServer, pSegment, &pMatches, &n ) == EOK ) )
+    {
+        changed = ( n != pSegment->nMatches );
+        for( i = 0; ( i < n ) && ( changed == false ); i++ )
+        {
+            changed = ( pMatches[i].hVar != pSegment->pMatches[i].hVar );
+        }
+
+        if( changed == true )
+        {
+            *ppPrevious = pSegment->pMatches;
+            *pnPrevious = pSegment->nMatches;
+            pSegment->pMatches = pMatches;
+            pSegment->nMatches = n;
+            Aggregate( hVarServer, pSegment );
+        }
+        else
+        {
+            CTEMPLATE_FreeMatches( pMatches, n );
+
+            if( pSegment->pAggregate != NULL )
+            {
+                Rescan( pSegment );
+                Format( pSegment );
+            }
+        }
+    }
+
+    return changed;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Update                                                          */
+/*!
+    Update the aggregates of a compiled template
+
+    The CTEMPLATE_Update function is called when a variable has
+    changed.  It reads the new value of the variable, and updates
+    the result of every aggregate in the template which it is an
+    input of, without visiting the other inputs or the other segments.
+    The variable is read once, however many aggregates it is an input
+    of.  The matches of an aggregate are sorted by variable handle, so
+    the changed input is found with a binary search.  See Update for
+    how the result of each aggregate is updated.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template
+
+    @param[in]
+       hVar
+            handle of the variable which has changed
+
+    @retval true - the variable is an input of an aggregate
+    @retval false - the variable is not an input of an aggregate
+
+==============================================================================*/
+bool CTEMPLATE_Update( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       VAR_HANDLE hVar )
+{
+    bool result = false;
+    Segment *pSegment;
+    LoopMatch key;
+    LoopMatch *pMatch;
+    long double value = 0.0;
+    bool numeric = false;
+    bool fetched = false;
+    size_t n = 0;
+    size_t i;
+
+    key.hVar = hVar;
+
+    if( ( pTemplate != NULL ) &&
+        ( pTemplate->pAggregates != NULL ) )
+    {
+        n = pTemplate->nAggregates;
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        pSegment = &pTemplate->pSegments[pTemplate->pAggregates[i]];
+        pMatch = ( pSegment->pAggregate != NULL )
+                 ? bsearch( &key,
+                            pSegment->pMatches,
+                            pSegment->nMatches,
+                            sizeof( LoopMatch ),
+                            CompareHandles )
+                 : NULL;
+        if( pMatch != NULL )
+        {
+            if( fetched == false )
+            {
+                numeric = GetNumber( hVarServer, hVar, &value );
+                fetched = true;
+            }
+
+            result = Update( pSegment, pMatch, value, numeric );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Fold                                                            */
+/*!
+    Fold the values of constant variables into a compiled template
+
+    The CTEMPLATE_Fold function replaces each resolved reference to a
+    variable whose value never changes with the value of the variable,
+    and merges it with the literal text around it, so the template is
+    rendered with fewer, larger writes and the variable is not fetched
+    again.  The isConstant function is called with the name of each
+    resolved variable reference to decide if it is constant.
+
+    The values are captured with VAR_Print into the scratch file
+    descriptor, which is truncated first.  The literal text of a
+    template with folded references is copied into a buffer owned by
+    the template, and the segments are renumbered, so the segment
+    indices of the template change when any reference is folded.
+    References which are not yet resolved are left alone, and can be
+    folded by calling CTEMPLATE_Fold again once they are resolved.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the resolved compiled template
+
+    @param[in]
+       isConstant
+            function which checks if a variable is constant
+
+    @param[in]
+       pArg
+            argument passed to the isConstant function
+
+    @param[in]
+       fd
+            scratch file descriptor used to capture the values
+
+    @retval number of variable references which were folded
+
+==============================================================================*/
+size_t CTEMPLATE_Fold( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       CTemplateConstant isConstant,
+                       void *pArg,
+                       int fd )
+{
+    size_t n = 0;
+    FoldValue *pValues = NULL;
+    Segment *pSegments = NULL;
+    Segment *pSegment;
+    size_t *pIndex = NULL;
+    char *pCapture = NULL;
+    char *pFolded = NULL;
+    char *pText;
+    size_t textLen = 0;
+    size_t count = 0;
+    bool literal;
+    off_t offset;
+    off_t end;
+    size_t i;
+
+    if( ( pTemplate != NULL ) &&
+        ( pTemplate->nSegments > 0 ) &&
+        ( isConstant != NULL ) &&
+        ( fd >= 0 ) &&
+        ( ftruncate( fd, 0 ) == 0 ) &&
+        ( lseek( fd, 0, SEEK_SET ) == 0 ) )
+    {
+        pValues = calloc( pTemplate->nSegments, sizeof( FoldValue ) );
+    }
+
+    for( i = 0; ( pValues != NULL ) && ( i < pTemplate->nSegments ); i++ )
+    {
+        pSegment = &pTemplate->pSegments[i];
+        if( ( pSegment->type == SEGMENT_VAR ) &&
+            ( pSegment->hVar != VAR_INVALID ) &&
+            ( isConstant( pArg, pSegment->pText ) == true ) )
+        {
+            offset = lseek( fd, 0, SEEK_CUR );
+            if( ( offset >= 0 ) &&
+                ( VAR_Print( hVarServer, pSegment->hVar, fd ) == EOK ) &&
+                ( ( end = lseek( fd, 0, SEEK_CUR ) ) >= offset ) )
+            {
+                pValues[i].folded = true;
+                pValues[i].offset = offset;
+                pValues[i].len = end - offset;
+                n++;
+            }
+            else if( offset >= 0 )
+            {
+                /* discard any partial value */
+                lseek( fd, offset, SEEK_SET );
+            }
+        }
+
+        if( pValues[i].folded == true )
+        {
+            textLen += pValues[i].len;
+        }
+        else if( pSegment->type == SEGMENT_LITERAL )
+        {
+            textLen += pSegment->len;
+        }
+    }
+
+    if( n > 0 )
+    {
+        end = lseek( fd, 0, SEEK_CUR );
+        pCapture = ( end > 0 ) ? malloc( end ) : NULL;
+        pFolded = malloc( textLen + 1 );
+        pSegments = calloc( pTemplate->nSegments, sizeof( Segment ) );
+        pIndex = calloc( pTemplate->nSegments, sizeof( size_t ) );
+
+        if( ( ( end > 0 ) &&
+              ( ( pCapture == NULL ) ||
+                ( pread( fd, pCapture, end, 0 ) != end ) ) ) ||
+            ( pFolded == NULL ) ||
+            ( pSegments == NULL ) ||
+            ( pIndex == NULL ) )
+        {
+            n = 0;
+        }
+    }
+
+    if( n > 0 )
+    {
+        pText = pFolded;
+        for( i = 0; i < pTemplate->nSegments; i++ )
+        {
+            pSegment = &pTemplate->pSegments[i];
+            literal = ( pSegment->type == SEGMENT_LITERAL ) ||
+                      ( pValues[i].folded == true );
+
+            if( ( literal == true ) &&
+                ( count > 0 ) &&
+                ( pSegments[count - 1].type == SEGMENT_LITERAL ) )
+            {
+                /* merge with the preceding literal text */
+                pIndex[i] = count - 1;
+            }
+            else if( literal == true )
+            {
+                pIndex[i] = count;
+                pSegments[count].type = SEGMENT_LITERAL;
+                pSegments[count].pText = pText;
+                pSegments[count].hVar = VAR_INVALID;
+                count++;
+            }
+            else
+            {
+                pIndex[i] = count;
+                pSegments[count++] = *pSegment;
+            }
+
+            if( pValues[i].folded == true )
+            {
+                memcpy( pText, &pCapture[pValues[i].offset], pValues[i].len );
+                pText += pValues[i].len;
+                pSegments[count - 1].len += pValues[i].len;
+            }
+            else if( pSegment->type == SEGMENT_LITERAL )
+            {
+                memcpy( pText, pSegment->pText, pSegment->len );
+                pText += pSegment->len;
+                pSegments[count - 1].len += pSegment->len;
+            }
+        }
+
+        *pText = '\0';
+
+        for( i = 0; i < count; i++ )
+        {
+            if( ( ( pSegments[i].type == SEGMENT_IF ) ||
+                  ( pSegments[i].type == SEGMENT_ELSE ) ||
+                  ( pSegments[i].type == SEGMENT_FOR ) ) &&
+                ( pSegments[i].jump < pTemplate->nSegments ) )
+            {
+                pSegments[i].jump = pIndex[pSegments[i].jump];
+            }
+        }
+
+        /* the literal text of a previous fold has been copied */
+        free( pTemplate->pFolded );
+        free( pTemplate->pSegments );
+        pTemplate->pFolded = pFolded;
+        pTemplate->pSegments = pSegments;
+        pTemplate->nSegments = count;
+        pFolded = NULL;
+        pSegments = NULL;
+
+        /* the aggregates have been renumbered */
+        IndexAggregates( pTemplate );
+    }
+
+    free( pValues );
+    free( pCapture );
+    free( pFolded );
+    free( pSegments );
+    free( pIndex );
+
+    return n;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_FreeMatches                                                     */
+/*!
+    Free a loop match list
+
+    The CTEMPLATE_FreeMatches function frees the variable names of a
+    loop match list, and the list which holds them.
+
+    @param[in]
+       pMatches
+            pointer to the match list
+
+    @param[in]
+       n
+            number of entries in the match list
+
+==============================================================================*/
+void CTEMPLATE_FreeMatches( LoopMatch *pMatches, size_t n )
+{
+    size_t i;
+
+    if( pMatches != NULL )
+    {
+        for( i = 0; i < n; i++ )
+        {
+            free( pMatches[i].pName );
+        }
+
+        free( pMatches );
+    }
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Skip                                                            */
+/*!
+    Get the next segment of a compiled template to render
+
+    The CTEMPLATE_Skip function steps over the conditional section
+    segments of a compiled template, starting at the specified segment,
+    and returns the index of the next segment to render, which is a
+    literal, a variable reference or a loop segment.  Only the
+    condition variable of a conditional section is read.  The segments
+    of an untaken branch are jumped over without being visited, so the
+    variables they reference are never fetched.
+
+    A condition is true if its variable exists and has a non-zero
+    numeric value, or a non-empty string or blob value.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template
+
+    @param[in]
+       i
+            index of the segment to start at
+
+    @retval index of the next segment to render
+    @retval number of segments in the template if there is none
+
+==============================================================================*/
+size_t CTEMPLATE_Skip( VARSERVER_HANDLE hVarServer,
+                       CTemplate *pTemplate,
+                       size_t i )
+{
+    Segment *pSegment;
+
+    while( i < pTemplate->nSegments )
+    {
+        pSegment = &pTemplate->pSegments[i];
+        if( pSegment->type == SEGMENT_IF )
+        {
+            i = ( Test( hVarServer, pSegment->hVar ) == true )
+                ? i + 1
+                : pSegment->jump;
+        }
+        else if( pSegment->type == SEGMENT_ELSE )
+        {
+            /* the end of a taken branch */
+            i = pSegment->jump;
+        }
+        else if( pSegment->type == SEGMENT_ENDIF )
+        {
+            i++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Free                                                            */
+/*!
+    Free a compiled template
+
+    The CTEMPLATE_Free function releases all of the resources
+    associated with a compiled template.  The image of a template
+    created by CTEMPLATE_Load is not owned by the template, and is
+    not freed, unless it has been handed over to the template as
+    its memory mapping.
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to free
+
+==============================================================================*/
+void CTEMPLATE_Free( CTemplate *pTemplate )
+{
+    size_t i;
+
+    if( pTemplate != NULL )
+    {
+        for( i = 0; ( pTemplate->pSegments != NULL ) &&
+                    ( i < pTemplate->nSegments ); i++ )
+        {
+            CTEMPLATE_FreeMatches( pTemplate->pSegments[i].pMatches,
+                                   pTemplate->pSegments[i].nMatches );
+            free( pTemplate->pSegments[i].pAggregate );
+        }
+
+        free( pTemplate->pFileName );
+        free( pTemplate->pSource );
+        free( pTemplate->pFolded );
+        free( pTemplate->pSegments );
+        free( pTemplate->pAggregates );
+
+        if( pTemplate->pMapping != NULL )
+        {
+            munmap( (void *)pTemplate->pMapping, pTemplate->mappingLen );
+        }
+
+        free( pTemplate );
+    }
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_Write                                                           */
+/*!
+    Write a buffer to a file descriptor
+
+    The CTEMPLATE_Write function writes the entire buffer to the
+    specified file descriptor, retrying on short writes and
+    interrupted system calls.
+
+    @param[in]
+       fd
+            output file descriptor
+
+    @param[in]
+       pBuf
+            pointer to the buffer to write
+
+    @param[in]
+       len
+            number of bytes to write
+
+    @retval EOK - the buffer was written
+    @retval other error from write()
+
+==============================================================================*/
+int CTEMPLATE_Write( int fd, const char *pBuf, size_t len )
+{
+    int result = EOK;
+    ssize_t n;
+
+    while( ( len > 0 ) && ( result == EOK ) )
+    {
+        n = write( fd, pBuf, len );
+        if( n > 0 )
+        {
+            pBuf += n;
+            len -= n;
+        }
+        else if( ( n < 0 ) && ( errno != EINTR ) )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_ReadFile                                                        */
+/*!
+    Read a template file into memory
+
+    The CTEMPLATE_ReadFile function reads the entire content of the
+    specified file into a NUL terminated buffer allocated on the heap.
+
+    @param[in]
+       pFileName
+            pointer to the name of the file to read
+
+    @param[out]
+       pLen
+            pointer to a location to store the file length
+
+    @retval pointer to the file content
+    @retval NULL if the file could not be read
+
+==============================================================================*/
+char *CTEMPLATE_ReadFile( char *pFileName, size_t *pLen )
+{
+    char *pBuf = NULL;
+    struct stat sb;
+    size_t len = 0;
+    ssize_t n;
+    int fd;
+
+    fd = open( pFileName, O_RDONLY );
+    if( fd >= 0 )
+    {
+        if( fstat( fd, &sb ) == 0 )
+        {
+            pBuf = malloc( sb.st_size + 1 );
+        }
+
+        while( ( pBuf != NULL ) && ( len < (size_t)sb.st_size ) )
+        {
+            n = read( fd, &pBuf[len], sb.st_size - len );
+            if( n > 0 )
+            {
+                len += n;
+            }
+            else if( ( n == 0 ) || ( errno != EINTR ) )
+            {
+                break;
+            }
+        }
+
+        if( pBuf != NULL )
+        {
+            pBuf[len] = '\0';
+            *pLen = len;
+        }
+
+        close( fd );
+    }
+
+    return pBuf;
+}
+
+/*============================================================================*/
+/*  CTEMPLATE_ReadTemplate                                                    */
+/*!
+    Read a template file and flatten its includes
+
+    The CTEMPLATE_ReadTemplate function reads the entire content of the
+    specified template file into a NUL terminated buffer allocated on
+    the heap, replacing every ${@include path} directive with the
+    content of the included file.  Relative include paths are relative
+    to the directory of the including file.  Included files may
+    include other files, up to CTEMPLATE_MAX_INCLUDE_DEPTH levels deep.
+    A file which includes itself, directly or indirectly, is rejected
+    when the template is read, so the compiled template never refers
+    to its includes and renders as a single list of segments.
+
+    @param[in]
+       pFileName
+            pointer to the name of the template file to read
+
+    @param[out]
+       pLen
+            pointer to a location to store the flattened length
+
+    @retval pointer to the flattened template content
+    @retval NULL if the template or one of its includes could not be read
+
+==============================================================================*/
+char *CTEMPLATE_ReadTemplate( char *pFileName, size_t *pLen )
+{
+    char *pSource;
+    IncludeBuffer buf;
+    IncludeStack stack;
+    size_t len;
+
+    pSource = CTEMPLATE_ReadFile( pFileName, &len );
+    if( ( pSource != NULL ) &&
+        ( strstr( pSource, INCLUDE_DIRECTIVE ) != NULL ) )
+    {
+        memset( &buf, 0, sizeof( buf ) );
+        memset( &stack, 0, sizeof( stack ) );
+
+        if( Include( pFileName, pSource, len, &stack, &buf ) == EOK )
+        {
+            *pLen = buf.len;
+        }
+        else
+        {
+            free( buf.pBuf );
+            buf.pBuf = NULL;
+        }
+
+        free( pSource );
+        pSource = buf.pBuf;
+    }
+    else if( pSource != NULL )
+    {
+        *pLen = len;
+    }
+
+    return pSource;
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  Parse                                                                     */
+/*!
+    Parse the template source into segments
+
+    The Parse function splits the template source into literal and
+    variable reference segments.  Variable references are enclosed
+    in ${ } tags.  The closing brace of each variable reference is
+    overwritten with a NUL terminator so the segment can be used
+    directly as a variable name.  An unterminated variable reference
+    is treated as literal text.  References starting with an @
+    character are conditional section and loop directives.
+
+    @param[in]
+       pTemplate
+            pointer to the template to parse
+
+    @retval EOK - the template was parsed
+    @retval EINVAL - invalid or unbalanced directive
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Parse( CTemplate *pTemplate )
+{
+    int result = EOK;
+    char *p = pTemplate->pSource;
+    char *pEnd = pTemplate->pSource + pTemplate->sourceLen;
+    char *pStart;
+    char *pClose;
+    size_t size = 0;
+    size_t open = 0;
+
+    while( ( p < pEnd ) && ( result == EOK ) )
+    {
+        pStart = strstr( p, "${" );
+        pClose = ( pStart != NULL ) ? strchr( pStart + 2, '}' ) : NULL;
+        if( pClose == NULL )
+        {
+            /* the rest of the template is literal text */
+            result = AddSegment( pTemplate,
+                                 &size,
+                                 SEGMENT_LITERAL,
+                                 p,
+                                 pEnd - p );
+            break;
+        }
+
+        if( pStart > p )
+        {
+            result = AddSegment( pTemplate,
+                                 &size,
+                                 SEGMENT_LITERAL,
+                                 p,
+                                 pStart - p );
+        }
+
+        if( result == EOK )
+        {
+            *pClose = '\0';
+            if( pStart[2] == '@' )
+            {
+                result = AddDirective( pTemplate, &size, &open, pStart + 3 );
+            }
+            else
+            {
+                result = AddSegment( pTemplate,
+                                     &size,
+                                     SEGMENT_VAR,
+                                     pStart + 2,
+                                     pClose - pStart - 2 );
+            }
+        }
+
+        p = pClose + 1;
+    }
+
+    if( ( result == EOK ) &&
+        ( open != 0 ) )
+    {
+        syslog( LOG_ERR,
+                "filevars: unterminated @if or @for in %s",
+                pTemplate->pFileName );
+        result = EINVAL;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddSegment                                                                */
+/*!
+    Append a segment to a compiled template
+
+    The AddSegment function appends a segment to the template's
+    segment array, growing the array as required.
+
+    @param[in]
+       pTemplate
+            pointer to the template to add the segment to
+
+    @param[in,out]
+       pSize
+            pointer to the allocated size of the segment array
+
+    @param[in]
+       type
+            type of segment to add
+
+    @param[in]
+       pText
+            pointer to the segment text
+
+    @param[in]
+       len
+            length of the segment text
+
+    @retval EOK - the segment was added
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int AddSegment( CTemplate *pTemplate,
+                       size_t *pSize,
+                       SegmentType type,
+                       char *pText,
+                       size_t len )
+{
+    int result = EOK;
+    Segment *pSegments;
+    Segment *pSegment;
+    size_t size;
+
+    if( pTemplate->nSegments == *pSize )
+    {
+        size = ( *pSize == 0 ) ? CTEMPLATE_INITIAL_SEGMENTS : *pSize * 2;
+        pSegments = realloc( pTemplate->pSegments, size * sizeof( Segment ) );
+        if( pSegments != NULL )
+        {
+            pTemplate->pSegments = pSegments;
+            *pSize = size;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    if( result == EOK )
+    {
+        pSegment = &pTemplate->pSegments[pTemplate->nSegments++];
+        pSegment->type = type;
+        pSegment->pText = pText;
+        pSegment->len = len;
+        pSegment->jump = 0;
+        pSegment->hVar = VAR_INVALID;
+        pSegment->pMatches = NULL;
+        pSegment->nMatches = 0;
+        pSegment->pAggregate = NULL;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  AddDirective                                                              */
+/*!
+    Append a conditional section or loop directive to a template
+
+    The AddDirective function appends the segment for a ${@if var},
+    ${@else}, ${@endif}, ${@for pattern}, ${@endfor}, ${@name},
+    ${@value} or aggregate directive to the template's segment
+    array.  While a
+    conditional section or loop is open, the jump index of its
+    innermost segment links to the enclosing open section, so nested
+    sections can be matched without a separate stack.  When a section
+    is closed, the jump index of its ${@if} segment is set to the
+    segment following its ${@else}, or to its ${@endif}, the jump
+    index of its ${@else} is set to its ${@endif}, and the jump index
+    of a ${@for} segment is set to its ${@endfor}.
+
+    @param[in]
+       pTemplate
+            pointer to the template to add the directive to
+
+    @param[in,out]
+       pSize
+            pointer to the allocated size of the segment array
+
+    @param[in,out]
+       pOpen
+            pointer to the index plus one of the innermost open
+            section segment, or 0 if there is none
+
+    @param[in]
+       pText
+            pointer to the NUL terminated directive text following
+            the @ character
+
+    @retval EOK - the directive was added
+    @retval EINVAL - unknown or unbalanced directive
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int AddDirective( CTemplate *pTemplate,
+                         size_t *pSize,
+                         size_t *pOpen,
+                         char *pText )
+{
+    int result = EINVAL;
+    SegmentType type = SEGMENT_LITERAL;
+    Segment *pOpenSegment = NULL;
+    size_t idx = pTemplate->nSegments;
+    size_t parent;
+    size_t len;
+    char *pArg;
+
+    pArg = Argument( pText, &len );
+
+    if( *pOpen > 0 )
+    {
+        pOpenSegment = &pTemplate->pSegments[*pOpen - 1];
+    }
+
+    if( len > 0 )
+    {
+        if( strcmp( pText, "if" ) == 0 )
+        {
+            type = SEGMENT_IF;
+        }
+        else if( strcmp( pText, "for" ) == 0 )
+        {
+            type = SEGMENT_FOR;
+        }
+        else if( strcmp( pText, "sum" ) == 0 )
+        {
+            type = SEGMENT_SUM;
+        }
+        else if( strcmp( pText, "min" ) == 0 )
+        {
+            type = SEGMENT_MIN;
+        }
+        else if( strcmp( pText, "max" ) == 0 )
+        {
+            type = SEGMENT_MAX;
+        }
+        else if( strcmp( pText, "count" ) == 0 )
+        {
+            type = SEGMENT_COUNT;
+        }
+        else if( strcmp( pText, "avg" ) == 0 )
+        {
+            type = SEGMENT_AVG;
+        }
+    }
+    else if( strcmp( pText, "else" ) == 0 )
+    {
+        if( ( pOpenSegment != NULL ) &&
+            ( pOpenSegment->type == SEGMENT_IF ) )
+        {
+            type = SEGMENT_ELSE;
+        }
+    }
+    else if( strcmp( pText, "endif" ) == 0 )
+    {
+        if( ( pOpenSegment != NULL ) &&
+            ( ( pOpenSegment->type == SEGMENT_IF ) ||
+              ( pOpenSegment->type == SEGMENT_ELSE ) ) )
+        {
+            type = SEGMENT_ENDIF;
+        }
+    }
+    else if( strcmp( pText, "endfor" ) == 0 )
+    {
+        if( ( pOpenSegment != NULL ) &&
+            ( pOpenSegment->type == SEGMENT_FOR ) )
+        {
+            type = SEGMENT_ENDFOR;
+        }
+    }
+    else if( InLoop( pTemplate, *pOpen ) == true )
+    {
+        if( strcmp( pText, "name" ) == 0 )
+        {
+            type = SEGMENT_NAME;
+        }
+        else if( strcmp( pText, "value" ) == 0 )
+        {
+            type = SEGMENT_VALUE;
+        }
+    }
+
+    if( type != SEGMENT_LITERAL )
+    {
+        result = AddSegment( pTemplate, pSize, type, pArg, len );
+    }
+
+    if( result == EOK )
+    {
+        /* the segment array may have moved */
+        if( *pOpen > 0 )
+        {
+            pOpenSegment = &pTemplate->pSegments[*pOpen - 1];
+        }
+
+        switch( type )
+        {
+            case SEGMENT_FOR:
+                pTemplate->nLoops++;
+                /* fall through */
+
+            case SEGMENT_IF:
+                pTemplate->pSegments[idx].jump = *pOpen;
+                *pOpen = idx + 1;
+                break;
+
+            case SEGMENT_ELSE:
+                pTemplate->pSegments[idx].jump = pOpenSegment->jump;
+                pOpenSegment->jump = idx + 1;
+                *pOpen = idx + 1;
+                break;
+
+            case SEGMENT_ENDIF:
+            case SEGMENT_ENDFOR:
+                parent = pOpenSegment->jump;
+                pOpenSegment->jump = idx;
+                *pOpen = parent;
+                break;
+
+            case SEGMENT_SUM:
+            case SEGMENT_MIN:
+            case SEGMENT_MAX:
+            case SEGMENT_COUNT:
+            case SEGMENT_AVG:
+                pTemplate->nAggregates++;
+                break;
+
+            default:
+                break;
+        }
+    }
+    else if( result == EINVAL )
+    {
+        syslog( LOG_ERR,
+                "filevars: invalid directive @%s in %s",
+                pText,
+                pTemplate->pFileName );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Argument                                                                  */
+/*!
+    Split the argument from a directive
+
+    The Argument function NUL terminates the keyword at the start of
+    the directive text, and gets the argument which follows it, without
+    surrounding white space.
+
+    @param[in]
+       pText
+            pointer to the NUL terminated directive text
+
+    @param[out]
+       pLen
+            pointer to a location to store the length of the argument
+
+    @retval pointer to the NUL terminated argument
+
+==============================================================================*/
+static char *Argument( char *pText, size_t *pLen )
+{
+    char *pArg = pText;
+    char *pEnd;
+
+    while( ( *pArg != '\0' ) && ( !isspace( (unsigned char)*pArg ) ) )
+    {
+        pArg++;
+    }
+
+    if( *pArg != '\0' )
+    {
+        *pArg++ = '\0';
+    }
+
+    while( isspace( (unsigned char)*pArg ) )
+    {
+        pArg++;
+    }
+
+    pEnd = pArg + strlen( pArg );
+    while( ( pEnd > pArg ) && ( isspace( (unsigned char)pEnd[-1] ) ) )
+    {
+        *--pEnd = '\0';
+    }
+
+    *pLen = pEnd - pArg;
+
+    return pArg;
+}
+
+/*============================================================================*/
+/*  InLoop                                                                    */
+/*!
+    Check if a directive is inside a loop
+
+    The InLoop function follows the chain of open sections, from the
+    innermost one outwards, to see if one of them is a loop.
+
+    @param[in]
+       pTemplate
+            pointer to the template being parsed
+
+    @param[in]
+       open
+            index plus one of the innermost open section segment,
+            or 0 if there is none
+
+    @retval true - the directive is inside a loop
+    @retval false - the directive is not inside a loop
+
+==============================================================================*/
+static bool InLoop( CTemplate *pTemplate, size_t open )
+{
+    bool result = false;
+
+    while( ( open > 0 ) && ( result == false ) )
+    {
+        result = ( pTemplate->pSegments[open - 1].type == SEGMENT_FOR );
+        open = pTemplate->pSegments[open - 1].jump;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Walk                                                                      */
+/*!
+    Walk the output of a range of template segments
+
+    The Walk function calls the visitor function for each piece of
+    output of the segments in the specified range.  The body of a loop
+    is walked recursively once for each of its matching variables.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pTemplate
+            pointer to the compiled template to walk
+
+    @param[in]
+       from
+            index of the first segment to walk
+
+    @param[in]
+       to
+            index of the segment following the range
+
+    @param[in]
+       pMatch
+            pointer to the current match of the innermost loop,
+            or NULL if the range is not inside a loop
+
+    @param[in]
+       visitor
+            function to call for each step of the output
+
+    @param[in]
+       pArg
+            opaque argument passed to the visitor function
+
+    @retval EOK - the segments were walked
+    @retval other error returned by the visitor function
+
+==============================================================================*/
+static int Walk( VARSERVER_HANDLE hVarServer,
+                 CTemplate *pTemplate,
+                 size_t from,
+                 size_t to,
+                 const LoopMatch *pMatch,
+                 CTemplateVisitor visitor,
+                 void *pArg )
+{
+    int result = EOK;
+    CTemplateStep step;
+    Segment *pSegment;
+    size_t i;
+    size_t j;
+
+    for( i = CTEMPLATE_Skip( hVarServer, pTemplate, from );
+         ( i < to ) && ( result == EOK );
+         i = CTEMPLATE_Skip( hVarServer, pTemplate, i + 1 ) )
+    {
+        pSegment = &pTemplate->pSegments[i];
+
+        step.idx = i;
+        step.pText = NULL;
+        step.len = 0;
+        step.hVar = VAR_INVALID;
+        step.loop = false;
+
+        switch( pSegment->type )
+        {
+            case SEGMENT_LITERAL:
+                step.pText = pSegment->pText;
+                step.len = pSegment->len;
+                break;
+
+            case SEGMENT_VAR:
+                step.hVar = pSegment->hVar;
+                break;
+
+            case SEGMENT_NAME:
+                if( pMatch != NULL )
+                {
+                    step.pText = pMatch->pName;
+                    step.len = strlen( pMatch->pName );
+                }
+                break;
+
+            case SEGMENT_VALUE:
+                if( pMatch != NULL )
+                {
+                    step.hVar = pMatch->hVar;
+                    step.loop = true;
+                }
+                break;
+
+            case SEGMENT_SUM:
+            case SEGMENT_MIN:
+            case SEGMENT_MAX:
+            case SEGMENT_COUNT:
+            case SEGMENT_AVG:
+                if( pSegment->pAggregate != NULL )
+                {
+                    step.pText = pSegment->pAggregate->text;
+                    step.len = pSegment->pAggregate->len;
+                }
+                break;
+
+            case SEGMENT_FOR:
+                for( j = 0;
+                     ( j < pSegment->nMatches ) && ( result == EOK );
+                     j++ )
+                {
+                    result = Walk( hVarServer,
+                                   pTemplate,
+                                   i + 1,
+                                   pSegment->jump,
+                                   &pSegment->pMatches[j],
+                                   visitor,
+                                   pArg );
+                }
+
+                /* continue after the end of the loop */
+                i = pSegment->jump;
+                break;
+
+            default:
+                break;
+        }
+
+        if( ( result == EOK ) &&
+            ( ( step.pText != NULL ) || ( step.hVar != VAR_INVALID ) ) )
+        {
+            result = visitor( pArg, &step );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RenderStep                                                                */
+/*!
+    Render a step of the template output
+
+    The RenderStep function is the CTEMPLATE_Walk visitor used by
+    CTEMPLATE_Render.  It writes the text of the step, or prints the
+    value of its variable, to the output file descriptor.
+
+    @param[in]
+       pArg
+            pointer to the render context
+
+    @param[in]
+       pStep
+            pointer to the step to render
+
+    @retval EOK - the step was rendered
+    @retval other error from write()
+
+==============================================================================*/
+static int RenderStep( void *pArg, const CTemplateStep *pStep )
+{
+    int result = EOK;
+    RenderContext *pContext = (RenderContext *)pArg;
+
+    if( pStep->pText != NULL )
+    {
+        result = CTEMPLATE_Write( pContext->fd, pStep->pText, pStep->len );
+    }
+    else
+    {
+        VAR_Print( pContext->hVarServer, pStep->hVar, pContext->fd );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Query                                                                     */
+/*!
+    Look up the variables matching a loop pattern
+
+    The Query function queries the variable server for the variables
+    matching a loop pattern.  A pattern starting with a # character
+    matches the variables which have the tag which follows it.  Any
+    other pattern is a shell wildcard pattern, in which * and ? do
+    not match the / character, that is matched against the variable
+    names.  The variable server is asked for the names containing the
+    literal text before the first wildcard, and the wildcards are
+    matched here.  The matches are sorted by name.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pPattern
+            pointer to the NUL terminated loop pattern
+
+    @param[out]
+       ppMatches
+            pointer to a location to store the match list
+
+    @param[out]
+       pCount
+            pointer to a location to store the number of matches
+
+    @retval EOK - the query was run
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Query( VARSERVER_HANDLE hVarServer,
+                  const char *pPattern,
+                  LoopMatch **ppMatches,
+                  size_t *pCount )
+{
+    int result = EOK;
+    LoopMatch *pMatches = NULL;
+    LoopMatch *p;
+    VarQuery query;
+    VarObject obj;
+    char *pPrefix = NULL;
+    size_t size = 0;
+    size_t n = 0;
+    int rc;
+
+    memset( &query, 0, sizeof( query ) );
+    if( pPattern[0] == '#' )
+    {
+        query.type = QUERY_TAGSPEC;
+        snprintf( query.tagspec, sizeof( query.tagspec ), "%s", &pPattern[1] );
+    }
+    else
+    {
+        pPrefix = strndup( pPattern, strcspn( pPattern, "*?[" ) );
+        query.type = QUERY_MATCH;
+        query.match = pPrefix;
+        result = ( pPrefix != NULL ) ? EOK : ENOMEM;
+    }
+
+    rc = ( result == EOK ) ? VAR_GetFirst( hVarServer, &query, &obj ) : ENOENT;
+    while( ( rc == EOK ) && ( result == EOK ) )
+    {
+        if( ( pPrefix == NULL ) ||
+            ( fnmatch( pPattern, query.name, FNM_PATHNAME ) == 0 ) )
+        {
+            if( n == size )
+            {
+                size = ( size == 0 ) ? CTEMPLATE_INITIAL_SEGMENTS : size * 2;
+                p = realloc( pMatches, size * sizeof( LoopMatch ) );
+                if( p != NULL )
+                {
+                    pMatches = p;
+                }
+                else
+                {
+                    result = ENOMEM;
+                }
+            }
+
+            if( result == EOK )
+            {
+                pMatches[n].hVar = query.hVar;
+                pMatches[n].pName = strdup( query.name );
+                result = ( pMatches[n++].pName != NULL ) ? EOK : ENOMEM;
+            }
+        }
+
+        rc = VAR_GetNext( hVarServer, &query, &obj );
+    }
+
+    if( result == EOK )
+    {
+        if( n > 0 )
+        {
+            qsort( pMatches, n, sizeof( LoopMatch ), CompareMatches );
+        }
+
+        *ppMatches = pMatches;
+        *pCount = n;
+    }
+    else
+    {
+        CTEMPLATE_FreeMatches( pMatches, n );
+    }
+
+    free( pPrefix );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CompareMatches                                                            */
+/*!
+    Compare two loop matches by name
+
+    The CompareMatches function is the qsort comparison function used
+    to sort loop matches by variable name.
+
+    @param[in]
+       p1
+            pointer to the first loop match
+
+    @param[in]
+       p2
+            pointer to the second loop match
+
+    @retval <0 if the first name sorts first
+    @retval 0 if the names are equal
+    @retval >0 if the second name sorts first
+
+==============================================================================*/
+static int CompareMatches( const void *p1, const void *p2 )
+{
+    return strcmp( ((const LoopMatch *)p1)->pName,
+                   ((const LoopMatch *)p2)->pName );
+}
+
+/*============================================================================*/
+/*  Test                                                                      */
+/*!
+    Test the condition of a conditional section
+
+    The Test function reads the value of the condition variable of a
+    conditional section.  The condition is true if the variable exists
+    and has a non-zero numeric value, or a non-empty string or blob
+    value.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       hVar
+            handle of the condition variable
+
+    @retval true - the condition is true
+    @retval false - the condition is false
+
+==============================================================================*/
+static bool Test( VARSERVER_HANDLE hVarServer, VAR_HANDLE hVar )
+{
+    bool result = false;
+    VarObject obj;
+
+    memset( &obj, 0, sizeof( obj ) );
+    if( ( hVar != VAR_INVALID ) &&
+        ( VAR_Get( hVarServer, hVar, &obj ) == EOK ) )
+    {
+        switch( obj.type )
+        {
+            case VARTYPE_STR:
+                result = ( obj.val.str != NULL ) && ( obj.val.str[0] != '\0' );
+                break;
+
+            case VARTYPE_BLOB:
+                result = ( obj.val.blob != NULL ) && ( obj.len > 0 );
+                break;
+
+            case VARTYPE_UINT16:
+                result = ( obj.val.ui != 0 );
+                break;
+
+            case VARTYPE_INT16:
+                result = ( obj.val.i != 0 );
+                break;
+
+            case VARTYPE_UINT32:
+                result = ( obj.val.ul != 0 );
+                break;
+
+            case VARTYPE_INT32:
+                result = ( obj.val.l != 0 );
+                break;
+
+            case VARTYPE_UINT64:
+                result = ( obj.val.ull != 0 );
+                break;
+
+            case VARTYPE_INT64:
+                result = ( obj.val.ll != 0 );
+                break;
+
+            case VARTYPE_FLOAT:
+                result = ( obj.val.f != 0.0f );
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Include                                                                   */
+/*!
+    Append a template source to the flattened template
+
+    The Include function appends the template source to the flattened
+    template buffer, recursively replacing each ${@include path}
+    directive with the flattened content of the included file.  The
+    canonical names of the files being included are kept on the
+    include stack so include cycles can be detected.
+
+    @param[in]
+       pFileName
+            pointer to the name of the file the source was read from
+
+    @param[in]
+       pSource
+            pointer to the NUL terminated template source
+
+    @param[in]
+       len
+            length of the template source
+
+    @param[in,out]
+       pStack
+            pointer to the stack of files being included
+
+    @param[in,out]
+       pBuf
+            pointer to the flattened template buffer
+
+    @retval EOK - the source was appended
+    @retval ELOOP - include cycle, or the includes are nested too deeply
+    @retval ENOENT - an included file could not be read
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Include( char *pFileName,
+                    char *pSource,
+                    size_t len,
+                    IncludeStack *pStack,
+                    IncludeBuffer *pBuf )
+{
+    int result = EOK;
+    char *p = pSource;
+    char *pEnd = pSource + len;
+    char *pStart;
+    char *pClose;
+    char *pName;
+    char *pPath;
+    bool pushed = false;
+    size_t i;
+
+    pName = realpath( pFileName, NULL );
+    if( pName == NULL )
+    {
+        result = ENOENT;
+    }
+    else if( pStack->depth == CTEMPLATE_MAX_INCLUDE_DEPTH )
+    {
+        syslog( LOG_ERR,
+                "filevars: includes nested too deeply at %s",
+                pFileName );
+        result = ELOOP;
+    }
+
+    for( i = 0; ( result == EOK ) && ( i < pStack->depth ); i++ )
+    {
+        if( strcmp( pStack->pNames[i], pName ) == 0 )
+        {
+            syslog( LOG_ERR,
+                    "filevars: include cycle in %s at %s",
+                    pStack->pNames[0],
+                    pFileName );
+            result = ELOOP;
+        }
+    }
+
+    if( result == EOK )
+    {
+        pStack->pNames[pStack->depth++] = pName;
+        pushed = true;
+    }
+
+    while( ( p < pEnd ) && ( result == EOK ) )
+    {
+        pStart = strstr( p, INCLUDE_DIRECTIVE );
+        pClose = ( pStart != NULL ) ? strchr( pStart, '}' ) : NULL;
+        if( pClose == NULL )
+        {
+            result = Append( pBuf, p, pEnd - p );
+            break;
+        }
+
+        result = Append( pBuf, p, pStart - p );
+        if( result == EOK )
+        {
+            pPath = IncludePath( pFileName,
+                                 pStart + sizeof( INCLUDE_DIRECTIVE ) - 1,
+                                 pClose );
+            result = ( pPath != NULL ) ? EOK : ENOMEM;
+        }
+
+        if( result == EOK )
+        {
+            result = IncludeFile( pPath, pStack, pBuf );
+            free( pPath );
+        }
+
+        p = pClose + 1;
+    }
+
+    if( pushed == true )
+    {
+        pStack->depth--;
+    }
+
+    free( pName );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IncludeFile                                                               */
+/*!
+    Append an included file to the flattened template
+
+    The IncludeFile function reads an included template file and
+    appends its flattened content to the flattened template buffer.
+
+    @param[in]
+       pFileName
+            pointer to the name of the included file
+
+    @param[in,out]
+       pStack
+            pointer to the stack of files being included
+
+    @param[in,out]
+       pBuf
+            pointer to the flattened template buffer
+
+    @retval EOK - the file was appended
+    @retval ELOOP - include cycle, or the includes are nested too deeply
+    @retval ENOENT - the file could not be read
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int IncludeFile( char *pFileName,
+                        IncludeStack *pStack,
+                        IncludeBuffer *pBuf )
+{
+    int result = ENOENT;
+    char *pSource;
+    size_t len;
+
+    pSource = CTEMPLATE_ReadFile( pFileName, &len );
+    if( pSource != NULL )
+    {
+        result = Include( pFileName, pSource, len, pStack, pBuf );
+        free( pSource );
+    }
+    else
+    {
+        syslog( LOG_ERR,
+                "filevars: cannot include %s: %s",
+                pFileName,
+                strerror( errno ) );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IncludePath                                                               */
+/*!
+    Get the path of an included file
+
+    The IncludePath function gets the path of the file named by an
+    include directive.  Leading and trailing white space is ignored.
+    Relative paths are relative to the directory of the including
+    file.
+
+    @param[in]
+       pFileName
+            pointer to the name of the including file
+
+    @param[in]
+       pStart
+            pointer to the start of the included file name
+
+    @param[in]
+       pEnd
+            pointer to the end of the included file name
+
+    @retval pointer to the path allocated on the heap
+    @retval NULL if memory could not be allocated
+
+==============================================================================*/
+static char *IncludePath( char *pFileName, char *pStart, char *pEnd )
+{
+    char *pPath = NULL;
+    char *pSlash;
+    int dirLen = 0;
+
+    while( ( pStart < pEnd ) && ( isspace( (unsigned char)*pStart ) ) )
+    {
+        pStart++;
+    }
+
+    while( ( pEnd > pStart ) && ( isspace( (unsigned char)pEnd[-1] ) ) )
+    {
+        pEnd--;
+    }
+
+    pSlash = strrchr( pFileName, '/' );
+    if( ( *pStart != '/' ) &&
+        ( pSlash != NULL ) )
+    {
+        dirLen = pSlash - pFileName + 1;
+    }
+
+    if( asprintf( &pPath,
+                  "%.*s%.*s",
+                  dirLen,
+                  pFileName,
+                  (int)( pEnd - pStart ),
+                  pStart ) < 0 )
+    {
+        pPath = NULL;
+    }
+
+    return pPath;
+}
+
+/*============================================================================*/
+/*  Append                                                                    */
+/*!
+    Append text to the flattened template
+
+    The Append function appends text to the NUL terminated flattened
+    template buffer, growing the buffer as required.
+
+    @param[in,out]
+       pBuf
+            pointer to the flattened template buffer
+
+    @param[in]
+       pText
+            pointer to the text to append
+
+    @param[in]
+       len
+            length of the text to append
+
+    @retval EOK - the text was appended
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Append( IncludeBuffer *pBuf, const char *pText, size_t len )
+{
+    int result = EOK;
+    char *p;
+    size_t size;
+
+    if( pBuf->len + len + 1 > pBuf->size )
+    {
+        size = ( pBuf->size == 0 ) ? BUFSIZ : pBuf->size;
+        while( size < pBuf->len + len + 1 )
+        {
+            size *= 2;
+        }
+
+        p = realloc( pBuf->pBuf, size );
+        if( p != NULL )
+        {
+            pBuf->pBuf = p;
+            pBuf->size = size;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    if( result == EOK )
+    {
+        memcpy( &pBuf->pBuf[pBuf->len], pText, len );
+        pBuf->len += len;
+        pBuf->pBuf[pBuf->len] = '\0';
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CompareHandles                                                            */
+/*!
+    Compare two loop matches by variable handle
+
+    The CompareHandles function is the qsort and bsearch comparison
+    function used to order the matches of an aggregate by variable
+    handle.
+
+    @param[in]
+       p1
+            pointer to the first loop match
+
+    @param[in]
+       p2
+            pointer to the second loop match
+
+    @retval -1 if the first handle sorts first
+    @retval 0 if the handles are equal
+    @retval 1 if the second handle sorts first
+
+==============================================================================*/
+static int CompareHandles( const void *p1, const void *p2 )
+{
+    VAR_HANDLE h1 = ((const LoopMatch *)p1)->hVar;
+    VAR_HANDLE h2 = ((const LoopMatch *)p2)->hVar;
+
+    return ( h1 > h2 ) - ( h1 < h2 );
+}
+
+/*============================================================================*/
+/*  Match                                                                     */
+/*!
+    Look up the variables matching a loop or aggregate segment
+
+    The Match function queries the variables matching the pattern of a
+    loop or aggregate segment.  The matches of a loop are sorted by
+    name, so they are rendered in name order, and the matches of an
+    aggregate are sorted by handle, so a changed input can be found
+    quickly.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pSegment
+            pointer to the loop or aggregate segment
+
+    @param[out]
+       ppMatches
+            pointer to a location to store the match list
+
+    @param[out]
+       pCount
+            pointer to a location to store the number of matches
+
+    @retval EOK - the query was run
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Match( VARSERVER_HANDLE hVarServer,
+                  Segment *pSegment,
+                  LoopMatch **ppMatches,
+                  size_t *pCount )
+{
+    int result;
+
+    result = Query( hVarServer, pSegment->pText, ppMatches, pCount );
+    if( ( result == EOK ) &&
+        ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) &&
+        ( *pCount > 0 ) )
+    {
+        qsort( *ppMatches, *pCount, sizeof( LoopMatch ), CompareHandles );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CheckJump                                                                 */
+/*!
+    Check the jump of a serialized template segment
+
+    The CheckJump function checks that the jump of a conditional or loop
+    segment in a serialized image lands where the compiler puts it.  An
+    @for jumps to its @endfor, an @else jumps to its @endif, and an @if
+    jumps to its @endif, or to the segment after its @else.  Jumps only
+    go forward.  Other segments do not jump.
+
+    @param[in]
+       pImage
+            pointer to the serialized image
+
+    @param[in]
+       i
+            index of the segment to check
+
+    @retval true - the jump is valid
+    @retval false - the jump is not valid
+
+==============================================================================*/
+static bool CheckJump( const CTemplateImage *pImage, size_t i )
+{
+    bool result = true;
+    uint32_t type = pImage->segments[i].type;
+    size_t jump = pImage->segments[i].jump;
+
+    if( ( type == SEGMENT_IF ) ||
+        ( type == SEGMENT_ELSE ) ||
+        ( type == SEGMENT_FOR ) )
+    {
+        result = ( jump > i ) && ( jump < pImage->nSegments );
+    }
+
+    if( ( result == true ) &&
+        ( type == SEGMENT_FOR ) )
+    {
+        result = ( pImage->segments[jump].type == SEGMENT_ENDFOR );
+    }
+    else if( ( result == true ) &&
+             ( type == SEGMENT_ELSE ) )
+    {
+        result = ( pImage->segments[jump].type == SEGMENT_ENDIF );
+    }
+    else if( ( result == true ) &&
+             ( type == SEGMENT_IF ) )
+    {
+        result = ( pImage->segments[jump].type == SEGMENT_ENDIF ) ||
+                 ( ( jump > i + 1 ) &&
+                   ( pImage->segments[jump - 1].type == SEGMENT_ELSE ) );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Aggregate                                                                 */
+/*!
+    Calculate the result of an aggregate from scratch
+
+    The Aggregate function reads the value of every input of an
+    aggregate segment, remembers it in the match list, and calculates
+    and formats the result of the aggregate.  Inputs which do not have
+    a numeric value are counted, but are not part of the sum, minimum,
+    maximum or average.  Segments which are not aggregates are left
+    unchanged.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       pSegment
+            pointer to the aggregate segment
+
+    @retval EOK - the aggregate was calculated
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Aggregate( VARSERVER_HANDLE hVarServer, Segment *pSegment )
+{
+    int result = EOK;
+    LoopMatch *pMatch;
+    size_t i;
+
+    if( ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) &&
+        ( pSegment->pAggregate == NULL ) )
+    {
+        pSegment->pAggregate = calloc( 1, sizeof( CTemplateAggregate ) );
+        result = ( pSegment->pAggregate != NULL ) ? EOK : ENOMEM;
+    }
+
+    if( ( result == EOK ) &&
+        ( pSegment->pAggregate != NULL ) )
+    {
+        for( i = 0; i < pSegment->nMatches; i++ )
+        {
+            pMatch = &pSegment->pMatches[i];
+            pMatch->numeric = GetNumber( hVarServer,
+                                         pMatch->hVar,
+                                         &pMatch->value );
+        }
+
+        Rescan( pSegment );
+        Format( pSegment );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IndexAggregates                                                           */
+/*!
+    Index the aggregate segments of a compiled template
+
+    The IndexAggregates function builds the list of the indices of the
+    aggregate segments of a compiled template, so a changed variable
+    is only looked up in the aggregates and not in every segment.  If
+    the list cannot be allocated, the aggregates are not updated
+    incrementally.
+
+    @param[in,out]
+       pTemplate
+            pointer to the compiled template
+
+==============================================================================*/
+static void IndexAggregates( CTemplate *pTemplate )
+{
+    size_t n = 0;
+    size_t i;
+
+    free( pTemplate->pAggregates );
+    pTemplate->pAggregates = NULL;
+
+    if( pTemplate->nAggregates > 0 )
+    {
+        pTemplate->pAggregates = calloc( pTemplate->nAggregates,
+                                         sizeof( size_t ) );
+    }
+
+    for( i = 0;
+         ( pTemplate->pAggregates != NULL ) &&
+         ( i < pTemplate->nSegments ) &&
+         ( n < pTemplate->nAggregates );
+         i++ )
+    {
+        if( CTEMPLATE_IS_AGGREGATE( &pTemplate->pSegments[i] ) )
+        {
+            pTemplate->pAggregates[n++] = i;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  Update                                                                    */
+/*!
+    Update an aggregate with the new value of one of its inputs
+
+    The Update function replaces the remembered value of an input of an
+    aggregate, and updates the result of the aggregate.  The sum, count
+    and average are updated in constant time.  The minimum and maximum
+    are also updated in constant time, unless the input held the
+    minimum or maximum and its new value moves inward from it, in which
+    case the remembered values of the inputs are scanned.  The inputs
+    are also scanned every CTEMPLATE_AGGREGATE_RESCAN updates, so the
+    running sum does not drift from the sum of the inputs.
+
+    @param[in]
+       pSegment
+            pointer to the aggregate segment
+
+    @param[in,out]
+       pMatch
+            pointer to the match of the changed input
+
+    @param[in]
+       value
+            new numeric value of the input
+
+    @param[in]
+       numeric
+            flag to indicate that the input has a numeric value
+
+    @retval true - the aggregate was updated
+
+==============================================================================*/
+static bool Update( Segment *pSegment,
+                    LoopMatch *pMatch,
+                    long double value,
+                    bool numeric )
+{
+    CTemplateAggregate *pAggregate = pSegment->pAggregate;
+    bool rescan = false;
+
+    if( pMatch->numeric == true )
+    {
+        pAggregate->sum -= pMatch->value;
+        pAggregate->n--;
+
+        /* only a minimum or maximum which moves inward is lost */
+        if( pSegment->type == SEGMENT_MIN )
+        {
+            rescan = ( pMatch->value == pAggregate->min ) &&
+                     ( ( numeric == false ) || ( value > pMatch->value ) );
+        }
+        else if( pSegment->type == SEGMENT_MAX )
+        {
+            rescan = ( pMatch->value == pAggregate->max ) &&
+                     ( ( numeric == false ) || ( value < pMatch->value ) );
+        }
+    }
+
+    pMatch->value = value;
+    pMatch->numeric = numeric;
+
+    if( ++pAggregate->updates >= CTEMPLATE_AGGREGATE_RESCAN )
+    {
+        rescan = true;
+    }
+
+    if( rescan == true )
+    {
+        Rescan( pSegment );
+    }
+    else if( numeric == true )
+    {
+        Accumulate( pAggregate, value );
+    }
+
+    Format( pSegment );
+
+    return true;
+}
+
+/*============================================================================*/
+/*  Accumulate                                                                */
+/*!
+    Add a numeric input value to an aggregate
+
+    The Accumulate function adds a numeric input value to the sum of an
+    aggregate, and updates its minimum and maximum.
+
+    @param[in,out]
+       pAggregate
+            pointer to the aggregate state
+
+    @param[in]
+       value
+            numeric value of the input
+
+==============================================================================*/
+static void Accumulate( CTemplateAggregate *pAggregate, long double value )
+{
+    if( ( pAggregate->n == 0 ) ||
+        ( value < pAggregate->min ) )
+    {
+        pAggregate->min = value;
+    }
+
+    if( ( pAggregate->n == 0 ) ||
+        ( value > pAggregate->max ) )
+    {
+        pAggregate->max = value;
+    }
+
+    pAggregate->sum += value;
+    pAggregate->n++;
+}
+
+/*============================================================================*/
+/*  Rescan                                                                    */
+/*!
+    Recalculate an aggregate from the remembered input values
+
+    The Rescan function recalculates the sum, minimum and maximum of an
+    aggregate from the input values remembered in its match list,
+    without reading the inputs again, and restarts the count of its
+    incremental updates.
+
+    @param[in]
+       pSegment
+            pointer to the aggregate segment
+
+==============================================================================*/
+static void Rescan( Segment *pSegment )
+{
+    CTemplateAggregate *pAggregate = pSegment->pAggregate;
+    size_t i;
+
+    pAggregate->sum = 0.0;
+    pAggregate->min = 0.0;
+    pAggregate->max = 0.0;
+    pAggregate->n = 0;
+    pAggregate->updates = 0;
+
+    for( i = 0; i < pSegment->nMatches; i++ )
+    {
+        if( pSegment->pMatches[i].numeric == true )
+        {
+            Accumulate( pAggregate, pSegment->pMatches[i].value );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  Format                                                                    */
+/*!
+    Format the result of an aggregate
+
+    The Format function formats the result of an aggregate into its
+    text buffer, so it can be rendered without any work.  Whole numbers
+    are formatted as integers.  The minimum, maximum and average of an
+    aggregate with no numeric inputs are empty.
+
+    @param[in]
+       pSegment
+            pointer to the aggregate segment
+
+==============================================================================*/
+static void Format( Segment *pSegment )
+{
+    CTemplateAggregate *pAggregate = pSegment->pAggregate;
+    long double value = 0.0;
+    bool empty = false;
+    int n;
+
+    switch( pSegment->type )
+    {
+        case SEGMENT_SUM:
+            value = pAggregate->sum;
+            break;
+
+        case SEGMENT_MIN:
+            value = pAggregate->min;
+            empty = ( pAggregate->n == 0 );
+            break;
+
+        case SEGMENT_MAX:
+            value = pAggregate->max;
+            empty = ( pAggregate->n == 0 );
+            break;
+
+        case SEGMENT_COUNT:
+            value = pSegment->nMatches;
+            break;
+
+        case SEGMENT_AVG:
+            empty = ( pAggregate->n == 0 );
+            value = ( empty == false ) ? pAggregate->sum / pAggregate->n : 0.0;
+            break;
+
+        default:
+            break;
+    }
+
+    if( empty == true )
+    {
+        n = 0;
+    }
+    else if( ( value >= (long double)INT64_MIN ) &&
+             ( value < (long double)INT64_MAX ) &&
+             ( (long double)(int64_t)value == value ) )
+    {
+        n = snprintf( pAggregate->text,
+                      sizeof( pAggregate->text ),
+                      "%" PRId64,
+                      (int64_t)value );
+    }
+    else
+    {
+        n = snprintf( pAggregate->text,
+                      sizeof( pAggregate->text ),
+                      "%.15Lg",
+                      value );
+    }
+
+    pAggregate->len = ( n > 0 ) ? (size_t)n : 0;
+    pAggregate->text[pAggregate->len] = '\0';
+}
+
+/*============================================================================*/
+/*  GetNumber                                                                 */
+/*!
+    Get the numeric value of a variable
+
+    The GetNumber function reads the value of a variable, and converts
+    it to a number.  String values are converted if they hold a number.
+
+    @param[in]
+       hVarServer
+            handle to the variable server
+
+    @param[in]
+       hVar
+            handle of the variable
+
+    @param[out]
+       pValue
+            pointer to a location to store the numeric value
+
+    @retval true - the variable has a numeric value
+    @retval false - the variable does not exist or is not numeric
+
+==============================================================================*/
+static bool GetNumber( VARSERVER_HANDLE hVarServer,
+                       VAR_HANDLE hVar,
+                       long double *pValue )
+{
+    bool result = true;
+    VarObject obj;
+    char *pEnd;
+
+    memset( &obj, 0, sizeof( obj ) );
+    if( ( hVar != VAR_INVALID ) &&
+        ( VAR_Get( hVarServer, hVar, &obj ) == EOK ) )
+    {
+        switch( obj.type )
+        {
+            case VARTYPE_UINT16:
+                *pValue = obj.val.ui;
+                break;
+
+            case VARTYPE_INT16:
+                *pValue = obj.val.i;
+                break;
+
+            case VARTYPE_UINT32:
+                *pValue = obj.val.ul;
+                break;
+
+            case VARTYPE_INT32:
+                *pValue = obj.val.l;
+                break;
+
+            case VARTYPE_UINT64:
+                *pValue = obj.val.ull;
+                break;
+
+            case VARTYPE_INT64:
+                *pValue = obj.val.ll;
+                break;
+
+            case VARTYPE_FLOAT:
+                *pValue = obj.val.f;
+                break;
+
+            case VARTYPE_STR:
+                result = ( obj.val.str != NULL );
+                if( result == true )
+                {
+                    *pValue = strtold( obj.val.str, &pEnd );
+                    result = ( pEnd != obj.val.str );
+                }
+                break;
+
+            default:
+                result = false;
+                break;
+        }
+    }
+    else
+    {
+        result = false;
+    }
+
+    return result;
+}
+
+/*! @}
+ * end of ctemplate group */
@@ -0,0 +1,960 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup fetch fetch
+ * @brief Variable fetching with a render deadline
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file fetch.c
+
+    Variable Fetching
+
+    The Variable Fetching module renders a compiled template by fetching
+    its variable references concurrently.  The variables are printed
+    by a pool of fetch threads, each with its own variable server
+    connection, so a render costs about as much as its slowest fetch,
+    and the rendering thread can stop waiting for a variable whose
+    producer does not respond.  A variable which has not been fetched
+    by the render deadline is replaced with a placeholder, or with its
+    last known value, and the render completes without it.
+
+    A fetch which misses the deadline keeps its fetch thread busy until
+    the producer responds, and its result is then discarded.  Fetch
+    requests are reference counted, so a request is freed by whichever
+    of the rendering thread and the fetch thread is done with it last.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <varserver/varserver.h>
+#include "realtime.h"
+#include "fetch.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! initial size of the request table of a render plan */
+#define FETCH_TABLE_SIZE ( 16 )
+
+/*! request to fetch the rendered value of a variable */
+typedef struct fetchRequest
+{
+    /*! handle of the variable to fetch */
+    VAR_HANDLE hVar;
+
+    /*! rendered value of the variable */
+    char *pData;
+
+    /*! length of the rendered value */
+    size_t len;
+
+    /*! result of the fetch */
+    int result;
+
+    /*! flag to indicate that the fetch has completed */
+    bool done;
+
+    /*! number of references held by the rendering and fetch threads */
+    int refs;
+
+    /*! pointer to the next request in the queue */
+    struct fetchRequest *pNext;
+
+} FetchRequest;
+
+/*! variable fetch thread pool */
+struct fetchPool
+{
+    /*! lock protecting the request queue and the request states */
+    pthread_mutex_t lock;
+
+    /*! condition signalled when a request is queued */
+    pthread_cond_t work;
+
+    /*! condition signalled when a request has completed */
+    pthread_cond_t done;
+
+    /*! first request in the queue */
+    FetchRequest *pHead;
+
+    /*! last request in the queue */
+    FetchRequest *pTail;
+
+    /*! attributes of the fetch threads */
+    FetchAttr attr;
+};
+
+/*! piece of the output of a template render */
+typedef struct fetchStep
+{
+    /*! template output step */
+    CTemplateStep step;
+
+    /*! request fetching the variable of the step, or NULL */
+    FetchRequest *pRequest;
+
+} FetchStep;
+
+/*! output steps of a template render */
+typedef struct fetchPlan
+{
+    /*! pointer to the fetch thread pool */
+    FetchPool *pPool;
+
+    /*! pointer to the render request */
+    FetchRender *pRender;
+
+    /*! array of the output steps which follow the literal prefix */
+    FetchStep *pSteps;
+
+    /*! number of output steps */
+    size_t n;
+
+    /*! allocated size of the output step array */
+    size_t size;
+
+    /*! open-addressed table of the requests issued, keyed by handle */
+    FetchRequest **ppTable;
+
+    /*! number of slots in the request table (a power of two) */
+    size_t tableSize;
+
+    /*! number of requests in the request table */
+    size_t nRequests;
+
+} FetchPlan;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static void *FetchThread( void *arg );
+static int Plan( void *pArg, const CTemplateStep *pStep );
+static FetchRequest *Submit( FetchPlan *pPlan, VAR_HANDLE hVar );
+static FetchRequest **Lookup( FetchRequest **ppTable,
+                              size_t tableSize,
+                              VAR_HANDLE hVar );
+static int Grow( FetchPlan *pPlan );
+static void Release( FetchRequest *pRequest );
+static int Substitute( FetchRender *pRender, FetchValue *pValue );
+static int Emit( FetchRender *pRender, const char *pBuf, size_t len );
+static void Remember( FetchValue *pValue, FetchRequest *pRequest );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  FETCH_Create                                                              */
+/*!
+    Create a variable fetch thread pool
+
+    The FETCH_Create function starts the specified number of fetch
+    threads.  The thread pool lives for the lifetime of the process,
+    since a fetch thread may be blocked indefinitely by a producer
+    which does not respond.  The fetch threads block every
+    asynchronous signal, so signals are only delivered to the thread
+    which waits for them.  Each fetch thread sets its own CPU affinity
+    and scheduling policy when it starts, rather than inheriting those
+    of the signal loop, so the fetches are not serialized on the CPU
+    of the signal loop and do not compete with it at its priority.
+    When the process memory is locked, the pool should be created
+    before the first render, and each fetch thread prefaults its stack
+    when it starts, so a render does not wait for thread creation or
+    page faults.
+
+    @param[in]
+       pAttr
+            pointer to the attributes of the fetch threads
+
+    @retval pointer to the fetch thread pool
+    @retval NULL if the fetch thread pool could not be created
+
+==============================================================================*/
+FetchPool *FETCH_Create( const FetchAttr *pAttr )
+{
+    FetchPool *pPool;
+    pthread_condattr_t attr;
+    pthread_t thread;
+    sigset_t mask;
+    sigset_t old;
+    int n = 0;
+    int i;
+
+    pPool = ( pAttr != NULL ) ? calloc( 1, sizeof( FetchPool ) ) : NULL;
+    if( pPool != NULL )
+    {
+        pthread_mutex_init( &pPool->lock, NULL );
+        pthread_condattr_init( &attr );
+        pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+        pthread_cond_init( &pPool->work, &attr );
+        pthread_cond_init( &pPool->done, &attr );
+        pthread_condattr_destroy( &attr );
+        pPool->attr = *pAttr;
+
+        /* the fetch threads inherit the signal mask */
+        sigfillset( &mask );
+        sigdelset( &mask, SIGSEGV );
+        sigdelset( &mask, SIGBUS );
+        sigdelset( &mask, SIGFPE );
+        sigdelset( &mask, SIGILL );
+        pthread_sigmask( SIG_BLOCK, &mask, &old );
+
+        for( i = 0; i < pAttr->nThreads; i++ )
+        {
+            if( pthread_create( &thread, NULL, FetchThread, pPool ) == 0 )
+            {
+                pthread_detach( thread );
+                n++;
+            }
+        }
+
+        pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+        if( n == 0 )
+        {
+            /* the pool is only freed if no thread references it */
+            pthread_cond_destroy( &pPool->work );
+            pthread_cond_destroy( &pPool->done );
+            pthread_mutex_destroy( &pPool->lock );
+            free( pPool );
+            pPool = NULL;
+        }
+    }
+
+    return pPool;
+}
+
+/*============================================================================*/
+/*  FETCH_Render                                                              */
+/*!
+    Render a compiled template with concurrent variable fetches
+
+    The FETCH_Render function writes the literal prefix of the compiled
+    template to the output immediately, then queues a fetch for every
+    variable referenced by the template, so the fetch threads print
+    them concurrently.  The rest of the template is streamed to the
+    output in template order as the values arrive, so a reader sees
+    the leading literal text, and each value, as soon as it can be
+    written.  A variable referenced more than once is only fetched
+    once.  The render takes about as long as the slowest fetch, rather
+    than the sum of them, as long as there are enough fetch threads.
+
+    Conditional sections are evaluated before any fetch is queued,
+    and only the variables of the taken branches are fetched.  The
+    values of the variables matched by a loop are fetched like any
+    other variable.
+
+    If there is a deadline, a variable which is still being fetched
+    when it passes is replaced with the placeholder if there is one,
+    or with its last known value.  The variables matched by a loop
+    have no last known value.
+
+    The output is written to the render output file descriptor, and
+    also to the stream file descriptor if there is one.  The time at
+    which the first byte of output was written, and the number of
+    substituted variables, are returned in the render request.
+
+    @param[in]
+       pPool
+            pointer to the fetch thread pool
+
+    @param[in,out]
+       pRender
+            pointer to the render request
+
+    @retval EOK - the template was rendered
+    @retval EINVAL - invalid arguments
+    @retval ENOMEM - memory allocation failure
+    @retval other error from write()
+
+==============================================================================*/
+int FETCH_Render( FetchPool *pPool, FetchRender *pRender )
+{
+    int result = EINVAL;
+    struct timespec end;
+    FetchPlan plan;
+    FetchStep *pStep;
+    FetchRequest *pRequest;
+    FetchValue *pValue;
+    bool expired = false;
+    bool fetched;
+    size_t i;
+
+    memset( &plan, 0, sizeof( plan ) );
+
+    if( ( pPool != NULL ) &&
+        ( pRender != NULL ) &&
+        ( pRender->hVarServer != NULL ) &&
+        ( pRender->pTemplate != NULL ) &&
+        ( pRender->pValues != NULL ) &&
+        ( pRender->fd >= 0 ) )
+    {
+        pRender->missed = 0;
+        pRender->firstByte.tv_sec = 0;
+        pRender->firstByte.tv_nsec = 0;
+
+        clock_gettime( CLOCK_MONOTONIC, &end );
+        end.tv_sec += pRender->deadline / 1000;
+        end.tv_nsec += ( pRender->deadline % 1000 ) * 1000000L;
+        if( end.tv_nsec >= 1000000000L )
+        {
+            end.tv_sec++;
+            end.tv_nsec -= 1000000000L;
+        }
+
+        /* write the literal prefix, and issue all of the fetches
+           before waiting for any of them */
+        plan.pPool = pPool;
+        plan.pRender = pRender;
+        result = CTEMPLATE_Walk( pRender->hVarServer,
+                                 pRender->pTemplate,
+                                 Plan,
+                                 &plan );
+    }
+
+    for( i = 0; i < plan.n; i++ )
+    {
+        pStep = &plan.pSteps[i];
+        pRequest = pStep->pRequest;
+        pValue = ( pStep->step.loop == false )
+                 ? &pRender->pValues[pStep->step.idx]
+                 : NULL;
+
+        if( ( pStep->step.pText != NULL ) &&
+            ( result == EOK ) )
+        {
+            result = Emit( pRender, pStep->step.pText, pStep->step.len );
+        }
+
+        if( pRequest == NULL )
+        {
+            if( ( pStep->step.pText == NULL ) &&
+                ( result == EOK ) )
+            {
+                result = Substitute( pRender, pValue );
+            }
+
+            continue;
+        }
+
+        pthread_mutex_lock( &pPool->lock );
+        while( ( pRequest->done == false ) &&
+               ( expired == false ) )
+        {
+            if( pRender->deadline > 0 )
+            {
+                expired = ( pthread_cond_timedwait( &pPool->done,
+                                                    &pPool->lock,
+                                                    &end ) == ETIMEDOUT );
+            }
+            else
+            {
+                pthread_cond_wait( &pPool->done, &pPool->lock );
+            }
+        }
+
+        /* a completed request is no longer touched by its thread */
+        fetched = ( pRequest->done == true ) &&
+                  ( pRequest->result == EOK );
+        pthread_mutex_unlock( &pPool->lock );
+
+        if( result == EOK )
+        {
+            if( fetched == true )
+            {
+                result = Emit( pRender, pRequest->pData, pRequest->len );
+                if( pValue != NULL )
+                {
+                    Remember( pValue, pRequest );
+                }
+            }
+            else
+            {
+                result = Substitute( pRender, pValue );
+            }
+        }
+
+        pthread_mutex_lock( &pPool->lock );
+        Release( pRequest );
+        pthread_mutex_unlock( &pPool->lock );
+    }
+
+    free( plan.pSteps );
+    free( plan.ppTable );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FETCH_FreeValues                                                          */
+/*!
+    Free an array of last known values
+
+    The FETCH_FreeValues function frees the last known values of the
+    segments of a template, and the array which holds them.
+
+    @param[in]
+       pValues
+            array of last known values
+
+    @param[in]
+       n
+            number of entries in the array
+
+==============================================================================*/
+void FETCH_FreeValues( FetchValue *pValues, size_t n )
+{
+    size_t i;
+
+    if( pValues != NULL )
+    {
+        for( i = 0; i < n; i++ )
+        {
+            free( pValues[i].pData );
+        }
+
+        free( pValues );
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  FetchThread                                                               */
+/*!
+    Variable fetch thread
+
+    The FetchThread function prefaults its stack if the pool asks for
+    it, applies the CPU affinity and scheduling policy of the pool,
+    opens its own variable server connection and scratch file, and
+    then prints each queued variable into the
+    scratch file and reads the rendered value back into its request.
+
+    @param[in]
+       arg
+            pointer to the fetch thread pool
+
+    @retval NULL
+
+==============================================================================*/
+static void *FetchThread( void *arg )
+{
+    FetchPool *pPool = (FetchPool *)arg;
+    FetchRequest *pRequest;
+    VARSERVER_HANDLE hVarServer;
+    char *pData;
+    off_t len;
+    int result;
+    int fd;
+
+    if( pPool->attr.prefault == true )
+    {
+        REALTIME_PrefaultStack();
+    }
+
+    /* do not share the CPU or the priority of the signal loop */
+    result = REALTIME_SetAffinityList( pPool->attr.pCPUList );
+    if( result != EOK )
+    {
+        syslog( LOG_ERR,
+                "filevars: cannot set fetch thread CPUs: %s",
+                strerror( result ) );
+    }
+
+    result = REALTIME_SetScheduler( pPool->attr.policy,
+                                    pPool->attr.priority );
+    if( result != EOK )
+    {
+        syslog( LOG_ERR,
+                "filevars: cannot set fetch thread priority %d: %s",
+                pPool->attr.priority,
+                strerror( result ) );
+    }
+
+    hVarServer = VARSERVER_Open();
+    fd = memfd_create( "filevars-fetch", MFD_CLOEXEC );
+
+    while( true )
+    {
+        pthread_mutex_lock( &pPool->lock );
+        while( pPool->pHead == NULL )
+        {
+            pthread_cond_wait( &pPool->work, &pPool->lock );
+        }
+
+        pRequest = pPool->pHead;
+        pPool->pHead = pRequest->pNext;
+        if( pPool->pHead == NULL )
+        {
+            pPool->pTail = NULL;
+        }
+        pthread_mutex_unlock( &pPool->lock );
+
+        pData = NULL;
+        len = 0;
+        result = ( ( hVarServer != NULL ) && ( fd >= 0 ) ) ? EOK : ENOTCONN;
+
+        if( result == EOK )
+        {
+            ftruncate( fd, 0 );
+            lseek( fd, 0, SEEK_SET );
+            VAR_Print( hVarServer, pRequest->hVar, fd );
+
+            len = lseek( fd, 0, SEEK_CUR );
+            pData = malloc( len + 1 );
+            if( pData == NULL )
+            {
+                result = ENOMEM;
+            }
+            else if( pread( fd, pData, len, 0 ) != len )
+            {
+                result = EIO;
+            }
+        }
+
+        pthread_mutex_lock( &pPool->lock );
+        pRequest->pData = pData;
+        pRequest->len = len;
+        pRequest->result = result;
+        pRequest->done = true;
+        pthread_cond_broadcast( &pPool->done );
+        Release( pRequest );
+        pthread_mutex_unlock( &pPool->lock );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  Plan                                                                      */
+/*!
+    Plan a step of the template output
+
+    The Plan function is the CTEMPLATE_Walk visitor used by
+    FETCH_Render.  Literal text which precedes the first variable is
+    written immediately.  Every later step is appended to the render
+    plan, and a fetch is queued for the variable of each variable
+    step.
+
+    @param[in]
+       pArg
+            pointer to the render plan
+
+    @param[in]
+       pStep
+            pointer to the template output step
+
+    @retval EOK - the step was planned
+    @retval ENOMEM - memory allocation failure
+    @retval other error from write()
+
+==============================================================================*/
+static int Plan( void *pArg, const CTemplateStep *pStep )
+{
+    int result = EOK;
+    FetchPlan *pPlan = (FetchPlan *)pArg;
+    FetchStep *pSteps;
+    size_t size;
+
+    if( ( pPlan->n == 0 ) &&
+        ( pStep->pText != NULL ) )
+    {
+        /* the literal prefix does not depend on any fetch */
+        result = Emit( pPlan->pRender, pStep->pText, pStep->len );
+    }
+    else
+    {
+        if( pPlan->n == pPlan->size )
+        {
+            size = ( pPlan->size == 0 )
+                   ? pPlan->pRender->pTemplate->nSegments
+                   : pPlan->size * 2;
+            pSteps = realloc( pPlan->pSteps, size * sizeof( FetchStep ) );
+            if( pSteps != NULL )
+            {
+                pPlan->pSteps = pSteps;
+                pPlan->size = size;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+
+        if( result == EOK )
+        {
+            pPlan->pSteps[pPlan->n].step = *pStep;
+            pPlan->pSteps[pPlan->n].pRequest =
+                ( pStep->pText == NULL )
+                    ? Submit( pPlan, pStep->hVar )
+                    : NULL;
+            pPlan->n++;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Submit                                                                    */
+/*!
+    Queue a variable fetch request
+
+    The Submit function queues a request to fetch the rendered value
+    of a variable referenced by a template.  If an earlier step of the
+    render fetches the same variable, its request is shared instead.
+    The requests of the render are found through the request table of
+    the plan, so each step is planned in constant time.  The request
+    holds one reference for each step which shares it, and one for the
+    fetch thread.
+
+    @param[in,out]
+       pPlan
+            pointer to the render plan
+
+    @param[in]
+       hVar
+            handle of the variable to fetch
+
+    @retval pointer to the fetch request
+    @retval NULL if the request could not be allocated
+
+==============================================================================*/
+static FetchRequest *Submit( FetchPlan *pPlan, VAR_HANDLE hVar )
+{
+    FetchPool *pPool = pPlan->pPool;
+    FetchRequest *pRequest = NULL;
+    FetchRequest **ppSlot = NULL;
+
+    /* keep the table at most half full.  If it cannot grow, the
+       request is simply not shared */
+    if( ( ( pPlan->nRequests + 1 ) * 2 <= pPlan->tableSize ) ||
+        ( Grow( pPlan ) == EOK ) )
+    {
+        ppSlot = Lookup( pPlan->ppTable, pPlan->tableSize, hVar );
+        pRequest = *ppSlot;
+    }
+
+    pthread_mutex_lock( &pPool->lock );
+
+    if( pRequest != NULL )
+    {
+        pRequest->refs++;
+    }
+    else
+    {
+        pRequest = calloc( 1, sizeof( FetchRequest ) );
+        if( pRequest != NULL )
+        {
+            pRequest->hVar = hVar;
+            pRequest->refs = 2;
+
+            if( pPool->pTail != NULL )
+            {
+                pPool->pTail->pNext = pRequest;
+            }
+            else
+            {
+                pPool->pHead = pRequest;
+            }
+
+            pPool->pTail = pRequest;
+            pthread_cond_signal( &pPool->work );
+
+            if( ppSlot != NULL )
+            {
+                *ppSlot = pRequest;
+                pPlan->nRequests++;
+            }
+        }
+    }
+
+    pthread_mutex_unlock( &pPool->lock );
+
+    return pRequest;
+}
+
+/*============================================================================*/
+/*  Lookup                                                                    */
+/*!
+    Find the slot of a variable in a request table
+
+    The Lookup function probes an open-addressed request table
+    linearly, starting from the hashed variable handle, and returns
+    the slot holding the request for the variable, or the empty slot
+    where it belongs.  The table must have at least one empty slot.
+
+    @param[in]
+       ppTable
+            pointer to the request table
+
+    @param[in]
+       tableSize
+            number of slots in the table (a power of two)
+
+    @param[in]
+       hVar
+            handle of the variable to look up
+
+    @retval pointer to the table slot for the variable
+
+==============================================================================*/
+static FetchRequest **Lookup( FetchRequest **ppTable,
+                              size_t tableSize,
+                              VAR_HANDLE hVar )
+{
+    size_t mask = tableSize - 1;
+    size_t i = ( (uint32_t)hVar * 2654435761u ) & mask;
+
+    while( ( ppTable[i] != NULL ) &&
+           ( ppTable[i]->hVar != hVar ) )
+    {
+        i = ( i + 1 ) & mask;
+    }
+
+    return &ppTable[i];
+}
+
+/*============================================================================*/
+/*  Grow                                                                      */
+/*!
+    Grow the request table of a render plan
+
+    The Grow function doubles the size of the request table of a
+    render plan, or allocates the initial table, and re-inserts the
+    requests which it already holds.
+
+    @param[in,out]
+       pPlan
+            pointer to the render plan
+
+    @retval EOK - the table was grown
+    @retval ENOMEM - memory allocation failure
+
+==============================================================================*/
+static int Grow( FetchPlan *pPlan )
+{
+    int result = ENOMEM;
+    FetchRequest **ppTable;
+    FetchRequest *pRequest;
+    size_t size;
+    size_t i;
+
+    size = ( pPlan->tableSize == 0 )
+           ? FETCH_TABLE_SIZE
+           : pPlan->tableSize * 2;
+
+    ppTable = calloc( size, sizeof( FetchRequest * ) );
+    if( ppTable != NULL )
+    {
+        for( i = 0; i < pPlan->tableSize; i++ )
+        {
+            pRequest = pPlan->ppTable[i];
+            if( pRequest != NULL )
+            {
+                *Lookup( ppTable, size, pRequest->hVar ) = pRequest;
+            }
+        }
+
+        free( pPlan->ppTable );
+        pPlan->ppTable = ppTable;
+        pPlan->tableSize = size;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Release                                                                   */
+/*!
+    Release a reference to a fetch request
+
+    The Release function drops a reference to a fetch request, and
+    frees it once neither the rendering thread nor the fetch thread
+    refers to it.  It must be called with the pool lock held.
+
+    @param[in]
+       pRequest
+            pointer to the fetch request
+
+==============================================================================*/
+static void Release( FetchRequest *pRequest )
+{
+    if( --pRequest->refs == 0 )
+    {
+        free( pRequest->pData );
+        free( pRequest );
+    }
+}
+
+/*============================================================================*/
+/*  Substitute                                                                */
+/*!
+    Substitute a variable which was not fetched in time
+
+    The Substitute function writes the placeholder, or the last known
+    value of the variable if there is no placeholder, in place of a
+    variable which was not fetched before the deadline, and counts
+    the substitution.
+
+    @param[in,out]
+       pRender
+            pointer to the render request
+
+    @param[in]
+       pValue
+            pointer to the last known value of the variable, or NULL
+            if it has none
+
+    @retval EOK - the substitute was written
+    @retval other error from write()
+
+==============================================================================*/
+static int Substitute( FetchRender *pRender, FetchValue *pValue )
+{
+    int result = EOK;
+
+    if( pRender->pPlaceholder != NULL )
+    {
+        result = Emit( pRender,
+                       pRender->pPlaceholder,
+                       strlen( pRender->pPlaceholder ) );
+    }
+    else if( ( pValue != NULL ) &&
+             ( pValue->pData != NULL ) )
+    {
+        result = Emit( pRender, pValue->pData, pValue->len );
+    }
+
+    pRender->missed++;
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Emit                                                                      */
+/*!
+    Write rendered output
+
+    The Emit function writes a piece of rendered output to the render
+    output, and to the stream output if there is one, and records the
+    time at which the first byte of output was written.
+
+    @param[in,out]
+       pRender
+            pointer to the render request
+
+    @param[in]
+       pBuf
+            pointer to the output to write
+
+    @param[in]
+       len
+            length of the output to write
+
+    @retval EOK - the output was written
+    @retval other error from write()
+
+==============================================================================*/
+static int Emit( FetchRender *pRender, const char *pBuf, size_t len )
+{
+    int result;
+
+    result = CTEMPLATE_Write( pRender->fd, pBuf, len );
+
+    if( ( result == EOK ) &&
+        ( pRender->streamfd >= 0 ) )
+    {
+        /* the reader may go away, which does not fail the render */
+        CTEMPLATE_Write( pRender->streamfd, pBuf, len );
+    }
+
+    if( ( len > 0 ) &&
+        ( pRender->firstByte.tv_sec == 0 ) &&
+        ( pRender->firstByte.tv_nsec == 0 ) )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &pRender->firstByte );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Remember                                                                  */
+/*!
+    Remember the last known value of a variable
+
+    The Remember function copies the rendered value from a completed
+    fetch request into the last known value of the variable.  The
+    request may be shared with other references to the same variable.
+
+    @param[in]
+       pValue
+            pointer to the last known value of the variable
+
+    @param[in]
+       pRequest
+            pointer to the completed fetch request
+
+==============================================================================*/
+static void Remember( FetchValue *pValue, FetchRequest *pRequest )
+{
+    char *pData;
+
+    pData = realloc( pValue->pData, pRequest->len + 1 );
+    if( pData != NULL )
+    {
+        memcpy( pData, pRequest->pData, pRequest->len );
+        pValue->pData = pData;
+        pValue->len = pRequest->len;
+    }
+}
+
+/*! @}
+ * end of fetch group */
@@ -44,23 +44,104 @@ SOFTWARE.
         Includes
 ============================================================================*/
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <syslog.h>
 #include <signal.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sched.h>
+#include <fnmatch.h>
 #include <varserver/varserver.h>
-#include <varserver/vartemplate.h>
 #include <tjson/json.h>
+#include "ctemplate.h"
+#include "hash.h"
+#include "fvshm.h"
+#include "tstore.h"
+#include "tcache.h"
+#include "checkpoint.h"
+#include "supervisor.h"
+#include "realtime.h"
+#include "fetch.h"
 
 /*============================================================================
         Private definitions
 ============================================================================*/
 
+/*! number of buckets in the dependency index */
+#define DEP_INDEX_SIZE  ( 64 )
+
+/*! suffix appended to the variable name to form the etag variable name */
+#define ETAG_SUFFIX ".etag"
+
+/*! size of an etag string: 16 hash digits, separator, generation */
+#define ETAG_LEN    ( 32 )
+
+/*! suffix appended to the variable name to form the stats variable name */
+#define STATS_SUFFIX ".stats"
+
+/*! size of the statistics variable */
+#define STATS_LEN   ( 320 )
+
+/*! time to wait for in-flight print requests when handing over to a
+    new instance, in milliseconds */
+#define HANDOVER_DRAIN_MS   ( 100 )
+
+/*! initial interval between lookups of missing variables in seconds */
+#define MISSING_BACKOFF_MIN ( 1 )
+
+/*! maximum interval between lookups of missing variables in seconds */
+#define MISSING_BACKOFF_MAX ( 64 )
+
+/*! interval between lookups of the variables matching a template loop
+    in seconds */
+#define LOOP_REFRESH_INTERVAL   ( 5 )
+
+/*! access frequency half-life in seconds */
+#define HEAT_HALF_LIFE  ( 60 )
+
+/*! access frequency added by each print of a file variable */
+#define HEAT_UNIT       ( 1024 )
+
+/*! list of variables whose values never change */
+typedef struct constantList
+{
+    /*! names or wildcard patterns of the constant variables */
+    char **ppNames;
+
+    /*! number of entries in the list */
+    size_t n;
+
+} ConstantList;
+
+/*! configuration file which defines a namespace of file variables */
+typedef struct fileVarConfig
+{
+    /*! name of the configuration file */
+    char *pFileName;
+
+    /*! constant variables of every file variable in the file */
+    ConstantList constants;
+
+    /*! modification time of the configuration file when it was loaded */
+    struct timespec mtime;
+
+    /*! pointer to the next configuration file */
+    struct fileVarConfig *pNext;
+
+} FileVarConfig;
 
 /*! fileVar component which maps a system variable to
  *  a template file */
@@ -69,14 +150,226 @@ typedef struct fileVar
     /*! variable handle */
     VAR_HANDLE hVar;
 
+    /*! variable name */
+    char *pName;
+
     /*! template file name */
     char *pFilename;
 
+    /*! configuration file which defines the file variable */
+    FileVarConfig *pConfig;
+
+    /*! constant variables whose values are folded into the template */
+    ConstantList constants;
+
+    /*! flag to indicate that the file variable has been registered */
+    bool registered;
+
+    /*! compiled template */
+    CTemplate *pTemplate;
+
+    /*! flag to indicate that the template variable references have
+        been resolved */
+    bool resolved;
+
+    /*! flag to indicate that the rendered output is cached */
+    bool cache;
+
+    /*! flag to indicate that the rendered output is pushed into the
+        variable value instead of being rendered on print */
+    bool push;
+
+    /*! flag to indicate that the output is re-rendered as soon as a
+        dependency changes rather than on the next print */
+    bool prerender;
+
+    /*! name of the file to materialize the rendered output into */
+    char *pOutputFile;
+
+    /*! name of the companion etag variable */
+    char *pETagName;
+
+    /*! handle of the companion etag variable */
+    VAR_HANDLE hETag;
+
+    /*! output generation counter, incremented when the output changes */
+    uint32_t generation;
+
+    /*! index of the shared render cache slot, or -1 if none */
+    int slot;
+
+    /*! flag to indicate that the cached output is valid */
+    bool valid;
+
+    /*! flag to indicate that a dependency change is pending */
+    bool pending;
+
+    /*! cached rendered output */
+    char *pOutput;
+
+    /*! length of the cached rendered output */
+    size_t outputLen;
+
+    /*! allocated size of the cached output buffer */
+    size_t outputSize;
+
+    /*! hash of the cached output */
+    uint64_t hash;
+
+    /*! flag to indicate that the cached output has been published */
+    bool published;
+
+    /*! hash of the most recently published output */
+    uint64_t publishedHash;
+
+    /*! number of times the file variable has been printed */
+    uint64_t reads;
+
+    /*! access frequency, halved every HEAT_HALF_LIFE seconds */
+    uint64_t heat;
+
+    /*! access frequency period in which the heat was last updated */
+    uint32_t heatPeriod;
+
+    /*! flag to indicate that the file variable is one of the hottest,
+        and is pre-rendered when its output is invalidated */
+    bool hot;
+
+    /*! coarse monotonic time in seconds at which the file variable
+        was last printed or compiled */
+    uint32_t lastUsed;
+
+    /*! flag to indicate that the variables are fetched concurrently
+        by the fetch thread pool */
+    bool parallel;
+
+    /*! render deadline in milliseconds, or 0 to wait for every variable */
+    int deadline;
+
+    /*! text substituted for variables which are not fetched by the
+        deadline, or NULL to substitute their last known values */
+    char *pPlaceholder;
+
+    /*! last known values of the template segments */
+    FetchValue *pValues;
+
+    /*! number of entries in the last known value array */
+    size_t nValues;
+
+    /*! number of times the template has been rendered */
+    uint64_t renders;
+
+    /*! number of renders in which a variable was substituted */
+    uint64_t degraded;
+
+    /*! flag to indicate that a variable was substituted in the most
+        recent render */
+    bool partial;
+
+    /*! time to the first byte of output of the most recent print in
+        microseconds */
+    uint64_t ttfb;
+
+    /*! longest time to the first byte of output in microseconds */
+    uint64_t maxTTFB;
+
+    /*! number of renders with variables which do not exist */
+    uint64_t misses;
+
+    /*! coarse monotonic time in seconds at which the missing variables
+        of the template are next looked up */
+    uint32_t retryAt;
+
+    /*! current interval between lookups of missing variables in seconds,
+        or 0 if every variable is resolved */
+    uint32_t backoff;
+
+    /*! coarse monotonic time in seconds at which the variables matching
+        the loops of the template are next looked up */
+    uint32_t requeryAt;
+
+    /*! hash of the template source the template was compiled from, or
+        0 if it is not known */
+    uint64_t sourceHash;
+
+    /*! name of the companion statistics variable */
+    char *pStatsName;
+
+    /*! handle of the companion statistics variable */
+    VAR_HANDLE hStats;
+
+    /*! pointer to the next file variable with a pending change */
+    struct fileVar *pNextPending;
+
     /*! pointer to the next file variable */
     struct fileVar *pNext;
 
 } FileVar;
 
+/*! reference to a file variable */
+typedef struct fileVarRef
+{
+    /*! pointer to the referenced file variable */
+    FileVar *pFileVar;
+
+    /*! pointer to the next file variable reference */
+    struct fileVarRef *pNext;
+
+} FileVarRef;
+
+/*! dependency which maps a referenced variable to the file
+ *  variables whose templates reference it */
+typedef struct dependency
+{
+    /*! handle of the referenced variable */
+    VAR_HANDLE hVar;
+
+    /*! list of file variables which depend on this variable */
+    FileVarRef *pFileVars;
+
+    /*! pointer to the next dependency in the index bucket */
+    struct dependency *pNext;
+
+} Dependency;
+
+/*! template precompilation job shared by the compiler threads */
+typedef struct precompileJob
+{
+    /*! pointer to the FileVars state object */
+    struct fileVarsState *pState;
+
+    /*! array of file variables to compile */
+    FileVar **ppFileVars;
+
+    /*! number of file variables to compile */
+    size_t n;
+
+    /*! index of the next file variable to compile */
+    size_t next;
+
+    /*! number of templates which could not be compiled */
+    int failed;
+
+} PrecompileJob;
+
+/*! serial render of a file variable */
+typedef struct serialRender
+{
+    /*! handle to the variable server */
+    VARSERVER_HANDLE hVarServer;
+
+    /*! output file descriptor to render to */
+    int fd;
+
+    /*! file descriptor which also receives the output as it is
+        rendered, or -1 */
+    int streamfd;
+
+    /*! monotonic time at which the first byte of output was written,
+        or zero if no output was written */
+    struct timespec firstByte;
+
+} SerialRender;
 
 /*! FileVars state */
 typedef struct fileVarsState
@@ -87,11 +380,120 @@ typedef struct fileVarsState
     /*! verbose flag */
     bool verbose;
 
-    /*! name of the FileVars definition file */
-    char *pFileName;
+    /*! list of FileVars definition files */
+    FileVarConfig *pConfigs;
+
+    /*! definition file which is currently being loaded */
+    FileVarConfig *pConfig;
 
     /*! pointer to the file vars list */
     FileVar *pFileVars;
+
+    /*! set of signals handled by the main loop */
+    sigset_t sigmask;
+
+    /*! scratch memory file used to render cached output */
+    int scratchfd;
+
+    /*! change notification debounce window in milliseconds */
+    int debounce;
+
+    /*! time at which the pending changes must be processed */
+    struct timespec deadline;
+
+    /*! list of file variables with pending dependency changes */
+    FileVar *pPending;
+
+    /*! dependency index */
+    Dependency *deps[DEP_INDEX_SIZE];
+
+    /*! name of the shared render cache segment */
+    char *pShmName;
+
+    /*! size of the data area of each shared render cache slot */
+    uint32_t slotSize;
+
+    /*! shared render cache */
+    FVShm *pShm;
+
+    /*! name of the shared template store segment */
+    char *pStoreName;
+
+    /*! size of the shared template store segment */
+    size_t storeSize;
+
+    /*! shared template store */
+    TStore *pStore;
+
+    /*! name of the compiled template cache directory */
+    char *pCacheDir;
+
+    /*! name of the render cache checkpoint file */
+    char *pCheckpointName;
+
+    /*! render cache checkpoint being restored */
+    Checkpoint *pRestore;
+
+    /*! signal which requested the main loop to terminate, or 0 */
+    int terminate;
+
+    /*! name of the file the process identifier is written to */
+    char *pPidFile;
+
+    /*! flag to take over from the instance named in the pid file */
+    bool upgrade;
+
+    /*! number of the most frequently printed file variables to pre-render */
+    int hotCount;
+
+    /*! cached file variables ranked by access frequency */
+    FileVar **ppRanked;
+
+    /*! number of ranked file variables */
+    size_t nRanked;
+
+    /*! allocated size of the ranked file variable array */
+    size_t rankSize;
+
+    /*! access frequency period in which the file variables were ranked */
+    uint32_t rankPeriod;
+
+    /*! number of worker processes, or 0 to run in a single process */
+    int workers;
+
+    /*! number of threads used to compile all templates at startup,
+        or 0 to compile each template on first use */
+    int compileThreads;
+
+    /*! number of seconds after which the template and output of an
+        unused file variable are released, or 0 to keep them */
+    int idleTimeout;
+
+    /*! time at which the idle file variables are next released */
+    struct timespec sweep;
+
+    /*! number of bytes of locked and prefaulted heap, or 0 if the
+        process memory is not locked */
+    size_t lockBudget;
+
+    /*! list of CPUs to pin the signal loop of each process to, or NULL */
+    char *pCPUList;
+
+    /*! scheduling policy of the signal loop */
+    int policy;
+
+    /*! scheduling priority of the signal loop */
+    int priority;
+
+    /*! attributes of the variable fetch threads */
+    FetchAttr fetch;
+
+    /*! variable fetch thread pool used by renders with a deadline */
+    FetchPool *pFetch;
+
+    /*! index of the worker process which owns a shard of the file vars */
+    int shard;
+
 } FileVarsState;
 
 /*============================================================================
@@ -107,11 +509,100 @@ FileVarsState state;
 
 void main(int argc, char **argv);
 static int ProcessOptions( int argC, char *argV[], FileVarsState *pState );
+static unsigned long ParseNumber( char *pArg,
+                                  char *pName,
+                                  int base,
+                                  unsigned long min,
+                                  unsigned long max );
 static void usage( char *cmdname );
+static int AddConfig( FileVarsState *pState, char *pFileName );
+static int LoadConfig( FileVarsState *pState, FileVarConfig *pConfig );
+static void UnloadConfig( FileVarsState *pState, FileVarConfig *pConfig );
+static void ReloadConfigs( FileVarsState *pState );
 static int SetupFileVar( JNode *pNode, void *arg );
+static char *GetCompanionName( JNode *pNode,
+                               char *pAttr,
+                               char *name,
+                               char *pSuffix );
+static int PrecompileFileVars( FileVarsState *pState );
+static void *PrecompileWorker( void *arg );
+static void *PrecompileThread( void *arg );
+static void RegisterFileVars( FileVarsState *pState );
+static int RegisterFileVar( FileVarsState *pState, FileVar *pFileVar );
+static void UnregisterFileVar( FileVarsState *pState, FileVar *pFileVar );
+static void FreeFileVar( FileVar *pFileVar );
+static void HandlePrint( FileVarsState *pState, int sigval );
 static int PrintFileVar( FileVarsState *pState, VAR_HANDLE hVar, int fd );
-static void SetupTerminationHandler( void );
-static void TerminationHandler( int signum, siginfo_t *info, void *ptr );
+static void RecordRead( FileVar *pFileVar );
+static uint64_t DecayHeat( FileVar *pFileVar, uint32_t period );
+static uint32_t HeatPeriod( void );
+static int RankFileVars( FileVarsState *pState );
+static int CompareHeat( const void *p1, const void *p2 );
+static void WarmFileVars( FileVarsState *pState );
+static int CompileFileVar( FileVarsState *pState, FileVar *pFileVar );
+static CTemplate *LoadTemplate( FileVarsState *pState, char *pFileName );
+static void ReloadTemplate( FileVarsState *pState, FileVar *pFileVar );
+static int RenderToCache( FileVarsState *pState,
+                          FileVar *pFileVar,
+                          int streamfd,
+                          struct timespec *pFirstByte );
+static int RefreshFileVar( FileVarsState *pState, FileVar *pFileVar );
+static int PushFileVar( FileVarsState *pState, FileVar *pFileVar );
+static int WriteOutputFile( FileVar *pFileVar );
+static VAR_HANDLE SetupCompanion( FileVarsState *pState,
+                                  char *pCompanionName,
+                                  size_t len );
+static int PublishETag( FileVarsState *pState, FileVar *pFileVar );
+static void RestoreFileVar( FileVarsState *pState, FileVar *pFileVar );
+static int CheckpointFileVars( FileVarsState *pState );
+static uint64_t GetFingerprint( FileVarsState *pState, FileVar *pFileVar );
+static int AddDependency( FileVarsState *pState,
+                          VAR_HANDLE hVar,
+                          FileVar *pFileVar );
+static void RemoveDependency( FileVarsState *pState,
+                              VAR_HANDLE hVar,
+                              FileVar *pFileVar );
+static void HandleModified( FileVarsState *pState, VAR_HANDLE hVar );
+static void ProcessChanges( FileVarsState *pState );
+static void RemoveDependencies( FileVarsState *pState, FileVar *pFileVar );
+static void AddDependencies( FileVarsState *pState, FileVar *pFileVar );
+static void ResolveMissing( FileVarsState *pState, FileVar *pFileVar );
+static void ScheduleResolve( FileVar *pFileVar );
+static void RequeryLoops( FileVarsState *pState, FileVar *pFileVar );
+static void LoadConstants( JNode *pNode, ConstantList *pList );
+static int AddConstant( JNode *pNode, void *arg );
+static void FreeConstants( ConstantList *pList );
+static bool IsConstant( void *pArg, const char *pName );
+static void FoldConstants( FileVarsState *pState, FileVar *pFileVar );
+static uint64_t HashValue( FileVarsState *pState,
+                           VAR_HANDLE hVar,
+                           uint64_t hash );
+static void EvictFileVars( FileVarsState *pState );
+static void EvictFileVar( FileVarsState *pState, FileVar *pFileVar );
+static uint32_t MonotonicSeconds( void );
+static void PrefaultFileVars( FileVarsState *pState );
+static void LoadRealtimeConfig( FileVarsState *pState, JNode *pNode );
+static void SetupRealtime( FileVarsState *pState );
+static void StartFetchPool( FileVarsState *pState );
+static int RenderFileVar( FileVarsState *pState,
+                          FileVar *pFileVar,
+                          int fd,
+                          int streamfd,
+                          struct timespec *pFirstByte );
+static int StreamStep( void *pArg, const CTemplateStep *pStep );
+static void RecordTTFB( FileVar *pFileVar,
+                        struct timespec *pStart,
+                        struct timespec *pFirstByte );
+static void PrintStats( FileVar *pFileVar, int fd );
+static int WaitSignal( FileVarsState *pState, int *sigval );
+static long TimeRemaining( struct timespec *pDeadline );
+static int SetupSharedCache( FileVarsState *pState );
+static void Terminate( void );
+static void Shutdown( FileVarsState *pState );
+static void SetShardCheckpointName( FileVarsState *pState );
+static int TakeOver( FileVarsState *pState );
+static void WorkersReady( void );
+static void HandOver( FileVarsState *pState );
 
 /*============================================================================
         Private function definitions
@@ -139,16 +630,17 @@ static void TerminationHandler( int signum, siginfo_t *info, void *ptr );
 void main(int argc, char **argv)
 {
     VARSERVER_HANDLE hVarServer = NULL;
-    VAR_HANDLE hVar;
     int result;
-    JNode *config;
-    JArray *cfg;
-    int sigval;
+    FileVarConfig *pConfig;
+    int sigval = 0;
     int sig;
-    int fd;
 
     /* clear the filevars state object */
     memset( &state, 0, sizeof( state ) );
+    state.slotSize = FVSHM_DEFAULT_SLOT_SIZE;
+    state.storeSize = TSTORE_DEFAULT_SIZE;
+    state.fetch.nThreads = FETCH_DEFAULT_THREADS;
+    state.fetch.policy = SCHED_OTHER;
 
     if( argc < 2 )
     {
@@ -156,187 +648,3869 @@ void main(int argc, char **argv)
         exit( 1 );
     }
 
-    /* set up the abnormal termination handler */
-    SetupTerminationHandler();
+    /* block the signals handled by the main loop so they queue up
+       until we are ready to receive them.  Termination is requested
+       with SIGTERM or SIGINT, which are also handled by the main loop
+       so the process never shuts down from a signal handler */
+    sigemptyset( &state.sigmask );
+    sigaddset( &state.sigmask, SIG_VAR_PRINT );
+    sigaddset( &state.sigmask, SIG_VAR_MODIFIED );
+    sigaddset( &state.sigmask, SIGHUP );
+    sigaddset( &state.sigmask, SIGUSR2 );
+    sigaddset( &state.sigmask, SIGTERM );
+    sigaddset( &state.sigmask, SIGINT );
+    sigprocmask( SIG_BLOCK, &state.sigmask, NULL );
 
     /* process the command line options */
     ProcessOptions( argc, argv, &state );
 
-    /* process the input file */
-    config = JSON_Process( state.pFileName );
+    if( state.lockBudget > 0 )
+    {
+        /* keep every thread in the heap arena which is prefaulted */
+        REALTIME_LimitArenas();
+    }
 
-    /* get the configuration array */
-    cfg = (JArray *)JSON_Find( config, "config" );
+    if( state.pStoreName != NULL )
+    {
+        /* attach to the template store shared by all instances */
+        state.pStore = TSTORE_Open( state.pStoreName, state.storeSize );
+        if( state.pStore == NULL )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot open template store %s",
+                    state.pStoreName );
+        }
+    }
 
-    /* get a handle to the VAR server */
-    state.hVarServer = VARSERVER_Open();
-    if( state.hVarServer != NULL )
+    /* process the input files */
+    for( pConfig = state.pConfigs; pConfig != NULL; pConfig = pConfig->pNext )
     {
-        /* set up the file vars by iterating through the configuration array */
-        JSON_Iterate( cfg, SetupFileVar, (void *)&state );
+        LoadConfig( &state, pConfig );
+    }
 
-        while( 1 )
+    if( state.pShmName != NULL )
+    {
+        /* create the shared render cache */
+        SetupSharedCache( &state );
+    }
+
+    if( ( state.compileThreads > 0 ) ||
+        ( state.workers > 0 ) )
+    {
+        /* compile the templates once so the workers share them */
+        if( ( PrecompileFileVars( &state ) > 0 ) &&
+            ( state.compileThreads > 0 ) )
         {
-            /* wait for a signal from the variable server */
-            sig = VARSERVER_WaitSignal( &sigval );
-            if( sig == SIG_VAR_PRINT )
+            /* fail fast on missing or unreadable templates */
+            fprintf( stderr, "filevars: cannot compile all templates\n" );
+            exit( 1 );
+        }
+    }
+
+    if( state.workers > 0 )
+    {
+        /* fork the workers, this only returns in a worker process */
+        state.shard = SUPERVISOR_Run( state.workers, WorkersReady );
+        if( state.shard == SUPERVISOR_HANDED_OVER )
+        {
+            /* the new instance owns the shared render cache name */
+            if( state.pShm != NULL )
             {
-                /* open a print session */
-                VAR_OpenPrintSession( state.hVarServer,
-                                      sigval,
-                                      &hVar,
-                                      &fd );
+                state.pShm->owner = false;
+            }
 
-                /* print the file variable */
-                PrintFileVar( &state, hVar, fd );
+            FVSHM_Close( state.pShm );
+            exit( 0 );
+        }
+        else if( state.shard == SUPERVISOR_STOPPED )
+        {
+            /* the workers were asked to terminate and have exited */
+            Shutdown( &state );
+        }
+        else if( state.shard < 0 )
+        {
+            exit( 1 );
+        }
 
-                /* Close the print session */
-                VAR_ClosePrintSession( state.hVarServer,
-                                       sigval,
-                                       fd );
-            }
+        if( state.pShm != NULL )
+        {
+            /* the supervisor owns the shared render cache */
+            state.pShm->owner = false;
         }
 
-        /* close the variable server */
-        if ( VARSERVER_Close( state.hVarServer ) == EOK )
+        if( state.pCheckpointName != NULL )
         {
-            state.hVarServer = NULL;
+            /* each worker checkpoints its own shard */
+            SetShardCheckpointName( &state );
         }
     }
-}
 
-/*============================================================================*/
-/*  SetupFileVar                                                              */
-/*!
-    Set up a filevar object
+    /* pin the signal loop and set its scheduling policy */
+    SetupRealtime( &state );
 
-    The SetupFileVar function is a callback function for the JSON_Iterate
-    function which sets up a file variable from the JSON configuration.
-    The file variable definition object is expected to look as follows:
+    if( state.lockBudget > 0 )
+    {
+        /* memory locks are not inherited, so each worker locks its own */
+        result = REALTIME_LockMemory( state.lockBudget );
+        if( result != EOK )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot lock memory: %s",
+                    strerror( result ) );
+        }
 
-    { "name": "varname", "file": "filename" }
+        /* do not start the fetch threads on the render path */
+        StartFetchPool( &state );
+    }
 
-    @param[in]
-       pNode
-            pointer to the FileVar node
+    /* create the scratch file used to render cached output */
+    state.scratchfd = memfd_create( "filevars", MFD_CLOEXEC );
 
-    @param[in]
-        arg
-            opaque pointer argument used for the filevar state object
+    /* get a handle to the VAR server */
+    state.hVarServer = VARSERVER_Open();
+    if( state.hVarServer != NULL )
+    {
+        if( state.pCheckpointName != NULL )
+        {
+            /* restore the render cache checkpointed by the last run */
+            state.pRestore = CHECKPOINT_Open( state.pCheckpointName );
+        }
 
-    @retval EOK - the file variable was set up successfully
-    @retval EINVAL - the file variable could not be set up
+        /* register the file vars with the variable server */
+        RegisterFileVars( &state );
 
-==============================================================================*/
-static int SetupFileVar( JNode *pNode, void *arg )
-{
-    FileVarsState *pState = (FileVarsState *)arg;
-    JVar *pName;
-    JVar *pFileName;
-    char *varname = NULL;
-    char *filename = NULL;
-    VARSERVER_HANDLE hVarServer;
-    FileVar *pFilevar;
-    int result = EINVAL;
+        CHECKPOINT_Close( state.pRestore );
+        state.pRestore = NULL;
 
-    if( pState != NULL )
-    {
-        /* get a handle to the VarServer */
-        hVarServer = pState->hVarServer;
-        pName = (JVar *)JSON_Find( pNode, "var" );
-        if( pName != NULL )
+        if( state.hotCount > 0 )
         {
-            varname = pName->var.val.str;
+            /* pre-render the file vars which were hot in the last run */
+            RankFileVars( &state );
+            WarmFileVars( &state );
         }
 
-        pFileName = (JVar *)JSON_Find( pNode, "file" );
-        if( pFileName != NULL )
+        if( state.lockBudget > 0 )
         {
-            filename = pFileName->var.val.str;
+            /* fault in the templates and output before the first print */
+            PrefaultFileVars( &state );
         }
 
-        if( ( varname != NULL ) &&
-            ( filename != NULL ) )
+        if( state.workers > 0 )
         {
-            /* allocate memory for the file variable */
-            pFilevar = malloc( sizeof( FileVar ) );
-            if( pFilevar != NULL )
-            {
-                pFilevar->hVar = VAR_FindByName( hVarServer, varname );
-                pFilevar->pFilename = strdup( filename );
+            /* the supervisor takes over once all workers are ready */
+            SUPERVISOR_Ready();
+        }
+        else
+        {
+            TakeOver( &state );
+        }
 
-                VAR_Notify( hVarServer, pFilevar->hVar, NOTIFY_PRINT );
+        if( state.idleTimeout > 0 )
+        {
+            /* schedule the first release of idle file variables */
+            clock_gettime( CLOCK_MONOTONIC, &state.sweep );
+            state.sweep.tv_sec += state.idleTimeout;
+        }
 
-                pFilevar->pNext = pState->pFileVars;
-                pState->pFileVars = pFilevar;
+        while( state.terminate == 0 )
+        {
+            /* wait for a signal from the variable server */
+            sig = WaitSignal( &state, &sigval );
+            if( sig == SIG_VAR_PRINT )
+            {
+                /* print the file variable */
+                HandlePrint( &state, sigval );
+            }
+            else if( sig == SIG_VAR_MODIFIED )
+            {
+                /* queue the change against the dependent file vars */
+                HandleModified( &state, (VAR_HANDLE)sigval );
+            }
+            else if( sig == SIGHUP )
+            {
+                /* reload the modified configuration files */
+                ReloadConfigs( &state );
+            }
+            else if( sig == SIGUSR2 )
+            {
+                /* a new instance has taken over, this does not return */
+                HandOver( &state );
+            }
+            else if( ( sig == SIGTERM ) || ( sig == SIGINT ) )
+            {
+                /* leave the main loop */
+                state.terminate = sig;
+            }
 
-                result = EOK;
+            if( ( state.pPending != NULL ) &&
+                ( TimeRemaining( &state.deadline ) == 0 ) )
+            {
+                /* the debounce window has closed */
+                ProcessChanges( &state );
+            }
+
+            if( ( state.idleTimeout > 0 ) &&
+                ( TimeRemaining( &state.sweep ) == 0 ) )
+            {
+                /* release the file variables which are not being used */
+                EvictFileVars( &state );
             }
         }
-    }
 
-    return result;
+        /* the main loop only ends when termination was requested */
+        if( state.pCheckpointName != NULL )
+        {
+            CheckpointFileVars( &state );
+        }
+
+        Shutdown( &state );
+    }
+    else
+    {
+        syslog( LOG_ERR, "filevars: cannot connect to the variable server" );
+        Terminate();
+    }
 }
 
 /*============================================================================*/
-/*  PrintFileVar                                                              */
+/*  AddConfig                                                                 */
 /*!
-    Print a filevar
+    Add a configuration file
 
-    The PrintFileVar function iterates through all the registered filevars
-    looking for the specified variable handle.  If found, it renders the
-    template file associated with the file handle to the specified output
-    stream.
+    The AddConfig function appends a FileVars definition file to the
+    list of definition files.  Each definition file is a separate
+    namespace of file variables which can be reloaded independently
+    of the others, while sharing the variable server connection,
+    caches and worker processes of this process.
 
     @param[in]
        pState
             pointer to the FileVars state object
 
     @param[in]
-        hVar
-            handle of the variable to print
+        pFileName
+            name of the definition file
 
-    @param[in]
+    @retval EOK - the configuration file was added
+    @retval ENOMEM - memory allocation failure
+
+============================================================================*/
+static int AddConfig( FileVarsState *pState, char *pFileName )
+{
+    int result = ENOMEM;
+    FileVarConfig **ppConfig = &pState->pConfigs;
+    FileVarConfig *pConfig;
+
+    pConfig = calloc( 1, sizeof( FileVarConfig ) );
+    if( pConfig != NULL )
+    {
+        pConfig->pFileName = strdup( pFileName );
+
+        while( *ppConfig != NULL )
+        {
+            ppConfig = &(*ppConfig)->pNext;
+        }
+
+        *ppConfig = pConfig;
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LoadConfig                                                                */
+/*!
+    Load a configuration file
+
+    The LoadConfig function processes a FileVars definition file and
+    sets up a file variable for each entry of its configuration array.
+    If the definition file was loaded before, the file variables it
+    previously defined are unloaded first.  They are left untouched
+    if the definition file cannot be processed.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pConfig
+            pointer to the configuration file to load
+
+    @retval EOK - the configuration file was loaded
+    @retval ENOENT - the configuration file could not be processed
+
+============================================================================*/
+static int LoadConfig( FileVarsState *pState, FileVarConfig *pConfig )
+{
+    int result = ENOENT;
+    JNode *config;
+    JArray *cfg = NULL;
+    JNode *pRealtime;
+    struct stat sb;
+
+    if( stat( pConfig->pFileName, &sb ) == 0 )
+    {
+        pConfig->mtime = sb.st_mtim;
+    }
+
+    /* process the input file */
+    config = JSON_Process( pConfig->pFileName );
+    if( config != NULL )
+    {
+        /* get the configuration array */
+        cfg = (JArray *)JSON_Find( config, "config" );
+
+        pRealtime = JSON_Find( config, "realtime" );
+        if( pRealtime != NULL )
+        {
+            LoadRealtimeConfig( pState, pRealtime );
+        }
+    }
+
+    if( cfg != NULL )
+    {
+        UnloadConfig( pState, pConfig );
+        LoadConstants( config, &pConfig->constants );
+
+        /* set up the file vars by iterating through the configuration array */
+        pState->pConfig = pConfig;
+        JSON_Iterate( cfg, SetupFileVar, (void *)pState );
+        pState->pConfig = NULL;
+
+        result = EOK;
+    }
+    else
+    {
+        syslog( LOG_ERR, "filevars: cannot load %s", pConfig->pFileName );
+    }
+
+    if( config != NULL )
+    {
+        JSON_Free( config );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  UnloadConfig                                                              */
+/*!
+    Unload the file variables of a configuration file
+
+    The UnloadConfig function unregisters and frees every file variable
+    defined by the specified configuration file.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pConfig
+            pointer to the configuration file to unload
+
+============================================================================*/
+static void UnloadConfig( FileVarsState *pState, FileVarConfig *pConfig )
+{
+    FileVar **ppFileVar = &pState->pFileVars;
+    FileVar *pFileVar;
+
+    while( *ppFileVar != NULL )
+    {
+        pFileVar = *ppFileVar;
+        if( pFileVar->pConfig == pConfig )
+        {
+            *ppFileVar = pFileVar->pNext;
+            UnregisterFileVar( pState, pFileVar );
+            FreeFileVar( pFileVar );
+        }
+        else
+        {
+            ppFileVar = &pFileVar->pNext;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  ReloadConfigs                                                             */
+/*!
+    Reload the modified configuration files
+
+    The ReloadConfigs function is called when SIGHUP is received.
+    Each configuration file which has been modified since it was
+    last loaded is reloaded, and its file variables are registered
+    with the variable server.  File variables defined by unmodified
+    configuration files keep their compiled templates and cached
+    output.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void ReloadConfigs( FileVarsState *pState )
+{
+    FileVarConfig *pConfig;
+    struct stat sb;
+    int n = 0;
+
+    for( pConfig = pState->pConfigs; pConfig != NULL; pConfig = pConfig->pNext )
+    {
+        if( ( stat( pConfig->pFileName, &sb ) == 0 ) &&
+            ( ( sb.st_mtim.tv_sec != pConfig->mtime.tv_sec ) ||
+              ( sb.st_mtim.tv_nsec != pConfig->mtime.tv_nsec ) ) )
+        {
+            if( LoadConfig( pState, pConfig ) == EOK )
+            {
+                n++;
+            }
+        }
+    }
+
+    if( n > 0 )
+    {
+        if( ( pState->compileThreads > 0 ) &&
+            ( pState->workers == 0 ) )
+        {
+            PrecompileFileVars( pState );
+        }
+
+        RegisterFileVars( pState );
+
+        if( pState->hotCount > 0 )
+        {
+            RankFileVars( pState );
+            WarmFileVars( pState );
+        }
+
+        if( pState->lockBudget > 0 )
+        {
+            PrefaultFileVars( pState );
+        }
+    }
+
+    if( pState->verbose == true )
+    {
+        printf( "filevars: reloaded %d configuration files\n", n );
+    }
+}
+
+/*============================================================================*/
+/*  SetupFileVar                                                              */
+/*!
+    Set up a filevar object
+
+    The SetupFileVar function is a callback function for the JSON_Iterate
+    function which sets up a file variable from the JSON configuration.
+    The file variable definition object is expected to look as follows:
+
+    { "var": "varname",
+      "file": "filename",
+      "cache": true,
+      "push": true,
+      "output": "outputfilename",
+      "etag": true }
+
+    The optional "cache" attribute enables caching of the rendered output.
+    A cached file variable is only re-rendered after one of the variables
+    referenced by its template has changed.
+
+    The optional "push" attribute renders the template when the file
+    variable is set up and whenever its dependencies change, and stores
+    the rendered output as the string value of the variable.  Pushed
+    variables are cached, and do not request print notifications.
+
+    The optional "output" attribute materializes the rendered output
+    into the specified file whenever the dependencies change.
+
+    The optional "etag" attribute publishes the hash of the rendered
+    output and its generation counter into a companion string variable
+    whenever the output changes.  It is either true, to use the
+    variable name with an ".etag" suffix, or the name of the companion
+    variable.
+
+    The optional "parallel" attribute fetches the referenced variables
+    concurrently rather than one after the other.
+
+    The optional "deadline" attribute limits the time a render waits
+    for the referenced variables, in milliseconds, and implies
+    "parallel".  Variables which are not fetched by the deadline are
+    replaced with the optional "placeholder" attribute, or with their
+    last known values.
+
+    The optional "stats" attribute prints the statistics of the file
+    variable from a companion string variable.  It is either true, to
+    use the variable name with a ".stats" suffix, or the name of the
+    companion variable.
+
+    The file variable is not registered with the variable server until
+    RegisterFileVar is called.
+
+    @param[in]
+       pNode
+            pointer to the FileVar node
+
+    @param[in]
+        arg
+            opaque pointer argument used for the filevar state object
+
+    @retval EOK - the file variable was set up successfully
+    @retval EINVAL - the file variable could not be set up
+
+==============================================================================*/
+static int SetupFileVar( JNode *pNode, void *arg )
+{
+    FileVarsState *pState = (FileVarsState *)arg;
+    JVar *pName;
+    JVar *pFileName;
+    char *varname = NULL;
+    char *filename = NULL;
+    char *output;
+    char *placeholder;
+    FileVar *pFilevar;
+    bool cache = false;
+    bool push = false;
+    bool parallel = false;
+    int deadline = 0;
+    int result = EINVAL;
+
+    if( pState != NULL )
+    {
+        pName = (JVar *)JSON_Find( pNode, "var" );
+        if( pName != NULL )
+        {
+            varname = pName->var.val.str;
+        }
+
+        pFileName = (JVar *)JSON_Find( pNode, "file" );
+        if( pFileName != NULL )
+        {
+            filename = pFileName->var.val.str;
+        }
+
+        JSON_GetBool( pNode, "cache", &cache );
+        JSON_GetBool( pNode, "push", &push );
+        output = JSON_GetStr( pNode, "output" );
+        placeholder = JSON_GetStr( pNode, "placeholder" );
+        JSON_GetBool( pNode, "parallel", &parallel );
+        JSON_GetNum( pNode, "deadline", &deadline );
+
+        if( ( varname != NULL ) &&
+            ( filename != NULL ) )
+        {
+            /* allocate memory for the file variable */
+            pFilevar = calloc( 1, sizeof( FileVar ) );
+            if( pFilevar != NULL )
+            {
+                pFilevar->hVar = VAR_INVALID;
+                pFilevar->pName = strdup( varname );
+                pFilevar->pFilename = strdup( filename );
+                pFilevar->pConfig = pState->pConfig;
+                LoadConstants( pNode, &pFilevar->constants );
+                pFilevar->pETagName = GetCompanionName( pNode,
+                                                        "etag",
+                                                        varname,
+                                                        ETAG_SUFFIX );
+                pFilevar->pStatsName = GetCompanionName( pNode,
+                                                         "stats",
+                                                         varname,
+                                                         STATS_SUFFIX );
+                pFilevar->deadline = deadline;
+                pFilevar->parallel = parallel || ( deadline > 0 );
+                pFilevar->pPlaceholder = ( placeholder != NULL )
+                                         ? strdup( placeholder )
+                                         : NULL;
+                pFilevar->slot = -1;
+                pFilevar->push = push;
+                pFilevar->pOutputFile = ( output != NULL ) ? strdup( output )
+                                                           : NULL;
+                pFilevar->prerender = push ||
+                                      ( output != NULL ) ||
+                                      ( pFilevar->pETagName != NULL );
+                pFilevar->cache = cache || pFilevar->prerender;
+
+                pFilevar->pNext = pState->pFileVars;
+                pState->pFileVars = pFilevar;
+
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetCompanionName                                                          */
+/*!
+    Get the name of a companion variable
+
+    The GetCompanionName function gets the name of a companion variable,
+    such as the etag variable, from the specified attribute of a file
+    variable definition.  The attribute is either the name of the
+    companion variable, or true to use the name of the file variable
+    with the specified suffix.
+
+    @param[in]
+       pNode
+            pointer to the file variable definition
+
+    @param[in]
+        pAttr
+            name of the companion variable attribute
+
+    @param[in]
+        name
+            name of the file variable
+
+    @param[in]
+        pSuffix
+            suffix appended to the file variable name
+
+    @retval pointer to the companion variable name allocated on the heap
+    @retval NULL if the file variable has no such companion variable
+
+============================================================================*/
+static char *GetCompanionName( JNode *pNode,
+                               char *pAttr,
+                               char *name,
+                               char *pSuffix )
+{
+    char *pCompanionName;
+    bool enabled = false;
+    size_t len;
+
+    pCompanionName = JSON_GetStr( pNode, pAttr );
+    if( pCompanionName != NULL )
+    {
+        pCompanionName = strdup( pCompanionName );
+    }
+    else if( ( JSON_GetBool( pNode, pAttr, &enabled ) == EOK ) &&
+             ( enabled == true ) )
+    {
+        len = strlen( name ) + strlen( pSuffix ) + 1;
+        pCompanionName = malloc( len );
+        if( pCompanionName != NULL )
+        {
+            snprintf( pCompanionName, len, "%s%s", name, pSuffix );
+        }
+    }
+
+    return pCompanionName;
+}
+
+/*============================================================================*/
+/*  PrecompileFileVars                                                        */
+/*!
+    Compile the templates of all file variables
+
+    The PrecompileFileVars function compiles the template of every
+    file variable without resolving its variable references, which
+    does not require a variable server connection.  It is used to
+    compile the templates once before forking worker processes, so
+    the workers share the compiled templates copy-on-write, and to
+    compile all templates eagerly at startup.
+
+    The templates are compiled by a pool of compileThreads threads,
+    including the calling thread.  The compile threads block every
+    asynchronous signal, so signals are only delivered to the calling
+    thread, and do not run on the CPU or at the priority of the signal
+    loop when the templates are recompiled after a configuration
+    reload.  Templates which cannot be compiled are reported, and the
+    total number of compiled templates and the time taken are reported
+    once all of them have been compiled.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @retval number of templates which could not be compiled
+
+============================================================================*/
+static int PrecompileFileVars( FileVarsState *pState )
+{
+    PrecompileJob job;
+    FileVar *pFileVar;
+    pthread_t *pThreads = NULL;
+    struct timespec start;
+    struct timespec end;
+    sigset_t mask;
+    sigset_t old;
+    size_t threads;
+    size_t nThreads = 0;
+    size_t i;
+    long ms;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    memset( &job, 0, sizeof( job ) );
+    job.pState = pState;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        job.n++;
+    }
+
+    job.ppFileVars = calloc( job.n, sizeof( FileVar * ) );
+    if( job.ppFileVars != NULL )
+    {
+        job.n = 0;
+        for( pFileVar = pState->pFileVars;
+             pFileVar != NULL;
+             pFileVar = pFileVar->pNext )
+        {
+            if( pFileVar->pTemplate == NULL )
+            {
+                job.ppFileVars[job.n++] = pFileVar;
+            }
+        }
+
+        threads = ( pState->compileThreads > 0 )
+                  ? (size_t)pState->compileThreads
+                  : 0;
+        if( ( threads > 1 ) &&
+            ( job.n > 1 ) )
+        {
+            nThreads = ( threads < job.n ) ? threads - 1 : job.n - 1;
+            pThreads = calloc( nThreads, sizeof( pthread_t ) );
+        }
+
+        /* the compile threads inherit the signal mask */
+        sigfillset( &mask );
+        sigdelset( &mask, SIGSEGV );
+        sigdelset( &mask, SIGBUS );
+        sigdelset( &mask, SIGFPE );
+        sigdelset( &mask, SIGILL );
+        pthread_sigmask( SIG_BLOCK, &mask, &old );
+
+        for( i = 0; ( pThreads != NULL ) && ( i < nThreads ); i++ )
+        {
+            if( pthread_create( &pThreads[i],
+                                NULL,
+                                PrecompileThread,
+                                &job ) != 0 )
+            {
+                break;
+            }
+        }
+
+        pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+        nThreads = ( pThreads != NULL ) ? i : 0;
+
+        /* the calling thread is part of the pool */
+        PrecompileWorker( &job );
+
+        for( i = 0; i < nThreads; i++ )
+        {
+            pthread_join( pThreads[i], NULL );
+        }
+
+        free( pThreads );
+        free( job.ppFileVars );
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    ms = ( end.tv_sec - start.tv_sec ) * 1000L +
+         ( end.tv_nsec - start.tv_nsec ) / 1000000L;
+
+    syslog( LOG_INFO,
+            "filevars: compiled %zu templates in %ld ms, %d failed",
+            job.n - job.failed,
+            ms,
+            job.failed );
+
+    if( pState->verbose == true )
+    {
+        printf( "filevars: compiled %zu templates in %ld ms, %d failed\n",
+                job.n - job.failed,
+                ms,
+                job.failed );
+    }
+
+    return job.failed;
+}
+
+/*============================================================================*/
+/*  PrecompileWorker                                                          */
+/*!
+    Template compiler thread
+
+    The PrecompileWorker function is run by each thread of the template
+    compiler pool.  It takes file variables from the precompilation
+    job until there are none left, and compiles their templates.
+
+    @param[in]
+        arg
+            pointer to the precompilation job
+
+    @retval NULL
+
+============================================================================*/
+static void *PrecompileWorker( void *arg )
+{
+    PrecompileJob *pJob = (PrecompileJob *)arg;
+    FileVar *pFileVar;
+    size_t i;
+
+    while( ( i = __atomic_fetch_add( &pJob->next,
+                                     1,
+                                     __ATOMIC_RELAXED ) ) < pJob->n )
+    {
+        pFileVar = pJob->ppFileVars[i];
+        pFileVar->pTemplate = LoadTemplate( pJob->pState,
+                                            pFileVar->pFilename );
+        if( pFileVar->pTemplate == NULL )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot compile %s for %s: %s",
+                    pFileVar->pFilename,
+                    pFileVar->pName,
+                    strerror( errno ) );
+            __atomic_fetch_add( &pJob->failed, 1, __ATOMIC_RELAXED );
+        }
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  PrecompileThread                                                          */
+/*!
+    Template compiler pool thread
+
+    The PrecompileThread function is the entry point of the threads
+    started by PrecompileFileVars.  It lets the thread run on any CPU
+    which the process could run on before it was pinned, with the
+    default scheduling policy, and then compiles templates with
+    PrecompileWorker.
+
+    @param[in]
+        arg
+            pointer to the precompilation job
+
+    @retval NULL
+
+============================================================================*/
+static void *PrecompileThread( void *arg )
+{
+    /* compiling must not compete with the signal loop */
+    REALTIME_SetAffinityList( NULL );
+    REALTIME_SetScheduler( SCHED_OTHER, 0 );
+
+    return PrecompileWorker( arg );
+}
+
+/*============================================================================*/
+/*  RegisterFileVars                                                          */
+/*!
+    Register the file variables with the variable server
+
+    The RegisterFileVars function registers every file variable owned
+    by this process with the variable server, skipping file variables
+    which are already registered.  When running as one of several
+    worker processes, each worker owns the file variables whose name
+    hashes to its shard, and the others are dropped from its list.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void RegisterFileVars( FileVarsState *pState )
+{
+    FileVar **ppFileVar = &pState->pFileVars;
+    FileVar *pFileVar;
+    uint64_t hash;
+
+    while( *ppFileVar != NULL )
+    {
+        pFileVar = *ppFileVar;
+
+        if( pFileVar->registered == true )
+        {
+            ppFileVar = &pFileVar->pNext;
+            continue;
+        }
+
+        if( pState->workers > 0 )
+        {
+            hash = HASH_Compute( pFileVar->pName,
+                                 strlen( pFileVar->pName ),
+                                 0 );
+            if( (int)( hash % pState->workers ) != pState->shard )
+            {
+                /* another worker owns this file variable */
+                *ppFileVar = pFileVar->pNext;
+                FreeFileVar( pFileVar );
+                continue;
+            }
+
+            if( pFileVar->slot >= 0 )
+            {
+                /* discard any output published by a previous worker */
+                FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+            }
+        }
+
+        RegisterFileVar( pState, pFileVar );
+        ppFileVar = &pFileVar->pNext;
+    }
+}
+
+/*============================================================================*/
+/*  RegisterFileVar                                                           */
+/*!
+    Register a file variable with the variable server
+
+    The RegisterFileVar function looks up the variable handle of the
+    file variable, and requests a print notification for it unless
+    its output is pushed into the variable value.  The cached output
+    and statistics of the file variable are restored from the render
+    cache checkpoint if there is one.  Pre-rendered file variables are
+    rendered and published immediately.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to register
+
+    @retval EOK - the file variable was registered
+    @retval ENOENT - the variable does not exist
+
+============================================================================*/
+static int RegisterFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    int result = ENOENT;
+
+    pFileVar->hVar = VAR_FindByName( pState->hVarServer, pFileVar->pName );
+    if( pFileVar->hVar != VAR_INVALID )
+    {
+        if( ( pFileVar->cache == true ) &&
+            ( pFileVar->slot < 0 ) &&
+            ( pState->pShm != NULL ) )
+        {
+            /* a reloaded file variable keeps its shared cache slot */
+            pFileVar->slot = FVSHM_FindSlot( pState->pShm, pFileVar->pName );
+        }
+
+        if( pFileVar->pETagName != NULL )
+        {
+            pFileVar->hETag = SetupCompanion( pState,
+                                              pFileVar->pETagName,
+                                              ETAG_LEN );
+        }
+
+        if( pFileVar->pStatsName != NULL )
+        {
+            pFileVar->hStats = SetupCompanion( pState,
+                                               pFileVar->pStatsName,
+                                               STATS_LEN );
+            if( pFileVar->hStats != VAR_INVALID )
+            {
+                VAR_Notify( pState->hVarServer,
+                            pFileVar->hStats,
+                            NOTIFY_PRINT );
+            }
+        }
+
+        if( pState->pRestore != NULL )
+        {
+            RestoreFileVar( pState, pFileVar );
+        }
+
+        if( pFileVar->prerender == true )
+        {
+            /* publish the initial rendered value */
+            if( CompileFileVar( pState, pFileVar ) == EOK )
+            {
+                RefreshFileVar( pState, pFileVar );
+            }
+        }
+
+        if( pFileVar->push == false )
+        {
+            VAR_Notify( pState->hVarServer, pFileVar->hVar, NOTIFY_PRINT );
+        }
+
+        pFileVar->registered = true;
+        result = EOK;
+    }
+    else
+    {
+        syslog( LOG_ERR, "filevars: variable %s not found", pFileVar->pName );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  UnregisterFileVar                                                         */
+/*!
+    Unregister a file variable from the variable server
+
+    The UnregisterFileVar function cancels the print notification of
+    the file variable, removes it from the dependency index and the
+    pending change list, and invalidates its shared cache slot.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to unregister
+
+============================================================================*/
+static void UnregisterFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    FileVar **ppPending = &pState->pPending;
+
+    if( ( pFileVar->registered == true ) &&
+        ( pFileVar->push == false ) )
+    {
+        VAR_NotifyCancel( pState->hVarServer, pFileVar->hVar, NOTIFY_PRINT );
+    }
+
+    if( ( pFileVar->registered == true ) &&
+        ( pFileVar->hStats != VAR_INVALID ) )
+    {
+        VAR_NotifyCancel( pState->hVarServer, pFileVar->hStats, NOTIFY_PRINT );
+    }
+
+    RemoveDependencies( pState, pFileVar );
+
+    if( pFileVar->pending == true )
+    {
+        while( *ppPending != pFileVar )
+        {
+            ppPending = &(*ppPending)->pNextPending;
+        }
+
+        *ppPending = pFileVar->pNextPending;
+    }
+
+    if( pFileVar->slot >= 0 )
+    {
+        FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+    }
+
+    pFileVar->registered = false;
+}
+
+/*============================================================================*/
+/*  FreeFileVar                                                               */
+/*!
+    Free a file variable
+
+    The FreeFileVar function releases the compiled template, cached
+    output and other resources held by a file variable which has been
+    removed from the file variable list.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to free
+
+============================================================================*/
+static void FreeFileVar( FileVar *pFileVar )
+{
+    if( pFileVar->pTemplate != NULL )
+    {
+        CTEMPLATE_Free( pFileVar->pTemplate );
+    }
+
+    free( pFileVar->pName );
+    free( pFileVar->pFilename );
+    free( pFileVar->pOutputFile );
+    free( pFileVar->pETagName );
+    free( pFileVar->pStatsName );
+    free( pFileVar->pPlaceholder );
+    free( pFileVar->pOutput );
+    FETCH_FreeValues( pFileVar->pValues, pFileVar->nValues );
+    FreeConstants( &pFileVar->constants );
+    free( pFileVar );
+}
+
+/*============================================================================*/
+/*  HandlePrint                                                               */
+/*!
+    Handle a print request
+
+    The HandlePrint function opens the print session requested by the
+    variable server, prints the file variable into it, and closes it.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        sigval
+            print session identifier received with SIG_VAR_PRINT
+
+============================================================================*/
+static void HandlePrint( FileVarsState *pState, int sigval )
+{
+    VAR_HANDLE hVar;
+    int fd;
+
+    /* open a print session */
+    if( VAR_OpenPrintSession( pState->hVarServer,
+                              sigval,
+                              &hVar,
+                              &fd ) == EOK )
+    {
+        /* print the file variable */
+        PrintFileVar( pState, hVar, fd );
+
+        /* Close the print session */
+        VAR_ClosePrintSession( pState->hVarServer, sigval, fd );
+    }
+}
+
+/*============================================================================*/
+/*  PrintFileVar                                                              */
+/*!
+    Print a filevar
+
+    The PrintFileVar function iterates through all the registered filevars
+    looking for the specified variable handle.  If found, it renders the
+    compiled template associated with the file variable to the specified
+    output stream.  The template is compiled on first use.  The template
+    file of an uncached file variable is read on every print, and the
+    template is recompiled if it has changed.  Cached file variables
+    are served from the cached output, which is re-rendered only if it
+    has been invalidated by a dependency change.  When a
+    cached file variable is re-rendered, its output is streamed to the
+    reader while it is rendered into the cache.  The time to the first
+    byte of output is recorded in the file variable statistics.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        hVar
+            handle of the variable to print
+
+    @param[in]
+        fd
+            output file descriptor to render to
+
+    @retval EOK - file variable rendered successfully
+    @retval ENOENT - file variable was not found
+    @retval EINVAL - invalid arguments
+
+============================================================================*/
+static int PrintFileVar( FileVarsState *pState, VAR_HANDLE hVar, int fd )
+{
+    int result = EINVAL;
+    FileVar *pFileVar;
+    struct timespec start;
+    struct timespec firstByte;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    memset( &firstByte, 0, sizeof( firstByte ) );
+
+    if( ( pState != NULL ) &&
+        ( hVar != VAR_INVALID ) )
+    {
+        result = ENOENT;
+
+        pFileVar = pState->pFileVars;
+        while( pFileVar != NULL )
+        {
+            if( pFileVar->hStats == hVar )
+            {
+                PrintStats( pFileVar, fd );
+                result = EOK;
+                break;
+            }
+
+            if( pFileVar->hVar == hVar )
+            {
+                RecordRead( pFileVar );
+
+                if( pFileVar->cache == false )
+                {
+                    /* pick up template edits on the next print */
+                    ReloadTemplate( pState, pFileVar );
+                }
+
+                if( CompileFileVar( pState, pFileVar ) == EOK )
+                {
+                    if( pFileVar->cache == false )
+                    {
+                        RenderFileVar( pState, pFileVar, fd, -1, &firstByte );
+                    }
+                    else if( pFileVar->valid == true )
+                    {
+                        clock_gettime( CLOCK_MONOTONIC, &firstByte );
+                        CTEMPLATE_Write( fd,
+                                         pFileVar->pOutput,
+                                         pFileVar->outputLen );
+                    }
+                    else
+                    {
+                        /* stream the output while it is being cached */
+                        RenderToCache( pState, pFileVar, fd, &firstByte );
+                    }
+
+                    RecordTTFB( pFileVar, &start, &firstByte );
+                }
+
+                result = EOK;
+                break;
+            }
+
+            pFileVar = pFileVar->pNext;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RecordRead                                                                */
+/*!
+    Record a read of a file variable
+
+    The RecordRead function updates the access frequency of a file
+    variable when it is printed.  The access frequency is decayed
+    lazily, so the print path only costs a coarse clock read and a
+    shift.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable which was printed
+
+============================================================================*/
+static void RecordRead( FileVar *pFileVar )
+{
+    uint32_t period = HeatPeriod();
+
+    pFileVar->reads++;
+    pFileVar->heat = DecayHeat( pFileVar, period ) + HEAT_UNIT;
+    pFileVar->heatPeriod = period;
+    pFileVar->lastUsed = MonotonicSeconds();
+}
+
+/*============================================================================*/
+/*  DecayHeat                                                                 */
+/*!
+    Get the decayed access frequency of a file variable
+
+    The DecayHeat function gets the access frequency of a file variable
+    as of the specified period.  The access frequency is halved for
+    every HEAT_HALF_LIFE period which has elapsed since it was last
+    updated.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+    @param[in]
+        period
+            current access frequency period
+
+    @retval decayed access frequency
+
+============================================================================*/
+static uint64_t DecayHeat( FileVar *pFileVar, uint32_t period )
+{
+    uint32_t elapsed = period - pFileVar->heatPeriod;
+
+    return ( elapsed < 64 ) ? ( pFileVar->heat >> elapsed ) : 0;
+}
+
+/*============================================================================*/
+/*  HeatPeriod                                                                */
+/*!
+    Get the current access frequency period
+
+    The HeatPeriod function gets the number of HEAT_HALF_LIFE periods
+    which have elapsed on the monotonic clock.
+
+    @retval current access frequency period
+
+============================================================================*/
+static uint32_t HeatPeriod( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC_COARSE, &now );
+
+    return (uint32_t)( now.tv_sec / HEAT_HALF_LIFE );
+}
+
+/*============================================================================*/
+/*  RankFileVars                                                              */
+/*!
+    Rank the cached file variables by access frequency
+
+    The RankFileVars function sorts the cached file variables from the
+    most to the least frequently printed, and marks the hottest ones,
+    up to the configured number, to be pre-rendered.  It must be called
+    whenever file variables are added or removed, since the ranking
+    refers to them.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @retval EOK - the file variables were ranked
+    @retval ENOMEM - memory allocation failure
+
+============================================================================*/
+static int RankFileVars( FileVarsState *pState )
+{
+    int result = EOK;
+    FileVar **ppRanked;
+    FileVar *pFileVar;
+    uint32_t period = HeatPeriod();
+    size_t n = 0;
+    size_t i;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        n++;
+    }
+
+    if( n > pState->rankSize )
+    {
+        ppRanked = realloc( pState->ppRanked, n * sizeof( FileVar * ) );
+        if( ppRanked != NULL )
+        {
+            pState->ppRanked = ppRanked;
+            pState->rankSize = n;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    pState->nRanked = 0;
+
+    if( result == EOK )
+    {
+        for( pFileVar = pState->pFileVars;
+             pFileVar != NULL;
+             pFileVar = pFileVar->pNext )
+        {
+            /* bring every access frequency up to the same period */
+            pFileVar->heat = DecayHeat( pFileVar, period );
+            pFileVar->heatPeriod = period;
+            pFileVar->hot = false;
+
+            if( pFileVar->cache == true )
+            {
+                pState->ppRanked[pState->nRanked++] = pFileVar;
+            }
+        }
+
+        qsort( pState->ppRanked,
+               pState->nRanked,
+               sizeof( FileVar * ),
+               CompareHeat );
+
+        for( i = 0;
+             ( i < pState->nRanked ) && ( i < (size_t)pState->hotCount );
+             i++ )
+        {
+            pState->ppRanked[i]->hot = ( pState->ppRanked[i]->heat > 0 );
+        }
+
+        pState->rankPeriod = period;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  CompareHeat                                                               */
+/*!
+    Compare the access frequency of two file variables
+
+    The CompareHeat function is the qsort comparison function which
+    orders file variables from the highest to the lowest access
+    frequency.
+
+    @param[in]
+        p1
+            pointer to the first file variable pointer
+
+    @param[in]
+        p2
+            pointer to the second file variable pointer
+
+    @retval negative if the first file variable is hotter
+    @retval positive if the second file variable is hotter
+    @retval 0 if they are equally hot
+
+============================================================================*/
+static int CompareHeat( const void *p1, const void *p2 )
+{
+    const FileVar *pFileVar1 = *(FileVar * const *)p1;
+    const FileVar *pFileVar2 = *(FileVar * const *)p2;
+
+    return ( pFileVar1->heat < pFileVar2->heat ) ?  1 :
+           ( pFileVar1->heat > pFileVar2->heat ) ? -1 : 0;
+}
+
+/*============================================================================*/
+/*  WarmFileVars                                                              */
+/*!
+    Pre-render the hottest file variables
+
+    The WarmFileVars function renders the output cache of each of the
+    hottest file variables which does not hold valid output, starting
+    with the most frequently printed one, so they are served from the
+    cache when they are next printed.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void WarmFileVars( FileVarsState *pState )
+{
+    FileVar *pFileVar;
+    size_t i;
+
+    for( i = 0;
+         ( i < pState->nRanked ) && ( pState->ppRanked[i]->hot == true );
+         i++ )
+    {
+        pFileVar = pState->ppRanked[i];
+        if( ( pFileVar->valid == false ) &&
+            ( CompileFileVar( pState, pFileVar ) == EOK ) )
+        {
+            RenderToCache( pState, pFileVar, -1, NULL );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  CompileFileVar                                                            */
+/*!
+    Compile the template of a file variable
+
+    The CompileFileVar function compiles and resolves the template
+    associated with the file variable if it has not already been
+    compiled and resolved.  For cached file variables, a modification
+    notification is requested for each variable referenced by the
+    template so the cached output can be invalidated when one of
+    them changes.
+
+    References to variables which do not exist are left unresolved
+    and are looked up again once their retry interval has elapsed,
+    rather than on every render.  Likewise, the variables matching
+    the loops of the template are looked up again every
+    LOOP_REFRESH_INTERVAL seconds.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to compile
+
+    @retval EOK - the template is compiled
+    @retval ENOENT - the template could not be compiled
+
+============================================================================*/
+static int CompileFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    int result = EOK;
+
+    if( pFileVar->pTemplate == NULL )
+    {
+        pFileVar->pTemplate = LoadTemplate( pState, pFileVar->pFilename );
+        pFileVar->lastUsed = MonotonicSeconds();
+        if( pFileVar->pTemplate == NULL )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot compile %s",
+                    pFileVar->pFilename );
+            result = ENOENT;
+        }
+    }
+
+    if( ( pFileVar->pTemplate != NULL ) &&
+        ( pFileVar->resolved == false ) )
+    {
+        CTEMPLATE_Resolve( pState->hVarServer, pFileVar->pTemplate );
+        pFileVar->resolved = true;
+        pFileVar->backoff = 0;
+
+        FoldConstants( pState, pFileVar );
+        AddDependencies( pState, pFileVar );
+
+        if( pFileVar->pTemplate->nMissing > 0 )
+        {
+            syslog( LOG_WARNING,
+                    "filevars: %s references %zu missing variables",
+                    pFileVar->pName,
+                    pFileVar->pTemplate->nMissing );
+        }
+
+        ScheduleResolve( pFileVar );
+        pFileVar->requeryAt = MonotonicSeconds() + LOOP_REFRESH_INTERVAL;
+    }
+    else if( pFileVar->pTemplate != NULL )
+    {
+        if( ( pFileVar->pTemplate->nMissing > 0 ) &&
+            ( (int32_t)( MonotonicSeconds() - pFileVar->retryAt ) >= 0 ) )
+        {
+            ResolveMissing( pState, pFileVar );
+        }
+
+        if( ( ( pFileVar->pTemplate->nLoops > 0 ) ||
+              ( pFileVar->pTemplate->nAggregates > 0 ) ) &&
+            ( (int32_t)( MonotonicSeconds() -
+                         pFileVar->requeryAt ) >= 0 ) )
+        {
+            RequeryLoops( pState, pFileVar );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  LoadTemplate                                                              */
+/*!
+    Load a compiled template
+
+    The LoadTemplate function compiles the specified template file.
+    If the shared template store is enabled, the template is looked up
+    in the store by its path and content hash first, and is only
+    compiled if no instance has already stored it.  Newly compiled
+    templates are added to the store, and loaded back from it, so the
+    template text is only held once in memory across all instances.
+    Images are only added to the store once they have loaded, so a
+    corrupt image is never shared.
+
+    If the template cache directory is enabled, templates which are not
+    in the shared template store are mapped from the cache file written
+    by a previous run, and newly compiled templates are saved there, so
+    templates are only parsed once until their content changes.  A
+    stored or cached image which does not load is ignored, and the
+    template is compiled from its source instead.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileName
+            name of the template file to load
+
+    @retval pointer to the compiled template
+    @retval NULL if the template could not be loaded
+
+============================================================================*/
+static CTemplate *LoadTemplate( FileVarsState *pState, char *pFileName )
+{
+    CTemplate *pTemplate = NULL;
+    CTemplate *pShared;
+    CTemplateImage *pImage = NULL;
+    const CTemplateImage *pMapped = NULL;
+    const CTemplateImage *pStored = NULL;
+    uint64_t contentHash;
+    char *pSource;
+    size_t sourceLen;
+    size_t len = 0;
+
+    if( ( pState->pStore == NULL ) &&
+        ( pState->pCacheDir == NULL ) )
+    {
+        pTemplate = CTEMPLATE_Compile( pFileName );
+    }
+    else
+    {
+        pSource = CTEMPLATE_ReadTemplate( pFileName, &sourceLen );
+        if( pSource != NULL )
+        {
+            contentHash = HASH_Compute( pSource, sourceLen, 0 );
+            if( pState->pStore != NULL )
+            {
+                pStored = TSTORE_Find( pState->pStore,
+                                       pFileName,
+                                       contentHash,
+                                       &len );
+                pTemplate = CTEMPLATE_Load( pFileName, pStored, len );
+            }
+
+            if( ( pTemplate == NULL ) &&
+                ( pState->pCacheDir != NULL ) )
+            {
+                pMapped = TCACHE_Map( pState->pCacheDir, contentHash, &len );
+                pTemplate = CTEMPLATE_Load( pFileName, pMapped, len );
+                if( pTemplate != NULL )
+                {
+                    /* the template keeps the cache file mapped */
+                    pTemplate->pMapping = pMapped;
+                    pTemplate->mappingLen = len;
+                }
+                else if( pMapped != NULL )
+                {
+                    syslog( LOG_WARNING,
+                            "filevars: ignoring corrupt cached template %s",
+                            pFileName );
+                    TCACHE_Unmap( pMapped, len );
+                    pMapped = NULL;
+                }
+            }
+
+            if( pTemplate == NULL )
+            {
+                /* nothing valid was stored or cached, so compile it */
+                pTemplate = CTEMPLATE_CompileBuffer( pFileName,
+                                                     pSource,
+                                                     sourceLen );
+                pSource = NULL;
+                pImage = CTEMPLATE_Serialize( pTemplate, contentHash, &len );
+                if( ( pImage != NULL ) &&
+                    ( pState->pCacheDir != NULL ) )
+                {
+                    TCACHE_Save( pState->pCacheDir, pImage, len );
+                }
+            }
+
+            /* only images which have loaded are shared with the other
+               instances, and a private copy is kept if the store is
+               full */
+            if( ( pStored == NULL ) &&
+                ( pState->pStore != NULL ) &&
+                ( ( pMapped != NULL ) || ( pImage != NULL ) ) )
+            {
+                pStored = TSTORE_Add( pState->pStore,
+                                      pFileName,
+                                      ( pMapped != NULL ) ? pMapped : pImage,
+                                      len );
+                pShared = CTEMPLATE_Load( pFileName, pStored, len );
+                if( pShared != NULL )
+                {
+                    CTEMPLATE_Free( pTemplate );
+                    pTemplate = pShared;
+                }
+            }
+
+            free( pSource );
+            free( pImage );
+        }
+    }
+
+    return pTemplate;
+}
+
+/*============================================================================*/
+/*  ReloadTemplate                                                            */
+/*!
+    Reload the template of a file variable if it has changed
+
+    The ReloadTemplate function reads the template file of a file
+    variable, including the files it includes, and compares the hash
+    of its content with the hash of the source its compiled template
+    was built from.  If the template has changed, the compiled
+    template is released so it is compiled again before it is
+    rendered.  This keeps the behaviour of reading the template file
+    on every print for uncached file variables, so template edits take
+    effect on the next print without reloading the configuration.
+    The first hash seen for a template which is already compiled is
+    recorded without recompiling it.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+============================================================================*/
+static void ReloadTemplate( FileVarsState *pState, FileVar *pFileVar )
+{
+    uint64_t hash;
+    char *pSource;
+    size_t len;
+
+    pSource = CTEMPLATE_ReadTemplate( pFileVar->pFilename, &len );
+    if( pSource != NULL )
+    {
+        hash = HASH_Compute( pSource, len, 0 );
+        if( ( pFileVar->pTemplate != NULL ) &&
+            ( pFileVar->sourceHash != 0 ) &&
+            ( pFileVar->sourceHash != hash ) )
+        {
+            EvictFileVar( pState, pFileVar );
+
+            if( pState->verbose == true )
+            {
+                printf( "filevars: %s template changed\n", pFileVar->pName );
+            }
+        }
+
+        pFileVar->sourceHash = hash;
+        free( pSource );
+    }
+}
+
+/*============================================================================*/
+/*  RenderToCache                                                             */
+/*!
+    Render a file variable into its output cache
+
+    The RenderToCache function renders the compiled template of the
+    file variable into the scratch memory file, and copies the result
+    into the file variable's NUL terminated output buffer.  The output
+    generation counter is incremented whenever the output hash changes.
+    The output is also streamed to the reader of a print which is
+    waiting for it, if there is one.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to render
+
+    @param[in]
+        streamfd
+            file descriptor of the reader waiting for the output, or -1
+
+    @param[out]
+        pFirstByte
+            pointer to a location to store the time at which the first
+            byte of output was streamed, or NULL
+
+    @retval EOK - the output cache is valid
+    @retval ENOMEM - memory allocation failure
+    @retval EBADF - the scratch file is not available
+    @retval other error from the template renderer
+
+============================================================================*/
+static int RenderToCache( FileVarsState *pState,
+                          FileVar *pFileVar,
+                          int streamfd,
+                          struct timespec *pFirstByte )
+{
+    int result = EBADF;
+    off_t len;
+    char *pOutput;
+    uint64_t hash;
+
+    if( pState->scratchfd >= 0 )
+    {
+        ftruncate( pState->scratchfd, 0 );
+        lseek( pState->scratchfd, 0, SEEK_SET );
+
+        result = RenderFileVar( pState,
+                                pFileVar,
+                                pState->scratchfd,
+                                streamfd,
+                                pFirstByte );
+        if( result == EOK )
+        {
+            len = lseek( pState->scratchfd, 0, SEEK_CUR );
+            if( (size_t)len >= pFileVar->outputSize )
+            {
+                pOutput = realloc( pFileVar->pOutput, len + 1 );
+                if( pOutput != NULL )
+                {
+                    pFileVar->pOutput = pOutput;
+                    pFileVar->outputSize = len + 1;
+                }
+                else
+                {
+                    result = ENOMEM;
+                }
+            }
+        }
+
+        if( ( result == EOK ) &&
+            ( pread( pState->scratchfd, pFileVar->pOutput, len, 0 ) == len ) )
+        {
+            pFileVar->pOutput[len] = '\0';
+            pFileVar->outputLen = len;
+            hash = HASH_Compute( pFileVar->pOutput, len, 0 );
+            if( ( pFileVar->generation == 0 ) ||
+                ( hash != pFileVar->hash ) )
+            {
+                pFileVar->generation++;
+                pFileVar->hash = hash;
+            }
+
+            /* partial output is served, but not kept in the cache */
+            pFileVar->valid = ( pFileVar->partial == false );
+
+            if( ( pFileVar->slot >= 0 ) &&
+                ( pFileVar->valid == true ) )
+            {
+                FVSHM_Publish( pState->pShm,
+                               pFileVar->slot,
+                               pFileVar->pOutput,
+                               len,
+                               pFileVar->hash,
+                               pFileVar->generation );
+            }
+        }
+        else if( result == EOK )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RefreshFileVar                                                            */
+/*!
+    Refresh the published output of a file variable
+
+    The RefreshFileVar function re-renders the output cache of a
+    file variable and publishes the result to wherever the file
+    variable is configured to publish it.  Publishing is skipped
+    if the hash of the output is unchanged since it was last published.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to refresh
+
+    @retval EOK - the file variable was refreshed
+    @retval other error from RenderToCache, PushFileVar or WriteOutputFile
+
+============================================================================*/
+static int RefreshFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    int result;
+
+    result = RenderToCache( pState, pFileVar, -1, NULL );
+    if( ( result == EOK ) &&
+        ( ( pFileVar->published == false ) ||
+          ( pFileVar->publishedHash != pFileVar->hash ) ) )
+    {
+        if( pFileVar->push == true )
+        {
+            result = PushFileVar( pState, pFileVar );
+        }
+
+        if( ( result == EOK ) &&
+            ( pFileVar->pOutputFile != NULL ) )
+        {
+            result = WriteOutputFile( pFileVar );
+        }
+
+        if( ( result == EOK ) &&
+            ( pFileVar->hETag != VAR_INVALID ) )
+        {
+            result = PublishETag( pState, pFileVar );
+        }
+
+        /* only remember the hash once every target is up to date */
+        pFileVar->published = ( result == EOK );
+        pFileVar->publishedHash = pFileVar->hash;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  PushFileVar                                                               */
+/*!
+    Push the rendered output into the variable value
+
+    The PushFileVar function stores the cached rendered output of the
+    file variable as the string value of the variable, so readers can
+    get it directly from the variable server.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to push
+
+    @retval EOK - the variable value was updated
+    @retval other error from VAR_Set
+
+============================================================================*/
+static int PushFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    int result;
+    VarObject obj;
+
+    obj.type = VARTYPE_STR;
+    obj.val.str = pFileVar->pOutput;
+    obj.len = pFileVar->outputLen + 1;
+
+    result = VAR_Set( pState->hVarServer, pFileVar->hVar, &obj );
+    if( result != EOK )
+    {
+        syslog( LOG_ERR,
+                "filevars: cannot push %s: %s",
+                pFileVar->pFilename,
+                strerror( result ) );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  WriteOutputFile                                                           */
+/*!
+    Materialize the rendered output into the output file
+
+    The WriteOutputFile function writes the cached rendered output into
+    a temporary file alongside the output file, and then renames it
+    over the output file so readers always see a complete file.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to materialize
+
+    @retval EOK - the output file was updated
+    @retval ENOMEM - memory allocation failure
+    @retval other error from mkstemp, write or rename
+
+============================================================================*/
+static int WriteOutputFile( FileVar *pFileVar )
+{
+    int result = ENOMEM;
+    char *pTempName;
+    size_t len;
+    int fd;
+
+    len = strlen( pFileVar->pOutputFile ) + sizeof( ".XXXXXX" );
+    pTempName = malloc( len );
+    if( pTempName != NULL )
+    {
+        snprintf( pTempName, len, "%s.XXXXXX", pFileVar->pOutputFile );
+
+        fd = mkstemp( pTempName );
+        if( fd >= 0 )
+        {
+            fchmod( fd, 0644 );
+
+            result = CTEMPLATE_Write( fd,
+                                      pFileVar->pOutput,
+                                      pFileVar->outputLen );
+            close( fd );
+
+            if( ( result == EOK ) &&
+                ( rename( pTempName, pFileVar->pOutputFile ) != 0 ) )
+            {
+                result = errno;
+            }
+
+            if( result != EOK )
+            {
+                unlink( pTempName );
+            }
+        }
+        else
+        {
+            result = errno;
+        }
+
+        if( result != EOK )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot write %s: %s",
+                    pFileVar->pOutputFile,
+                    strerror( result ) );
+        }
+
+        free( pTempName );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetupCompanion                                                            */
+/*!
+    Set up a companion variable of a file variable
+
+    The SetupCompanion function gets the handle of a companion variable
+    of a file variable, such as its etag variable.  The companion
+    variable is created as a string variable if it does not already
+    exist.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pCompanionName
+            name of the companion variable
+
+    @param[in]
+        len
+            length of the companion string variable
+
+    @retval handle of the companion variable
+    @retval VAR_INVALID if the companion variable could not be created
+
+============================================================================*/
+static VAR_HANDLE SetupCompanion( FileVarsState *pState,
+                                  char *pCompanionName,
+                                  size_t len )
+{
+    VAR_HANDLE hCompanion;
+    VarInfo info;
+    char empty[] = "";
+
+    hCompanion = VAR_FindByName( pState->hVarServer, pCompanionName );
+    if( hCompanion == VAR_INVALID )
+    {
+        memset( &info, 0, sizeof( info ) );
+        strncpy( info.name, pCompanionName, MAX_NAME_LEN );
+        info.var.type = VARTYPE_STR;
+        info.var.len = len;
+        info.var.val.str = empty;
+
+        if( VAR_Create( pState->hVarServer, &info ) == EOK )
+        {
+            hCompanion = VAR_FindByName( pState->hVarServer,
+                                         pCompanionName );
+        }
+    }
+
+    if( hCompanion == VAR_INVALID )
+    {
+        syslog( LOG_ERR, "filevars: cannot create %s", pCompanionName );
+    }
+
+    return hCompanion;
+}
+
+/*============================================================================*/
+/*  PublishETag                                                               */
+/*!
+    Publish the etag of the rendered output
+
+    The PublishETag function stores the output hash and generation
+    counter of the file variable into its companion etag variable
+    in the form <hash>-<generation>.  Clients can compare the etag
+    with a previously seen value to find out whether the output has
+    changed, without printing the file variable.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+    @retval EOK - the etag variable was updated
+    @retval other error from VAR_Set
+
+============================================================================*/
+static int PublishETag( FileVarsState *pState, FileVar *pFileVar )
+{
+    int result;
+    VarObject obj;
+    char etag[ETAG_LEN];
+
+    snprintf( etag,
+              sizeof( etag ),
+              "%016" PRIx64 "-%" PRIu32,
+              pFileVar->hash,
+              pFileVar->generation );
+
+    obj.type = VARTYPE_STR;
+    obj.val.str = etag;
+    obj.len = strlen( etag ) + 1;
+
+    result = VAR_Set( pState->hVarServer, pFileVar->hETag, &obj );
+    if( result != EOK )
+    {
+        syslog( LOG_ERR,
+                "filevars: cannot publish etag for %s: %s",
+                pFileVar->pName,
+                strerror( result ) );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RestoreFileVar                                                            */
+/*!
+    Restore a file variable from the render cache checkpoint
+
+    The RestoreFileVar function looks up the file variable in the
+    render cache checkpoint written by the previous run, and restores
+    its statistics and output generation counter.  The checkpointed
+    output is only restored into the output cache if the fingerprint
+    of the template and the current values of its dependencies matches
+    the fingerprint taken when the checkpoint was written, so a value
+    which changed while filevars was not running is never served.
+    In lazy mode, the output of file variables which are not
+    pre-rendered is not restored, so they are not compiled until
+    they are printed.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to restore
+
+============================================================================*/
+static void RestoreFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    CheckpointEntry entry;
+    char *pOutput;
+
+    if( CHECKPOINT_Find( pState->pRestore,
+                         pFileVar->pName,
+                         &entry ) == EOK )
+    {
+        pFileVar->reads = entry.reads;
+        pFileVar->heat = entry.heat;
+        pFileVar->heatPeriod = HeatPeriod();
+
+        /* keep the generation counter of the etag monotonic */
+        pFileVar->generation = entry.generation;
+        pFileVar->hash = entry.hash;
+
+        if( ( pFileVar->cache == true ) &&
+            ( ( pState->idleTimeout == 0 ) ||
+              ( pFileVar->prerender == true ) ) &&
+            ( entry.flags & CHECKPOINT_VALID ) &&
+            ( CompileFileVar( pState, pFileVar ) == EOK ) &&
+            ( GetFingerprint( pState, pFileVar ) == entry.fingerprint ) )
+        {
+            pOutput = realloc( pFileVar->pOutput, entry.outputLen + 1 );
+            if( pOutput != NULL )
+            {
+                memcpy( pOutput, entry.pOutput, entry.outputLen );
+                pOutput[entry.outputLen] = '\0';
+                pFileVar->pOutput = pOutput;
+                pFileVar->outputSize = entry.outputLen + 1;
+                pFileVar->outputLen = entry.outputLen;
+                pFileVar->valid = true;
+
+                if( pFileVar->slot >= 0 )
+                {
+                    FVSHM_Publish( pState->pShm,
+                                   pFileVar->slot,
+                                   pFileVar->pOutput,
+                                   pFileVar->outputLen,
+                                   pFileVar->hash,
+                                   pFileVar->generation );
+                }
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  CheckpointFileVars                                                        */
+/*!
+    Checkpoint the render cache
+
+    The CheckpointFileVars function writes the cached output and
+    statistics of every file variable into the render cache checkpoint
+    file, so they can be restored by the next run.  Each valid cached
+    output is saved with a fingerprint of its template and the current
+    values of its dependencies.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @retval EOK - the render cache was checkpointed
+    @retval ENOENT - no checkpoint file is configured
+    @retval other error from the checkpoint module
+
+============================================================================*/
+static int CheckpointFileVars( FileVarsState *pState )
+{
+    int result = ENOENT;
+    Checkpoint *pCheckpoint;
+    CheckpointEntry entry;
+    FileVar *pFileVar;
+
+    pCheckpoint = CHECKPOINT_Create( pState->pCheckpointName );
+    if( pCheckpoint != NULL )
+    {
+        result = EOK;
+
+        for( pFileVar = pState->pFileVars;
+             ( pFileVar != NULL ) && ( result == EOK );
+             pFileVar = pFileVar->pNext )
+        {
+            memset( &entry, 0, sizeof( entry ) );
+            entry.pName = pFileVar->pName;
+            entry.hash = pFileVar->hash;
+            entry.generation = pFileVar->generation;
+            entry.reads = pFileVar->reads;
+            entry.heat = DecayHeat( pFileVar, HeatPeriod() );
+
+            if( ( pFileVar->valid == true ) &&
+                ( pFileVar->pending == false ) )
+            {
+                entry.flags = CHECKPOINT_VALID;
+                entry.fingerprint = GetFingerprint( pState, pFileVar );
+                entry.pOutput = pFileVar->pOutput;
+                entry.outputLen = pFileVar->outputLen;
+            }
+
+            result = CHECKPOINT_Add( pCheckpoint, &entry );
+        }
+
+        if( result == EOK )
+        {
+            result = CHECKPOINT_Commit( pCheckpoint );
+        }
+        else
+        {
+            CHECKPOINT_Close( pCheckpoint );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetFingerprint                                                            */
+/*!
+    Get the fingerprint of a file variable's inputs
+
+    The GetFingerprint function calculates a hash over the segments of
+    the compiled template of a file variable and the current values of
+    the variables it references, including the variables matched by
+    its loops.  The values are read with VAR_Get, so the fingerprint
+    is much cheaper to calculate than rendering the template, and
+    changes whenever the template or the value of one of its
+    dependencies changes.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+    @retval fingerprint of the template and its dependency values
+
+============================================================================*/
+static uint64_t GetFingerprint( FileVarsState *pState, FileVar *pFileVar )
+{
+    uint64_t fingerprint = 0;
+    Segment *pSegment;
+    size_t i;
+    size_t j;
+
+    for( i = 0; i < pFileVar->pTemplate->nSegments; i++ )
+    {
+        pSegment = &pFileVar->pTemplate->pSegments[i];
+        fingerprint = HASH_Compute( pSegment->pText,
+                                    pSegment->len,
+                                    fingerprint );
+
+        if( ( pSegment->type == SEGMENT_VAR ) ||
+            ( pSegment->type == SEGMENT_IF ) )
+        {
+            fingerprint = HashValue( pState, pSegment->hVar, fingerprint );
+        }
+
+        for( j = 0; j < pSegment->nMatches; j++ )
+        {
+            fingerprint = HASH_Compute( pSegment->pMatches[j].pName,
+                                        strlen( pSegment->pMatches[j].pName ),
+                                        fingerprint );
+            fingerprint = HashValue( pState,
+                                     pSegment->pMatches[j].hVar,
+                                     fingerprint );
+        }
+    }
+
+    return fingerprint;
+}
+
+/*============================================================================*/
+/*  HashValue                                                                 */
+/*!
+    Add the value of a variable to a hash
+
+    The HashValue function reads the value of a variable with VAR_Get
+    and adds it, and its type, to a running hash.  A variable which
+    does not exist is hashed as an invalid type.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        hVar
+            handle of the variable, or VAR_INVALID
+
+    @param[in]
+        hash
+            hash to add the value to
+
+    @retval updated hash
+
+============================================================================*/
+static uint64_t HashValue( FileVarsState *pState,
+                           VAR_HANDLE hVar,
+                           uint64_t hash )
+{
+    VarObject obj;
+
+    memset( &obj, 0, sizeof( obj ) );
+    if( ( hVar != VAR_INVALID ) &&
+        ( VAR_Get( pState->hVarServer, hVar, &obj ) == EOK ) )
+    {
+        if( ( obj.type == VARTYPE_STR ) &&
+            ( obj.val.str != NULL ) )
+        {
+            hash = HASH_Compute( obj.val.str,
+                                 strnlen( obj.val.str, obj.len ),
+                                 hash );
+        }
+        else if( ( obj.type == VARTYPE_BLOB ) &&
+                 ( obj.val.blob != NULL ) )
+        {
+            hash = HASH_Compute( obj.val.blob, obj.len, hash );
+        }
+        else
+        {
+            hash = HASH_Compute( &obj.val, sizeof( obj.val ), hash );
+        }
+    }
+
+    return HASH_Compute( &obj.type, sizeof( obj.type ), hash );
+}
+
+/*============================================================================*/
+/*  AddDependency                                                             */
+/*!
+    Add a dependency to the dependency index
+
+    The AddDependency function records that the specified file variable
+    depends on the specified variable.  A modification notification is
+    requested the first time a variable is added to the index.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        hVar
+            handle of the variable referenced by the file variable
+
+    @param[in]
+        pFileVar
+            pointer to the file variable which depends on hVar
+
+    @retval EOK - the dependency was added
+    @retval ENOMEM - memory allocation failure
+
+============================================================================*/
+static int AddDependency( FileVarsState *pState,
+                          VAR_HANDLE hVar,
+                          FileVar *pFileVar )
+{
+    int result = ENOMEM;
+    Dependency **ppBucket = &pState->deps[hVar % DEP_INDEX_SIZE];
+    Dependency *pDep = *ppBucket;
+    FileVarRef *pRef;
+
+    while( ( pDep != NULL ) && ( pDep->hVar != hVar ) )
+    {
+        pDep = pDep->pNext;
+    }
+
+    if( pDep == NULL )
+    {
+        pDep = calloc( 1, sizeof( Dependency ) );
+        if( pDep != NULL )
+        {
+            pDep->hVar = hVar;
+            pDep->pNext = *ppBucket;
+            *ppBucket = pDep;
+
+            VAR_Notify( pState->hVarServer, hVar, NOTIFY_MODIFIED );
+        }
+    }
+
+    if( pDep != NULL )
+    {
+        /* templates may reference the same variable more than once */
+        pRef = pDep->pFileVars;
+        while( ( pRef != NULL ) && ( pRef->pFileVar != pFileVar ) )
+        {
+            pRef = pRef->pNext;
+        }
+
+        if( pRef == NULL )
+        {
+            pRef = malloc( sizeof( FileVarRef ) );
+            if( pRef != NULL )
+            {
+                pRef->pFileVar = pFileVar;
+                pRef->pNext = pDep->pFileVars;
+                pDep->pFileVars = pRef;
+            }
+        }
+
+        result = ( pRef != NULL ) ? EOK : ENOMEM;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RemoveDependency                                                          */
+/*!
+    Remove a dependency from the dependency index
+
+    The RemoveDependency function removes the record that the specified
+    file variable depends on the specified variable.  The modification
+    notification is cancelled once no file variable depends on it.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        hVar
+            handle of the variable referenced by the file variable
+
+    @param[in]
+        pFileVar
+            pointer to the file variable which depends on hVar
+
+============================================================================*/
+static void RemoveDependency( FileVarsState *pState,
+                              VAR_HANDLE hVar,
+                              FileVar *pFileVar )
+{
+    Dependency **ppDep = &pState->deps[hVar % DEP_INDEX_SIZE];
+    Dependency *pDep;
+    FileVarRef **ppRef;
+    FileVarRef *pRef;
+
+    while( ( *ppDep != NULL ) && ( (*ppDep)->hVar != hVar ) )
+    {
+        ppDep = &(*ppDep)->pNext;
+    }
+
+    pDep = *ppDep;
+    if( pDep != NULL )
+    {
+        ppRef = &pDep->pFileVars;
+        while( ( *ppRef != NULL ) && ( (*ppRef)->pFileVar != pFileVar ) )
+        {
+            ppRef = &(*ppRef)->pNext;
+        }
+
+        pRef = *ppRef;
+        if( pRef != NULL )
+        {
+            *ppRef = pRef->pNext;
+            free( pRef );
+        }
+
+        if( pDep->pFileVars == NULL )
+        {
+            VAR_NotifyCancel( pState->hVarServer, hVar, NOTIFY_MODIFIED );
+            *ppDep = pDep->pNext;
+            free( pDep );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  RemoveDependencies                                                        */
+/*!
+    Remove a file variable from the dependency index
+
+    The RemoveDependencies function removes the file variable from
+    the dependency index entry of every variable referenced by its
+    resolved template, and of every input of its aggregates.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to remove
+
+============================================================================*/
+static void RemoveDependencies( FileVarsState *pState, FileVar *pFileVar )
+{
+    Segment *pSegment;
+    size_t i;
+    size_t j;
+
+    if( pFileVar->resolved == true )
+    {
+        for( i = 0; i < pFileVar->pTemplate->nSegments; i++ )
+        {
+            pSegment = &pFileVar->pTemplate->pSegments[i];
+            /* variable references and section conditions */
+            if( ( pFileVar->cache == true ) &&
+                ( pSegment->hVar != VAR_INVALID ) )
+            {
+                RemoveDependency( pState, pSegment->hVar, pFileVar );
+            }
+
+            for( j = 0;
+                 ( ( pFileVar->cache == true ) ||
+                   ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) ) &&
+                 ( j < pSegment->nMatches );
+                 j++ )
+            {
+                RemoveDependency( pState,
+                                  pSegment->pMatches[j].hVar,
+                                  pFileVar );
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  ResolveMissing                                                            */
+/*!
+    Retry the unresolved variable references of a file variable
+
+    The ResolveMissing function looks up the variables referenced by
+    the template of a file variable which did not exist when it was
+    last resolved.  Newly resolved variables are added to the
+    dependencies of cached file variables, and their cached output is
+    invalidated so it is rendered with the new variables on the next
+    print.  The retry interval doubles up to MISSING_BACKOFF_MAX
+    seconds while variables remain missing.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to resolve
+
+============================================================================*/
+static void ResolveMissing( FileVarsState *pState, FileVar *pFileVar )
+{
+    size_t n;
+
+    n = CTEMPLATE_ResolveMissing( pState->hVarServer, pFileVar->pTemplate );
+    if( n > 0 )
+    {
+        FoldConstants( pState, pFileVar );
+
+        if( pFileVar->cache == true )
+        {
+            AddDependencies( pState, pFileVar );
+
+            pFileVar->valid = false;
+            if( pFileVar->slot >= 0 )
+            {
+                FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+            }
+        }
+
+        if( pState->verbose == true )
+        {
+            printf( "filevars: %s resolved %zu variables, %zu missing\n",
+                    pFileVar->pName,
+                    n,
+                    pFileVar->pTemplate->nMissing );
+        }
+    }
+
+    ScheduleResolve( pFileVar );
+}
+
+/*============================================================================*/
+/*  ScheduleResolve                                                           */
+/*!
+    Schedule the next retry of the unresolved variable references
+
+    The ScheduleResolve function sets the time at which the missing
+    variables of a file variable are next looked up.  The backoff
+    interval starts at MISSING_BACKOFF_MIN seconds and doubles on
+    every retry up to MISSING_BACKOFF_MAX seconds.  It is reset once
+    every variable is resolved.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+============================================================================*/
+static void ScheduleResolve( FileVar *pFileVar )
+{
+    if( pFileVar->pTemplate->nMissing == 0 )
+    {
+        pFileVar->backoff = 0;
+    }
+    else
+    {
+        if( pFileVar->backoff == 0 )
+        {
+            pFileVar->backoff = MISSING_BACKOFF_MIN;
+        }
+        else if( pFileVar->backoff < MISSING_BACKOFF_MAX )
+        {
+            pFileVar->backoff *= 2;
+        }
+
+        pFileVar->retryAt = MonotonicSeconds() + pFileVar->backoff;
+    }
+}
+
+/*============================================================================*/
+/*  RequeryLoops                                                              */
+/*!
+    Look up the variables matching the loops of a file variable
+
+    The RequeryLoops function runs the queries of the loops and
+    aggregates in the template of a file variable again, to pick up
+    variables which have been created or deleted since they were last
+    run.  The variable server does not notify the creation or deletion
+    of variables, so the queries are run at most every
+    LOOP_REFRESH_INTERVAL seconds.  When the matches of a loop change,
+    a cached file variable stops depending on the variables which it
+    matched before and starts depending on the new ones, and its cached
+    output is invalidated.  The inputs of aggregates are swapped in the
+    same way whether or not the file variable is cached.  The results
+    of aggregates are recalculated on every refresh, so rounding errors
+    in their running sums do not build up.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+============================================================================*/
+static void RequeryLoops( FileVarsState *pState, FileVar *pFileVar )
+{
+    CTemplate *pTemplate = pFileVar->pTemplate;
+    LoopMatch *pPrevious;
+    Segment *pSegment;
+    bool changed = false;
+    size_t n;
+    size_t i;
+    size_t j;
+
+    for( i = 0; i < pTemplate->nSegments; i++ )
+    {
+        pSegment = &pTemplate->pSegments[i];
+        if( ( ( pSegment->type == SEGMENT_FOR ) ||
+              ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) ) &&
+            ( CTEMPLATE_Requery( pState->hVarServer,
+                                 pSegment,
+                                 &pPrevious,
+                                 &n ) == true ) )
+        {
+            if( ( pFileVar->cache == true ) ||
+                ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) )
+            {
+                for( j = 0; j < n; j++ )
+                {
+                    RemoveDependency( pState, pPrevious[j].hVar, pFileVar );
+                }
+            }
+
+            CTEMPLATE_FreeMatches( pPrevious, n );
+            changed = true;
+        }
+    }
+
+    if( changed == true )
+    {
+        /* restore the dependencies shared with other references */
+        AddDependencies( pState, pFileVar );
+
+        if( pFileVar->cache == true )
+        {
+            pFileVar->valid = false;
+            if( pFileVar->slot >= 0 )
+            {
+                FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+            }
+        }
+
+        if( pState->verbose == true )
+        {
+            printf( "filevars: %s loop matches changed\n", pFileVar->pName );
+        }
+    }
+
+    pFileVar->requeryAt = MonotonicSeconds() + LOOP_REFRESH_INTERVAL;
+}
+
+/*============================================================================*/
+/*  LoadConstants                                                             */
+/*!
+    Load a list of constant variables
+
+    The LoadConstants function loads the "constants" array of a
+    configuration file or file variable definition, which lists the
+    names of the variables whose values never change, such as the
+    serial number or firmware version.  The names may be wildcard
+    patterns.  Any previously loaded list is replaced.
+
+    @param[in]
+       pNode
+            pointer to the configuration object
+
+    @param[in,out]
+        pList
+            pointer to the constant list to load
+
+============================================================================*/
+static void LoadConstants( JNode *pNode, ConstantList *pList )
+{
+    JArray *pConstants;
+
+    FreeConstants( pList );
+
+    pConstants = (JArray *)JSON_Find( pNode, "constants" );
+    if( pConstants != NULL )
+    {
+        JSON_Iterate( pConstants, AddConstant, (void *)pList );
+    }
+}
+
+/*============================================================================*/
+/*  AddConstant                                                               */
+/*!
+    Add a variable to a list of constant variables
+
+    The AddConstant function is a callback function for the JSON_Iterate
+    function which adds an entry of a "constants" array to a constant
+    list.  Entries which are not strings are ignored.
+
+    @param[in]
+       pNode
+            pointer to the constants array entry
+
+    @param[in]
+        arg
+            opaque pointer to the constant list
+
+    @retval EOK - the entry was processed
+    @retval ENOMEM - memory allocation failure
+
+============================================================================*/
+static int AddConstant( JNode *pNode, void *arg )
+{
+    ConstantList *pList = (ConstantList *)arg;
+    JVar *pVar = (JVar *)pNode;
+    char **ppNames;
+    char *pName;
+    int result = EOK;
+
+    if( ( pVar->var.type == VARTYPE_STR ) &&
+        ( pVar->var.val.str != NULL ) )
+    {
+        result = ENOMEM;
+
+        ppNames = realloc( pList->ppNames,
+                           ( pList->n + 1 ) * sizeof( char * ) );
+        if( ppNames != NULL )
+        {
+            pList->ppNames = ppNames;
+
+            pName = strdup( pVar->var.val.str );
+            if( pName != NULL )
+            {
+                pList->ppNames[pList->n++] = pName;
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FreeConstants                                                             */
+/*!
+    Free a list of constant variables
+
+    The FreeConstants function frees the names in a constant list and
+    empties it.
+
+    @param[in]
+        pList
+            pointer to the constant list to free
+
+============================================================================*/
+static void FreeConstants( ConstantList *pList )
+{
+    size_t i;
+
+    for( i = 0; i < pList->n; i++ )
+    {
+        free( pList->ppNames[i] );
+    }
+
+    free( pList->ppNames );
+    pList->ppNames = NULL;
+    pList->n = 0;
+}
+
+/*============================================================================*/
+/*  IsConstant                                                                */
+/*!
+    Check if a variable referenced by a file variable is constant
+
+    The IsConstant function is called by CTEMPLATE_Fold to check if a
+    variable is listed as constant by the file variable definition, or
+    by its configuration file.
+
+    @param[in]
+       pArg
+            opaque pointer to the file variable
+
+    @param[in]
+        pName
+            name of the referenced variable
+
+    @retval true - the variable is constant
+    @retval false - the variable may change
+
+============================================================================*/
+static bool IsConstant( void *pArg, const char *pName )
+{
+    FileVar *pFileVar = (FileVar *)pArg;
+    ConstantList *pLists[2];
+    ConstantList *pList;
+    bool result = false;
+    size_t i;
+    size_t j;
+
+    pLists[0] = &pFileVar->constants;
+    pLists[1] = ( pFileVar->pConfig != NULL ) ? &pFileVar->pConfig->constants
+                                              : NULL;
+
+    for( i = 0; ( result == false ) && ( i < 2 ); i++ )
+    {
+        pList = pLists[i];
+        for( j = 0;
+             ( pList != NULL ) && ( result == false ) && ( j < pList->n );
+             j++ )
+        {
+            result = ( fnmatch( pList->ppNames[j], pName, FNM_PATHNAME ) == 0 );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FoldConstants                                                             */
+/*!
+    Fold the constant variables of a file variable into its template
+
+    The FoldConstants function bakes the values of the resolved
+    constant variables referenced by the template of a file variable
+    into its literal text, so they are not fetched on every render.
+    It is called before the dependencies of the file variable are
+    added, so no change notifications are requested for the folded
+    variables.  The last known values of a parallel file variable are
+    indexed by segment, so they are discarded when the segments are
+    renumbered.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+============================================================================*/
+static void FoldConstants( FileVarsState *pState, FileVar *pFileVar )
+{
+    size_t n = 0;
+
+    if( ( pFileVar->constants.n > 0 ) ||
+        ( ( pFileVar->pConfig != NULL ) &&
+          ( pFileVar->pConfig->constants.n > 0 ) ) )
+    {
+        n = CTEMPLATE_Fold( pState->hVarServer,
+                            pFileVar->pTemplate,
+                            IsConstant,
+                            pFileVar,
+                            pState->scratchfd );
+    }
+
+    if( n > 0 )
+    {
+        FETCH_FreeValues( pFileVar->pValues, pFileVar->nValues );
+        pFileVar->pValues = NULL;
+        pFileVar->nValues = 0;
+
+        if( pState->verbose == true )
+        {
+            printf( "filevars: %s folded %zu constant references\n",
+                    pFileVar->pName,
+                    n );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  AddDependencies                                                           */
+/*!
+    Add a cached file variable to the dependents of its variables
+
+    The AddDependencies function requests a modification notification
+    for each resolved variable referenced by the template of a cached
+    file variable, and for each variable matched by its loops, so its
+    cached output can be invalidated when one of them changes.  The
+    inputs of aggregates are always added, cached or not, so the
+    aggregates are kept up to date as their inputs change.
+    Variables which the file variable already depends on are skipped.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to add
+
+============================================================================*/
+static void AddDependencies( FileVarsState *pState, FileVar *pFileVar )
+{
+    Segment *pSegment;
+    size_t i;
+    size_t j;
+
+    if( pFileVar->resolved == true )
+    {
+        for( i = 0; i < pFileVar->pTemplate->nSegments; i++ )
+        {
+            pSegment = &pFileVar->pTemplate->pSegments[i];
+            /* variable references and section conditions */
+            if( ( pFileVar->cache == true ) &&
+                ( pSegment->hVar != VAR_INVALID ) )
+            {
+                AddDependency( pState, pSegment->hVar, pFileVar );
+            }
+
+            for( j = 0;
+                 ( ( pFileVar->cache == true ) ||
+                   ( CTEMPLATE_IS_AGGREGATE( pSegment ) ) ) &&
+                 ( j < pSegment->nMatches );
+                 j++ )
+            {
+                AddDependency( pState, pSegment->pMatches[j].hVar, pFileVar );
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  HandleModified                                                            */
+/*!
+    Handle a variable modification notification
+
+    The HandleModified function updates the aggregates of every file
+    variable which depends on the modified variable, and queues a
+    pending change against every cached one.  Each file
+    variable is queued at most once per debounce window, no matter how
+    many of its dependencies change.  The debounce window is opened by
+    the first change, so a continuous stream of changes cannot delay
+    processing indefinitely.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        hVar
+            handle of the modified variable
+
+============================================================================*/
+static void HandleModified( FileVarsState *pState, VAR_HANDLE hVar )
+{
+    Dependency *pDep = pState->deps[hVar % DEP_INDEX_SIZE];
+    FileVarRef *pRef;
+    FileVar *pFileVar;
+
+    while( ( pDep != NULL ) && ( pDep->hVar != hVar ) )
+    {
+        pDep = pDep->pNext;
+    }
+
+    pRef = ( pDep != NULL ) ? pDep->pFileVars : NULL;
+    while( pRef != NULL )
+    {
+        pFileVar = pRef->pFileVar;
+        if( ( pFileVar->resolved == true ) &&
+            ( pFileVar->pTemplate->nAggregates > 0 ) )
+        {
+            CTEMPLATE_Update( pState->hVarServer, pFileVar->pTemplate, hVar );
+        }
+
+        if( ( pFileVar->cache == true ) &&
+            ( pFileVar->pending == false ) )
+        {
+            if( pState->pPending == NULL )
+            {
+                /* open the debounce window */
+                clock_gettime( CLOCK_MONOTONIC, &pState->deadline );
+                pState->deadline.tv_sec += pState->debounce / 1000;
+                pState->deadline.tv_nsec += ( pState->debounce % 1000 )
+                                            * 1000000L;
+                if( pState->deadline.tv_nsec >= 1000000000L )
+                {
+                    pState->deadline.tv_sec++;
+                    pState->deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            pFileVar->pending = true;
+            pFileVar->pNextPending = pState->pPending;
+            pState->pPending = pFileVar;
+        }
+
+        pRef = pRef->pNext;
+    }
+}
+
+/*============================================================================*/
+/*  ProcessChanges                                                            */
+/*!
+    Process the pending dependency changes
+
+    The ProcessChanges function is called once the debounce window has
+    closed, and invalidates the cached output of every file variable
+    with a pending dependency change.  Pushed, materialized and
+    etag file variables are re-rendered and published immediately,
+    and then the hottest file variables are re-rendered
+    in order of their access frequency.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void ProcessChanges( FileVarsState *pState )
+{
+    FileVar *pFileVar = pState->pPending;
+    int n = 0;
+
+    pState->pPending = NULL;
+
+    if( ( pState->hotCount > 0 ) &&
+        ( pState->rankPeriod != HeatPeriod() ) )
+    {
+        /* the access frequencies have decayed since the last ranking */
+        RankFileVars( pState );
+    }
+
+    while( pFileVar != NULL )
+    {
+        pFileVar->pending = false;
+        pFileVar->valid = false;
+
+        if( pFileVar->slot >= 0 )
+        {
+            /* shared cache readers must fall back to printing */
+            FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+        }
+
+        /* retry any missing variables which are due before rendering */
+        if( ( pFileVar->prerender == true ) &&
+            ( CompileFileVar( pState, pFileVar ) == EOK ) )
+        {
+            RefreshFileVar( pState, pFileVar );
+        }
+
+        pFileVar = pFileVar->pNextPending;
+        n++;
+    }
+
+    /* re-render the hottest invalidated file variables first */
+    WarmFileVars( pState );
+
+    if( pState->verbose == true )
+    {
+        printf( "filevars: invalidated %d file variables\n", n );
+    }
+}
+
+/*============================================================================*/
+/*  EvictFileVars                                                             */
+/*!
+    Release the file variables which have not been used recently
+
+    The EvictFileVars function releases the compiled template and the
+    cached output of every file variable which has not been printed
+    for the configured idle timeout, so the resident memory of a lazy
+    instance tracks the working set of file variables rather than the
+    whole configuration.  An evicted file variable is compiled and
+    rendered again when it is next printed.  Pre-rendered file
+    variables are never evicted, since they must follow their
+    dependencies to keep their published output up to date.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void EvictFileVars( FileVarsState *pState )
+{
+    FileVar *pFileVar;
+    uint32_t now = MonotonicSeconds();
+    int n = 0;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        if( ( pFileVar->prerender == false ) &&
+            ( pFileVar->pending == false ) &&
+            ( ( pFileVar->pTemplate != NULL ) ||
+              ( pFileVar->pOutput != NULL ) ) &&
+            ( now - pFileVar->lastUsed >= (uint32_t)pState->idleTimeout ) )
+        {
+            EvictFileVar( pState, pFileVar );
+            n++;
+        }
+    }
+
+    if( n > 0 )
+    {
+        if( pState->lockBudget == 0 )
+        {
+            /* return the released memory to the system */
+            malloc_trim( 0 );
+        }
+
+        if( pState->verbose == true )
+        {
+            printf( "filevars: evicted %d idle file variables\n", n );
+        }
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &pState->sweep );
+    pState->sweep.tv_sec += pState->idleTimeout;
+}
+
+/*============================================================================*/
+/*  EvictFileVar                                                              */
+/*!
+    Release the compiled template and cached output of a file variable
+
+    The EvictFileVar function removes the file variable from the
+    dependency index, frees its compiled template and its cached
+    output, and invalidates its shared cache slot.  Its statistics,
+    and the hash and generation of its output, are kept so its etag
+    remains monotonic once it is rendered again.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to evict
+
+============================================================================*/
+static void EvictFileVar( FileVarsState *pState, FileVar *pFileVar )
+{
+    RemoveDependencies( pState, pFileVar );
+
+    CTEMPLATE_Free( pFileVar->pTemplate );
+    pFileVar->pTemplate = NULL;
+    pFileVar->resolved = false;
+
+    free( pFileVar->pOutput );
+    pFileVar->pOutput = NULL;
+    pFileVar->outputLen = 0;
+    pFileVar->outputSize = 0;
+    pFileVar->valid = false;
+
+    FETCH_FreeValues( pFileVar->pValues, pFileVar->nValues );
+    pFileVar->pValues = NULL;
+    pFileVar->nValues = 0;
+
+    if( pFileVar->slot >= 0 )
+    {
+        FVSHM_Invalidate( pState->pShm, pFileVar->slot );
+    }
+}
+
+/*============================================================================*/
+/*  MonotonicSeconds                                                          */
+/*!
+    Get the coarse monotonic clock time
+
+    The MonotonicSeconds function gets the number of seconds elapsed
+    on the coarse monotonic clock, which is cheap enough to read on
+    every print.
+
+    @retval monotonic clock time in seconds
+
+============================================================================*/
+static uint32_t MonotonicSeconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC_COARSE, &now );
+
+    return (uint32_t)now.tv_sec;
+}
+
+/*============================================================================*/
+/*  PrefaultFileVars                                                          */
+/*!
+    Prefault the compiled templates and cached output
+
+    The PrefaultFileVars function touches every page of the compiled
+    templates, cached output and shared segments of the file variables,
+    so they are resident before the first print.  A warning is logged
+    if the compiled templates and cached output outgrow the locked
+    memory budget, since allocations beyond the prefaulted heap arena
+    may then fault while rendering.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void PrefaultFileVars( FileVarsState *pState )
+{
+    FileVar *pFileVar;
+    CTemplate *pTemplate;
+    size_t total = 0;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        pTemplate = pFileVar->pTemplate;
+        if( pTemplate != NULL )
+        {
+            total += REALTIME_Touch( pTemplate->pSource,
+                                     pTemplate->sourceLen );
+            total += REALTIME_Touch( pTemplate->pMapping,
+                                     pTemplate->mappingLen );
+            total += REALTIME_Touch( pTemplate->pSegments,
+                                     pTemplate->nSegments *
+                                         sizeof( Segment ) );
+        }
+
+        total += REALTIME_Touch( pFileVar->pOutput, pFileVar->outputSize );
+    }
+
+    if( pState->pShm != NULL )
+    {
+        REALTIME_Touch( pState->pShm->pHeader, pState->pShm->size );
+    }
+
+    if( total > pState->lockBudget )
+    {
+        syslog( LOG_WARNING,
+                "filevars: %zu bytes of templates and output exceed the"
+                " locked memory budget of %zu bytes",
+                total,
+                pState->lockBudget );
+    }
+
+    if( pState->verbose == true )
+    {
+        printf( "filevars: prefaulted %zu bytes of templates and output\n",
+                total );
+    }
+}
+
+/*============================================================================*/
+/*  LoadRealtimeConfig                                                        */
+/*!
+    Load the realtime settings from a configuration file
+
+    The LoadRealtimeConfig function loads the optional "realtime"
+    object of a configuration file, which is expected to look as
+    follows:
+
+    "realtime" : { "cpus" : "2,3", "policy" : "fifo", "priority" : 50,
+                   "fetch" : { "cpus" : "4-7", "policy" : "rr",
+                               "priority" : 40 } }
+
+    The optional "fetch" object sets the CPUs and scheduling policy of
+    the variable fetch threads.  Without it, the fetch threads may run
+    on any CPU which the process could run on before it was pinned,
+    with the default scheduling policy.  Settings given on the command
+    line take precedence over those in the configuration files.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pNode
+            pointer to the realtime object
+
+============================================================================*/
+static void LoadRealtimeConfig( FileVarsState *pState, JNode *pNode )
+{
+    JNode *pFetch;
+    char *pCPUList;
+    int priority;
+
+    pCPUList = JSON_GetStr( pNode, "cpus" );
+    if( ( pCPUList != NULL ) &&
+        ( pState->pCPUList == NULL ) )
+    {
+        pState->pCPUList = strdup( pCPUList );
+    }
+
+    if( pState->policy == SCHED_OTHER )
+    {
+        pState->policy = REALTIME_GetPolicy( JSON_GetStr( pNode, "policy" ) );
+        if( pState->policy < 0 )
+        {
+            pState->policy = SCHED_OTHER;
+        }
+        else if( JSON_GetNum( pNode, "priority", &priority ) == EOK )
+        {
+            pState->priority = priority;
+        }
+    }
+
+    pFetch = JSON_Find( pNode, "fetch" );
+    if( pFetch != NULL )
+    {
+        pCPUList = JSON_GetStr( pFetch, "cpus" );
+        if( ( pCPUList != NULL ) &&
+            ( pState->fetch.pCPUList == NULL ) )
+        {
+            pState->fetch.pCPUList = strdup( pCPUList );
+        }
+
+        if( pState->fetch.policy == SCHED_OTHER )
+        {
+            pState->fetch.policy =
+                REALTIME_GetPolicy( JSON_GetStr( pFetch, "policy" ) );
+            if( pState->fetch.policy < 0 )
+            {
+                pState->fetch.policy = SCHED_OTHER;
+            }
+            else if( JSON_GetNum( pFetch, "priority", &priority ) == EOK )
+            {
+                pState->fetch.priority = priority;
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  SetupRealtime                                                             */
+/*!
+    Apply the CPU affinity and scheduling policy
+
+    The SetupRealtime function pins the signal loop of this process to
+    its CPU from the CPU list, and sets its scheduling policy and
+    priority.  Each worker process is pinned to the CPU at its shard
+    index in the CPU list, wrapping around the end of the list, and a
+    single process is pinned to the first CPU in the list.  Threads
+    created later set their own CPU affinity and scheduling policy, so
+    they do not run on the CPU of the signal loop.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void SetupRealtime( FileVarsState *pState )
+{
+    int result;
+    int cpu;
+
+    if( pState->pCPUList != NULL )
+    {
+        cpu = REALTIME_GetCPU( pState->pCPUList, pState->shard );
+        result = REALTIME_SetAffinity( cpu );
+        if( result != EOK )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot pin to CPU %d from %s: %s",
+                    cpu,
+                    pState->pCPUList,
+                    strerror( result ) );
+        }
+    }
+
+    if( pState->policy != SCHED_OTHER )
+    {
+        result = REALTIME_SetScheduler( pState->policy, pState->priority );
+        if( result != EOK )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot set scheduling priority %d: %s",
+                    pState->priority,
+                    strerror( result ) );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  StartFetchPool                                                            */
+/*!
+    Start the fetch thread pool before the first render
+
+    The StartFetchPool function creates the fetch thread pool if any
+    file variable is rendered in parallel.  It is called once the
+    process memory is locked, so the first parallel print does not
+    pay for creating the fetch threads, their variable server
+    connections and their scratch files, and the fetch threads
+    prefault their stacks.  Otherwise the pool is created by the first
+    parallel render.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void StartFetchPool( FileVarsState *pState )
+{
+    FileVar *pFileVar;
+
+    for( pFileVar = pState->pFileVars;
+         ( pFileVar != NULL ) && ( pState->pFetch == NULL );
+         pFileVar = pFileVar->pNext )
+    {
+        if( pFileVar->parallel == true )
+        {
+            pState->fetch.prefault = true;
+            pState->pFetch = FETCH_Create( &pState->fetch );
+            if( pState->pFetch == NULL )
+            {
+                syslog( LOG_ERR, "filevars: cannot start the fetch threads" );
+                break;
+            }
+        }
+    }
+}
+
+/*============================================================================*/
+/*  RenderFileVar                                                             */
+/*!
+    Render the template of a file variable
+
+    The RenderFileVar function renders the compiled template of a file
+    variable to the specified output file descriptor.  The variables
+    of parallel file variables are fetched concurrently by the fetch
+    thread pool, and with a render deadline, a variable which is not
+    fetched by the deadline is substituted rather than holding up the
+    render.  A render in which any variable was substituted is flagged
+    as partial in the file variable statistics.
+
+    Other file variables are rendered one step at a time, and each
+    step is written as soon as it is produced, so leading literal text
+    does not wait for the variables which follow it.  If there is a
+    stream file descriptor, it receives a copy of each step as it is
+    rendered.  The time to the first byte is recorded on every path.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[in]
+        pFileVar
+            pointer to the file variable to render
+
+    @param[in]
+        fd
+            output file descriptor to render to
+
+    @param[in]
+        streamfd
+            file descriptor which receives a copy of the output, or -1
+
+    @param[out]
+        pFirstByte
+            pointer to a location to store the time at which the first
+            byte of output was written, which is left unchanged if no
+            output was written
+
+    @retval EOK - the template was rendered
+    @retval other error from the template renderer
+
+============================================================================*/
+static int RenderFileVar( FileVarsState *pState,
+                          FileVar *pFileVar,
+                          int fd,
+                          int streamfd,
+                          struct timespec *pFirstByte )
+{
+    int result;
+    FetchRender render;
+    SerialRender serial;
+
+    memset( &render, 0, sizeof( render ) );
+
+    if( ( pFileVar->parallel == true ) &&
+        ( pState->pFetch == NULL ) )
+    {
+        pState->fetch.prefault = ( pState->lockBudget > 0 );
+        pState->pFetch = FETCH_Create( &pState->fetch );
+    }
+
+    if( ( pFileVar->parallel == true ) &&
+        ( pFileVar->pValues == NULL ) )
+    {
+        pFileVar->pValues = calloc( pFileVar->pTemplate->nSegments,
+                                    sizeof( FetchValue ) );
+        pFileVar->nValues = pFileVar->pTemplate->nSegments;
+    }
+
+    if( ( pFileVar->parallel == true ) &&
+        ( pState->pFetch != NULL ) &&
+        ( pFileVar->pValues != NULL ) )
+    {
+        render.hVarServer = pState->hVarServer;
+        render.pTemplate = pFileVar->pTemplate;
+        render.pValues = pFileVar->pValues;
+        render.pPlaceholder = pFileVar->pPlaceholder;
+        render.deadline = pFileVar->deadline;
+        render.fd = fd;
+        render.streamfd = streamfd;
+
+        result = FETCH_Render( pState->pFetch, &render );
+
+        if( ( pFirstByte != NULL ) &&
+            ( render.firstByte.tv_sec != 0 ) )
+        {
+            *pFirstByte = render.firstByte;
+        }
+    }
+    else
+    {
+        memset( &serial, 0, sizeof( serial ) );
+        serial.hVarServer = pState->hVarServer;
+        serial.fd = fd;
+        serial.streamfd = streamfd;
+
+        result = CTEMPLATE_Walk( pState->hVarServer,
+                                 pFileVar->pTemplate,
+                                 StreamStep,
+                                 &serial );
+
+        if( ( pFirstByte != NULL ) &&
+            ( serial.firstByte.tv_sec != 0 ) )
+        {
+            *pFirstByte = serial.firstByte;
+        }
+    }
+
+    pFileVar->renders++;
+    if( pFileVar->pTemplate->nMissing > 0 )
+    {
+        pFileVar->misses++;
+    }
+
+    pFileVar->partial = ( render.missed > 0 );
+    if( pFileVar->partial == true )
+    {
+        pFileVar->degraded++;
+        syslog( LOG_WARNING,
+                "filevars: %s rendered with %zu late variables",
+                pFileVar->pName,
+                render.missed );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  StreamStep                                                                */
+/*!
+    Render a step of a serial render
+
+    The StreamStep function is the CTEMPLATE_Walk visitor used by the
+    serial renderer.  It writes the text of the step, or prints the
+    value of its variable, to the output file descriptor, and copies
+    it to the stream file descriptor if there is one, so the reader
+    receives each step as soon as it is rendered.  The time of the
+    first write of output is recorded.
+
+    @param[in]
+       pArg
+            pointer to the serial render
+
+    @param[in]
+       pStep
+            pointer to the step to render
+
+    @retval EOK - the step was rendered
+    @retval other error from write()
+
+============================================================================*/
+static int StreamStep( void *pArg, const CTemplateStep *pStep )
+{
+    int result = EOK;
+    SerialRender *pRender = (SerialRender *)pArg;
+    bool written;
+    off_t offset;
+    off_t end;
+
+    if( pStep->pText != NULL )
+    {
+        result = CTEMPLATE_Write( pRender->fd, pStep->pText, pStep->len );
+        if( ( result == EOK ) &&
+            ( pRender->streamfd >= 0 ) )
+        {
+            /* the reader may go away, which does not fail the render */
+            CTEMPLATE_Write( pRender->streamfd, pStep->pText, pStep->len );
+        }
+
+        written = ( pStep->len > 0 );
+    }
+    else
+    {
+        /* the output is the scratch file when there is a stream */
+        offset = lseek( pRender->fd, 0, SEEK_CUR );
+        VAR_Print( pRender->hVarServer, pStep->hVar, pRender->fd );
+        end = ( offset >= 0 ) ? lseek( pRender->fd, 0, SEEK_CUR ) : -1;
+
+        /* the length of a value printed to a pipe is not known */
+        written = ( end < 0 ) || ( end > offset );
+
+        while( ( pRender->streamfd >= 0 ) &&
+               ( offset >= 0 ) &&
+               ( offset < end ) )
+        {
+            if( sendfile( pRender->streamfd,
+                          pRender->fd,
+                          &offset,
+                          end - offset ) <= 0 )
+            {
+                break;
+            }
+        }
+    }
+
+    if( ( written == true ) &&
+        ( pRender->firstByte.tv_sec == 0 ) &&
+        ( pRender->firstByte.tv_nsec == 0 ) )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &pRender->firstByte );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  RecordTTFB                                                                */
+/*!
+    Record the time to first byte of a print
+
+    The RecordTTFB function records the time from the start of a print
+    of a file variable until the first byte of its output was written
+    to the reader, in microseconds.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable which was printed
+
+    @param[in]
+        pStart
+            pointer to the time at which the print started
+
+    @param[in]
+        pFirstByte
+            pointer to the time at which the first byte was written,
+            or to a zero time if it is not known
+
+============================================================================*/
+static void RecordTTFB( FileVar *pFileVar,
+                        struct timespec *pStart,
+                        struct timespec *pFirstByte )
+{
+    int64_t ttfb;
+
+    if( ( pFirstByte->tv_sec != 0 ) ||
+        ( pFirstByte->tv_nsec != 0 ) )
+    {
+        ttfb = ( pFirstByte->tv_sec - pStart->tv_sec ) * 1000000LL +
+               ( pFirstByte->tv_nsec - pStart->tv_nsec ) / 1000;
+
+        pFileVar->ttfb = ( ttfb > 0 ) ? ttfb : 0;
+        if( pFileVar->ttfb > pFileVar->maxTTFB )
+        {
+            pFileVar->maxTTFB = pFileVar->ttfb;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  PrintStats                                                                */
+/*!
+    Print the statistics of a file variable
+
+    The PrintStats function prints the statistics of a file variable
+    as a JSON object into its companion statistics variable.
+
+    @param[in]
+        pFileVar
+            pointer to the file variable
+
+    @param[in]
         fd
-            output file descriptor to render to
+            output file descriptor to print to
 
-    @retval EOK - file variable rendered successfully
-    @retval ENOENT - file variable was not found
-    @retval EINVAL - invalid arguments
+============================================================================*/
+static void PrintStats( FileVar *pFileVar, int fd )
+{
+    dprintf( fd,
+             "{\"reads\":%" PRIu64
+             ",\"renders\":%" PRIu64
+             ",\"degraded\":%" PRIu64
+             ",\"partial\":%s"
+             ",\"ttfb\":%" PRIu64
+             ",\"maxTTFB\":%" PRIu64
+             ",\"missing\":%zu"
+             ",\"misses\":%" PRIu64 "}",
+             pFileVar->reads,
+             pFileVar->renders,
+             pFileVar->degraded,
+             ( pFileVar->partial == true ) ? "true" : "false",
+             pFileVar->ttfb,
+             pFileVar->maxTTFB,
+             ( pFileVar->pTemplate != NULL )
+                ? pFileVar->pTemplate->nMissing
+                : 0,
+             pFileVar->misses );
+}
+
+/*============================================================================*/
+/*  WaitSignal                                                                */
+/*!
+    Wait for a signal
+
+    The WaitSignal function waits for one of the signals handled by
+    the main loop.  While dependency changes are pending, the wait
+    is bounded by the end of the debounce window, and signals which
+    are already queued are drained without blocking.  In lazy mode,
+    the wait is also bounded by the next release of idle file
+    variables.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @param[out]
+        sigval
+            pointer to a location to store the signal value, which is
+            set to 0 if no signal was received
+
+    @retval the received signal number
+    @retval 0 if no signal was received before the wait timed out
 
 ============================================================================*/
-static int PrintFileVar( FileVarsState *pState, VAR_HANDLE hVar, int fd )
+static int WaitSignal( FileVarsState *pState, int *sigval )
 {
-    int result = EINVAL;
-    FileVar *pFileVar;
-    int fd_in;
+    siginfo_t info;
+    struct timespec timeout;
+    long remaining = -1;
+    long sweep;
+    int sig;
 
-    if( ( pState != NULL ) &&
-        ( hVar != VAR_INVALID ) )
+    if( pState->pPending != NULL )
     {
-        result = ENOENT;
+        remaining = TimeRemaining( &pState->deadline );
+    }
 
-        pFileVar = pState->pFileVars;
-        while( pFileVar != NULL )
+    if( pState->idleTimeout > 0 )
+    {
+        sweep = TimeRemaining( &pState->sweep );
+        if( ( remaining < 0 ) || ( sweep < remaining ) )
         {
-            if( pFileVar->hVar == hVar )
-            {
-                fd_in = open( pFileVar->pFilename, O_RDONLY );
-                if( fd_in > 0 )
-                {
-                    TEMPLATE_FileToFile( pState->hVarServer, fd_in, fd );
-                    close( fd_in );
-                }
+            remaining = sweep;
+        }
+    }
 
-                result = EOK;
-                break;
-            }
+    if( remaining >= 0 )
+    {
+        timeout.tv_sec = remaining / 1000;
+        timeout.tv_nsec = ( remaining % 1000 ) * 1000000L;
+        sig = sigtimedwait( &pState->sigmask, &info, &timeout );
+    }
+    else
+    {
+        sig = sigwaitinfo( &pState->sigmask, &info );
+    }
 
-            pFileVar = pFileVar->pNext;
-        }
+    if( sig > 0 )
+    {
+        *sigval = info.si_value.sival_int;
+    }
+    else
+    {
+        sig = 0;
+        *sigval = 0;
     }
 
-    return result;
+    return sig;
+}
+
+/*============================================================================*/
+/*  TimeRemaining                                                             */
+/*!
+    Get the time remaining until a deadline
+
+    The TimeRemaining function calculates the number of milliseconds
+    remaining until the specified monotonic clock deadline.
+
+    @param[in]
+       pDeadline
+            pointer to the deadline
+
+    @retval number of milliseconds until the deadline
+    @retval 0 if the deadline has passed
+
+============================================================================*/
+static long TimeRemaining( struct timespec *pDeadline )
+{
+    struct timespec now;
+    long remaining;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    remaining = ( pDeadline->tv_sec - now.tv_sec ) * 1000L +
+                ( pDeadline->tv_nsec - now.tv_nsec ) / 1000000L;
+
+    return ( remaining > 0 ) ? remaining : 0;
 }
 
 /*==========================================================================*/
@@ -359,10 +4533,31 @@ static void usage( char *cmdname )
     if( cmdname != NULL )
     {
         fprintf(stderr,
-                "usage: %s [-v] [-h] "
-                " [-h] : display this help"
-                " [-v] : verbose output"
-                " -f <filename> : configuration file",
+                "usage: %s [-v] [-h] [-d <ms>] [-s <name>] [-S <size>]"
+                " [-t <name>] [-T <size>] [-c <dir>] [-e <n>] [-l <s>]"
+                " [-m <size>] [-a <cpus>] [-r <policy>[:<prio>]] [-F <n>]"
+                " [-w <file>] [-p <file> [-u]] [-R <n>] [-P <n>]"
+                " -f <filename> ...\n"
+                " [-h] : display this help\n"
+                " [-v] : verbose output\n"
+                " [-d <ms>] : change notification debounce window\n"
+                " [-s <name>] : shared render cache name\n"
+                " [-S <size>] : shared render cache slot size\n"
+                " [-t <name>] : shared template store name\n"
+                " [-T <size>] : shared template store size\n"
+                " [-c <dir>] : compiled template cache directory\n"
+                " [-e <n>] : compile all templates at startup on n threads\n"
+                " [-l <s>] : release file vars which are idle for s seconds\n"
+                " [-m <size>] : lock memory and prefault size bytes of heap\n"
+                " [-a <cpus>] : pin each process to a CPU from the list\n"
+                " [-r <policy>[:<prio>]] : fifo, rr or other scheduling\n"
+                " [-F <n>] : number of variable fetch threads\n"
+                " [-w <file>] : render cache checkpoint file\n"
+                " [-p <file>] : process identifier file\n"
+                " [-u] : take over from the instance in the pid file\n"
+                " [-R <n>] : pre-render the n most printed file vars\n"
+                " [-P <n>] : number of worker processes\n"
+                " -f <filename> : configuration file, may be repeated\n",
                 cmdname );
     }
 }
@@ -373,7 +4568,8 @@ static void usage( char *cmdname )
     Process the command line options
 
     The ProcessOptions function processes the command line options and
-    populates the FileVarState object
+    populates the FileVarState object.  Numeric options are checked
+    with ParseNumber, and an invalid value stops the program.
 
     @param[in]
         argC
@@ -395,7 +4591,9 @@ static int ProcessOptions( int argC, char *argV[], FileVarsState *pState )
 {
     int c;
     int result = EINVAL;
-    const char *options = "hvf:";
+    char *pPriority;
+    long pages;
+    const char *options = "hvf:d:s:S:t:T:c:e:l:m:a:r:F:w:p:uR:P:";
 
     if( ( pState != NULL ) &&
         ( argV != NULL ) )
@@ -413,7 +4611,136 @@ static int ProcessOptions( int argC, char *argV[], FileVarsState *pState )
                     break;
 
                 case 'f':
-                    pState->pFileName = strdup(optarg);
+                    AddConfig( pState, optarg );
+                    break;
+
+                case 'd':
+                    pState->debounce = ParseNumber( optarg,
+                                                    "debounce window",
+                                                    10,
+                                                    0,
+                                                    INT_MAX );
+                    break;
+
+                case 's':
+                    pState->pShmName = strdup( optarg );
+                    break;
+
+                case 'S':
+                    pState->slotSize = ParseNumber( optarg,
+                                                    "slot size",
+                                                    0,
+                                                    1,
+                                                    FVSHM_MAX_SLOT_SIZE );
+                    break;
+
+                case 't':
+                    pState->pStoreName = strdup( optarg );
+                    break;
+
+                case 'T':
+                    pState->storeSize = ParseNumber( optarg,
+                                                     "template store size",
+                                                     0,
+                                                     TSTORE_MIN_SIZE,
+                                                     SIZE_MAX );
+                    break;
+
+                case 'c':
+                    pState->pCacheDir = strdup( optarg );
+                    break;
+
+                case 'e':
+                    pState->compileThreads = ParseNumber( optarg,
+                                                          "compile threads",
+                                                          10,
+                                                          1,
+                                                          INT_MAX );
+                    break;
+
+                case 'l':
+                    pState->idleTimeout = ParseNumber( optarg,
+                                                       "idle timeout",
+                                                       10,
+                                                       0,
+                                                       INT_MAX );
+                    break;
+
+                case 'm':
+                    /* the heap budget cannot exceed the physical memory */
+                    pages = sysconf( _SC_PHYS_PAGES );
+                    pState->lockBudget = ParseNumber(
+                        optarg,
+                        "locked heap size",
+                        0,
+                        1,
+                        ( pages > 0 )
+                            ? (unsigned long)pages * sysconf( _SC_PAGESIZE )
+                            : SIZE_MAX );
+                    break;
+
+                case 'a':
+                    pState->pCPUList = strdup( optarg );
+                    break;
+
+                case 'r':
+                    pPriority = strchr( optarg, ':' );
+                    if( pPriority != NULL )
+                    {
+                        *pPriority++ = '\0';
+                    }
+
+                    pState->policy = REALTIME_GetPolicy( optarg );
+                    if( pState->policy < 0 )
+                    {
+                        fprintf( stderr, "invalid policy: %s\n", optarg );
+                        pState->policy = SCHED_OTHER;
+                    }
+                    else if( pPriority != NULL )
+                    {
+                        pState->priority = ParseNumber(
+                            pPriority,
+                            "scheduling priority",
+                            10,
+                            sched_get_priority_min( pState->policy ),
+                            sched_get_priority_max( pState->policy ) );
+                    }
+                    break;
+
+                case 'F':
+                    pState->fetch.nThreads = ParseNumber( optarg,
+                                                          "fetch threads",
+                                                          10,
+                                                          1,
+                                                          INT_MAX );
+                    break;
+
+                case 'w':
+                    pState->pCheckpointName = strdup( optarg );
+                    break;
+
+                case 'p':
+                    pState->pPidFile = strdup( optarg );
+                    break;
+
+                case 'u':
+                    pState->upgrade = true;
+                    break;
+
+                case 'R':
+                    pState->hotCount = ParseNumber( optarg,
+                                                    "pre-render count",
+                                                    10,
+                                                    0,
+                                                    INT_MAX );
+                    break;
+
+                case 'P':
+                    pState->workers = ParseNumber( optarg,
+                                                   "worker count",
+                                                   10,
+                                                   1,
+                                                   INT_MAX );
                     break;
 
                 default:
@@ -427,55 +4754,342 @@ static int ProcessOptions( int argC, char *argV[], FileVarsState *pState )
 }
 
 /*============================================================================*/
-/*  SetupTerminationHandler                                                   */
+/*  ParseNumber                                                               */
 /*!
-    Set up an abnormal termination handler
+    Parse the value of a numeric command line option
 
-    The SetupTerminationHandler function registers a termination handler
-    function with the kernel in case of an abnormal termination of this
-    process.
+    The ParseNumber function converts the value of a numeric command
+    line option, and stops the program with an error message if the
+    value is not a whole number, or is outside the allowed range.
 
-==============================================================================*/
-static void SetupTerminationHandler( void )
+    @param[in]
+        pArg
+            pointer to the option value
+
+    @param[in]
+        pName
+            name of the option used in the error message
+
+    @param[in]
+        base
+            number base passed to strtoul, 0 to also accept octal and
+            hexadecimal values
+
+    @param[in]
+        min
+            smallest allowed value
+
+    @param[in]
+        max
+            largest allowed value
+
+    @retval value of the option
+
+============================================================================*/
+static unsigned long ParseNumber( char *pArg,
+                                  char *pName,
+                                  int base,
+                                  unsigned long min,
+                                  unsigned long max )
+{
+    unsigned long value;
+    char *pEnd;
+
+    errno = 0;
+    value = strtoul( pArg, &pEnd, base );
+
+    /* strtoul accepts negative values and wraps them around */
+    if( ( errno != 0 ) ||
+        ( pEnd == pArg ) ||
+        ( *pEnd != '\0' ) ||
+        ( strchr( pArg, '-' ) != NULL ) ||
+        ( value < min ) ||
+        ( value > max ) )
+    {
+        fprintf( stderr, "filevars: invalid %s: %s\n", pName, pArg );
+        exit( 1 );
+    }
+
+    return value;
+}
+
+/*============================================================================*/
+/*  SetupSharedCache                                                          */
+/*!
+    Set up the shared render cache
+
+    The SetupSharedCache function creates the shared render cache
+    segment with one slot for each cached file variable.  Output is
+    published into a slot whenever its file variable is rendered.
+    When running worker processes, the segment is created by the
+    supervisor and inherited by the workers, which only publish into
+    the slots of the file variables they own.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @retval EOK - the shared render cache was set up
+    @retval EEXIST - the segment is in use by another instance
+    @retval ENOMEM - the shared render cache could not be created
+
+============================================================================*/
+static int SetupSharedCache( FileVarsState *pState )
+{
+    int result = ENOMEM;
+    FileVar *pFileVar;
+    uint32_t n = 0;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        if( pFileVar->cache == true )
+        {
+            n++;
+        }
+    }
+
+    /* only an instance taking over may replace a live segment */
+    pState->pShm = FVSHM_Create( pState->pShmName,
+                                 n,
+                                 pState->slotSize,
+                                 pState->upgrade );
+    if( pState->pShm != NULL )
+    {
+        n = 0;
+        for( pFileVar = pState->pFileVars;
+             pFileVar != NULL;
+             pFileVar = pFileVar->pNext )
+        {
+            if( pFileVar->cache == true )
+            {
+                pFileVar->slot = n++;
+                FVSHM_SetSlotName( pState->pShm,
+                                   pFileVar->slot,
+                                   pFileVar->pName );
+            }
+        }
+
+        result = EOK;
+    }
+    else
+    {
+        result = ( errno == EEXIST ) ? EEXIST : ENOMEM;
+        syslog( LOG_ERR,
+                "filevars: cannot create shared cache %s: %s",
+                pState->pShmName,
+                strerror( result ) );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SetShardCheckpointName                                                    */
+/*!
+    Set the checkpoint file name of a worker process
+
+    The SetShardCheckpointName function appends the worker index to
+    the name of the render cache checkpoint file, so each worker
+    process checkpoints and restores its own shard of the file vars.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void SetShardCheckpointName( FileVarsState *pState )
+{
+    char *pName;
+    size_t len;
+
+    len = strlen( pState->pCheckpointName ) + 12;
+    pName = malloc( len );
+    if( pName != NULL )
+    {
+        snprintf( pName, len, "%s.%d", pState->pCheckpointName, pState->shard );
+        free( pState->pCheckpointName );
+        pState->pCheckpointName = pName;
+    }
+}
+
+/*============================================================================*/
+/*  TakeOver                                                                  */
+/*!
+    Take over the service from a previous instance
+
+    The TakeOver function is called once this instance is serving all
+    of its file variables.  In upgrade mode, the instance named in the
+    pid file is sent SIGUSR2 to hand the service over to this one.
+    The identifier of this process is then written to the pid file.
+
+    Print notifications of the old and new instances overlap until the
+    old instance has cancelled its own, so there is no window in which
+    the file variables are not served.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+    @retval EOK - the service was taken over
+    @retval other error from kill or the pid file
+
+============================================================================*/
+static int TakeOver( FileVarsState *pState )
 {
-    static struct sigaction sigact;
+    int result = EOK;
+    FILE *fp;
+    int pid = 0;
+
+    if( pState->pPidFile != NULL )
+    {
+        if( pState->upgrade == true )
+        {
+            fp = fopen( pState->pPidFile, "r" );
+            if( fp != NULL )
+            {
+                if( fscanf( fp, "%d", &pid ) != 1 )
+                {
+                    pid = 0;
+                }
+
+                fclose( fp );
+            }
 
-    memset( &sigact, 0, sizeof(sigact) );
+            if( ( pid > 0 ) &&
+                ( pid != getpid() ) &&
+                ( kill( pid, SIGUSR2 ) != 0 ) )
+            {
+                result = errno;
+                syslog( LOG_ERR,
+                        "filevars: cannot take over from %d: %s",
+                        pid,
+                        strerror( result ) );
+            }
+        }
+
+        fp = fopen( pState->pPidFile, "w" );
+        if( fp != NULL )
+        {
+            fprintf( fp, "%d\n", getpid() );
+            fclose( fp );
+        }
+        else
+        {
+            result = errno;
+            syslog( LOG_ERR,
+                    "filevars: cannot write %s: %s",
+                    pState->pPidFile,
+                    strerror( result ) );
+        }
+    }
+
+    return result;
+}
 
-    sigact.sa_sigaction = TerminationHandler;
-    sigact.sa_flags = SA_SIGINFO;
+/*============================================================================*/
+/*  WorkersReady                                                              */
+/*!
+    Handle the worker processes becoming ready
 
-    sigaction( SIGTERM, &sigact, NULL );
-    sigaction( SIGINT, &sigact, NULL );
+    The WorkersReady function is called in the supervisor once every
+    worker process is serving its shard, and takes over the service
+    from the previous instance.
 
+============================================================================*/
+static void WorkersReady( void )
+{
+    TakeOver( &state );
 }
 
 /*============================================================================*/
-/*  TerminationHandler                                                        */
+/*  HandOver                                                                  */
 /*!
-    Abnormal termination handler
+    Hand the service over to a new instance
+
+    The HandOver function is called when a new instance has taken over
+    the service.  The print notifications are cancelled, the print
+    requests which were already dispatched to this instance are served
+    until none have arrived for HANDOVER_DRAIN_MS, and the process
+    exits.  The shared render cache is left to the new instance.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+============================================================================*/
+static void HandOver( FileVarsState *pState )
+{
+    FileVar *pFileVar;
+    struct timespec timeout;
+    siginfo_t info;
+    sigset_t printmask;
+
+    for( pFileVar = pState->pFileVars;
+         pFileVar != NULL;
+         pFileVar = pFileVar->pNext )
+    {
+        if( ( pFileVar->registered == true ) &&
+            ( pFileVar->push == false ) )
+        {
+            VAR_NotifyCancel( pState->hVarServer,
+                              pFileVar->hVar,
+                              NOTIFY_PRINT );
+        }
+    }
+
+    /* drain the in-flight print sessions */
+    sigemptyset( &printmask );
+    sigaddset( &printmask, SIG_VAR_PRINT );
+    timeout.tv_sec = HANDOVER_DRAIN_MS / 1000;
+    timeout.tv_nsec = ( HANDOVER_DRAIN_MS % 1000 ) * 1000000L;
+
+    while( sigtimedwait( &printmask, &info, &timeout ) == SIG_VAR_PRINT )
+    {
+        HandlePrint( pState, info.si_value.sival_int );
+    }
+
+    if( pState->pShm != NULL )
+    {
+        /* the new instance owns the shared render cache name */
+        pState->pShm->owner = false;
+    }
+
+    FVSHM_Close( pState->pShm );
+    pState->pShm = NULL;
+
+    if ( VARSERVER_Close( pState->hVarServer ) == EOK )
+    {
+        pState->hVarServer = NULL;
+    }
 
-    The TerminationHandler function will be invoked in case of an abnormal
-    termination of this process.  The termination handler closes
-    the connection with the variable server and cleans up its VARFP shared
-    memory.
+    syslog( LOG_INFO, "filevars: handed over to a new instance" );
 
-@param[in]
-    signum
-        The signal which caused the abnormal termination (unused)
+    exit( 0 );
+}
 
-@param[in]
-    info
-        pointer to a siginfo_t object (unused)
+/*============================================================================*/
+/*  Terminate                                                                 */
+/*!
+    Terminate the process abnormally
 
-@param[in]
-    ptr
-        signal context information (ucontext_t) (unused)
+    The Terminate function stops the worker processes, removes the
+    shared render cache, closes the connection with the variable
+    server and cleans up its VARFP shared memory, and exits with a
+    failure status.
 
 ==============================================================================*/
-static void TerminationHandler( int signum, siginfo_t *info, void *ptr )
+static void Terminate( void )
 {
-    if ( VARSERVER_Close( state.hVarServer ) == EOK )
+    /* stop the worker processes if we are their supervisor */
+    SUPERVISOR_Stop();
+
+    /* remove the shared render cache so clients fall back to printing */
+    FVSHM_Close( state.pShm );
+
+    if( ( state.hVarServer != NULL ) &&
+        ( VARSERVER_Close( state.hVarServer ) == EOK ) )
     {
         state.hVarServer = NULL;
     }
@@ -485,5 +5099,41 @@ static void TerminationHandler( int signum, siginfo_t *info, void *ptr )
     exit( 1 );
 }
 
+/*============================================================================*/
+/*  Shutdown                                                                  */
+/*!
+    Shut the process down in an orderly way
+
+    The Shutdown function is called from the main loop once SIGTERM or
+    SIGINT has been received, after the render cache has been
+    checkpointed.  It stops the worker processes, removes the shared
+    render cache, closes the connection with the variable server, and
+    exits with a success status.
+
+    @param[in]
+       pState
+            pointer to the FileVars state object
+
+==============================================================================*/
+static void Shutdown( FileVarsState *pState )
+{
+    /* stop the worker processes if we are their supervisor */
+    SUPERVISOR_Stop();
+
+    /* remove the shared render cache so clients fall back to printing */
+    FVSHM_Close( pState->pShm );
+    pState->pShm = NULL;
+
+    if( ( pState->hVarServer != NULL ) &&
+        ( VARSERVER_Close( pState->hVarServer ) == EOK ) )
+    {
+        pState->hVarServer = NULL;
+    }
+
+    syslog( LOG_INFO, "filevars: terminated" );
+
+    exit( 0 );
+}
+
 /*! @}
  * end of filevars group */
@@ -0,0 +1,242 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup fvget fvget
+ * @brief Read rendered filevars from the shared render cache
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file fvget.c
+
+    File Variable Get
+
+    The fvget Application reads the rendered output of file variables
+    directly from the filevars shared render cache.  If a file variable
+    is not in the shared render cache, or its cached output is not
+    current, the variable is printed via the variable server instead.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <varserver/varserver.h>
+#include "fvshm.h"
+#include "ctemplate.h"
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static void usage( char *cmdname );
+static int PrintVar( VARSERVER_HANDLE *phVarServer, char *pName );
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*==========================================================================*/
+/*  main                                                                    */
+/*!
+    Main entry point for the fvget application
+
+    The main function reads each variable named on the command line
+    from the shared render cache, falling back to the variable server.
+
+    @param[in]
+        argc
+            number of arguments on the command line
+            (including the command itself)
+
+    @param[in]
+        argv
+            array of pointers to the command line arguments
+
+    @return 0 if all variables were output, 1 otherwise
+
+============================================================================*/
+int main(int argc, char **argv)
+{
+    VARSERVER_HANDLE hVarServer = NULL;
+    char *pShmName = FVSHM_DEFAULT_NAME;
+    FVShm *pShm;
+    char *pBuf = NULL;
+    size_t size = 0;
+    size_t len;
+    int result;
+    int status = 0;
+    int c;
+    int i;
+
+    while( ( c = getopt( argc, argv, "hs:" ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 's':
+                pShmName = optarg;
+                break;
+
+            case 'h':
+            default:
+                usage( argv[0] );
+                exit( 1 );
+                break;
+        }
+    }
+
+    if( optind >= argc )
+    {
+        usage( argv[0] );
+        exit( 1 );
+    }
+
+    pShm = FVSHM_Open( pShmName );
+    if( pShm != NULL )
+    {
+        size = pShm->pHeader->slotSize;
+        pBuf = malloc( size );
+    }
+
+    for( i = optind; i < argc; i++ )
+    {
+        result = ENOENT;
+        if( pBuf != NULL )
+        {
+            result = FVSHM_Read( pShm, argv[i], pBuf, size, &len );
+        }
+
+        if( result == EOK )
+        {
+            result = CTEMPLATE_Write( STDOUT_FILENO, pBuf, len );
+        }
+        else
+        {
+            result = PrintVar( &hVarServer, argv[i] );
+        }
+
+        if( result != EOK )
+        {
+            fprintf( stderr, "fvget: %s: %s\n", argv[i], strerror( result ) );
+            status = 1;
+        }
+    }
+
+    if( hVarServer != NULL )
+    {
+        VARSERVER_Close( hVarServer );
+    }
+
+    FVSHM_Close( pShm );
+    free( pBuf );
+
+    return status;
+}
+
+/*==========================================================================*/
+/*  PrintVar                                                                */
+/*!
+    Print a variable via the variable server
+
+    The PrintVar function prints the named variable to stdout via the
+    variable server.  The variable server connection is opened on
+    first use.
+
+    @param[in,out]
+        phVarServer
+            pointer to the variable server handle
+
+    @param[in]
+        pName
+            name of the variable to print
+
+    @retval EOK - the variable was printed
+    @retval ENOENT - the variable was not found
+    @retval ENOTCONN - the variable server is not available
+
+============================================================================*/
+static int PrintVar( VARSERVER_HANDLE *phVarServer, char *pName )
+{
+    int result = ENOTCONN;
+    VAR_HANDLE hVar;
+
+    if( *phVarServer == NULL )
+    {
+        *phVarServer = VARSERVER_Open();
+    }
+
+    if( *phVarServer != NULL )
+    {
+        hVar = VAR_FindByName( *phVarServer, pName );
+        if( hVar != VAR_INVALID )
+        {
+            result = VAR_Print( *phVarServer, hVar, STDOUT_FILENO );
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*==========================================================================*/
+/*  usage                                                                   */
+/*!
+    Display the application usage
+
+    The usage function dumps the application usage message
+    to stderr.
+
+    @param[in]
+       cmdname
+            pointer to the invoked command name
+
+    @return none
+
+============================================================================*/
+static void usage( char *cmdname )
+{
+    if( cmdname != NULL )
+    {
+        fprintf(stderr,
+                "usage: %s [-h] [-s <name>] <varname> ...\n"
+                " [-h] : display this help\n"
+                " [-s <name>] : shared render cache name\n",
+                cmdname );
+    }
+}
+
+/*! @}
+ * end of fvget group */
@@ -0,0 +1,741 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup fvshm fvshm
+ * @brief Shared memory render cache
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file fvshm.c
+
+    Shared Memory Render Cache
+
+    The Shared Memory Render Cache module publishes rendered file
+    variable output into a POSIX shared memory segment with one
+    sequence locked slot per file variable.  Clients can read the
+    rendered output directly from the segment without sending a
+    print request to the filevars process.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <varserver/varserver.h>
+#include "fvshm.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! slot alignment, to keep slots on separate cache lines */
+#define FVSHM_SLOT_ALIGN    ( 64 )
+
+/*! maximum number of attempts to get a consistent copy of a slot */
+#define FVSHM_READ_RETRIES  ( 100 )
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static FVShmSlot *GetSlot( FVShm *pShm, uint32_t slot );
+static void WriteBegin( FVShmSlot *pSlot );
+static void WriteEnd( FVShmSlot *pSlot );
+static bool InUse( char *pName );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  FVSHM_Create                                                              */
+/*!
+    Create the shared render cache segment
+
+    The FVSHM_Create function creates and maps a new shared render
+    cache segment with the specified number of slots.  An existing
+    segment with the same name is only replaced if the process which
+    owns it is no longer running, or if the replace flag is set
+    because this instance is taking the service over from it.
+
+    @param[in]
+       pName
+            name of the shared memory segment
+
+    @param[in]
+       nSlots
+            number of slots in the segment
+
+    @param[in]
+       slotSize
+            size of the data area of each slot
+
+    @param[in]
+       replace
+            true to replace a segment owned by a running process
+
+    @retval pointer to the shared render cache mapping
+    @retval NULL if the segment could not be created, with errno set
+            to EEXIST if it is owned by a running process
+
+==============================================================================*/
+FVShm *FVSHM_Create( char *pName,
+                     uint32_t nSlots,
+                     uint32_t slotSize,
+                     bool replace )
+{
+    FVShm *pShm = NULL;
+    FVShmHeader *pHeader;
+    uint32_t stride;
+    size_t size;
+    void *p;
+    int fd;
+
+    if( ( pName != NULL ) &&
+        ( replace == false ) &&
+        ( InUse( pName ) == true ) )
+    {
+        /* do not take the segment away from a live instance */
+        errno = EEXIST;
+    }
+    else if( pName != NULL )
+    {
+        stride = sizeof( FVShmSlot ) + slotSize + FVSHM_SLOT_ALIGN - 1;
+        stride &= ~( FVSHM_SLOT_ALIGN - 1 );
+        size = FVSHM_SLOT_ALIGN + (size_t)nSlots * stride;
+
+        shm_unlink( pName );
+        fd = shm_open( pName, O_CREAT | O_EXCL | O_RDWR, 0644 );
+        if( fd >= 0 )
+        {
+            if( ftruncate( fd, size ) == 0 )
+            {
+                p = mmap( NULL,
+                          size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          fd,
+                          0 );
+                if( p != MAP_FAILED )
+                {
+                    pShm = calloc( 1, sizeof( FVShm ) );
+                    if( pShm != NULL )
+                    {
+                        pShm->pName = strdup( pName );
+                        pShm->pHeader = p;
+                        pShm->size = size;
+                        pShm->owner = true;
+
+                        pHeader = pShm->pHeader;
+                        pHeader->version = FVSHM_VERSION;
+                        pHeader->nSlots = nSlots;
+                        pHeader->slotSize = slotSize;
+                        pHeader->stride = stride;
+                        pHeader->pid = getpid();
+
+                        /* the segment is available to clients */
+                        __atomic_store_n( &pHeader->magic,
+                                          FVSHM_MAGIC,
+                                          __ATOMIC_RELEASE );
+                    }
+                    else
+                    {
+                        munmap( p, size );
+                    }
+                }
+            }
+
+            close( fd );
+
+            if( pShm == NULL )
+            {
+                shm_unlink( pName );
+            }
+        }
+    }
+
+    return pShm;
+}
+
+/*============================================================================*/
+/*  FVSHM_SetSlotName                                                         */
+/*!
+    Assign a slot to a file variable
+
+    The FVSHM_SetSlotName function assigns a slot to the named file
+    variable.  Clients do not find the file variable in the shared
+    render cache until its slot has been named and published.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       slot
+            index of the slot to assign
+
+    @param[in]
+       pName
+            name of the file variable
+
+    @retval EOK - the slot was assigned
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int FVSHM_SetSlotName( FVShm *pShm, uint32_t slot, char *pName )
+{
+    int result = EINVAL;
+    FVShmSlot *pSlot;
+
+    pSlot = GetSlot( pShm, slot );
+    if( ( pSlot != NULL ) &&
+        ( pName != NULL ) )
+    {
+        strncpy( pSlot->name, pName, FVSHM_NAME_LEN - 1 );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FVSHM_FindSlot                                                            */
+/*!
+    Find the slot assigned to a file variable
+
+    The FVSHM_FindSlot function searches the shared render cache for
+    the slot which was assigned to the named file variable.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       pName
+            name of the file variable
+
+    @retval index of the slot assigned to the file variable
+    @retval -1 if no slot is assigned to the file variable
+
+==============================================================================*/
+int FVSHM_FindSlot( FVShm *pShm, char *pName )
+{
+    int result = -1;
+    uint32_t i;
+
+    if( ( pShm != NULL ) &&
+        ( pName != NULL ) )
+    {
+        for( i = 0; ( i < pShm->pHeader->nSlots ) && ( result < 0 ); i++ )
+        {
+            if( strncmp( GetSlot( pShm, i )->name,
+                         pName,
+                         FVSHM_NAME_LEN ) == 0 )
+            {
+                result = i;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FVSHM_Publish                                                             */
+/*!
+    Publish rendered output into a slot
+
+    The FVSHM_Publish function copies the rendered output into the
+    specified slot under its sequence lock, and marks the slot valid.
+    Output which does not fit into the slot invalidates the slot so
+    clients fall back to printing the variable.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       slot
+            index of the slot to publish into
+
+    @param[in]
+       pData
+            pointer to the rendered output
+
+    @param[in]
+       len
+            length of the rendered output
+
+    @param[in]
+       hash
+            hash of the rendered output
+
+    @param[in]
+       generation
+            output generation counter
+
+    @retval EOK - the output was published
+    @retval E2BIG - the output does not fit in the slot
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int FVSHM_Publish( FVShm *pShm,
+                   uint32_t slot,
+                   const char *pData,
+                   size_t len,
+                   uint64_t hash,
+                   uint32_t generation )
+{
+    int result = EINVAL;
+    FVShmSlot *pSlot;
+
+    pSlot = GetSlot( pShm, slot );
+    if( pSlot != NULL )
+    {
+        result = ( len <= pShm->pHeader->slotSize ) ? EOK : E2BIG;
+
+        WriteBegin( pSlot );
+
+        if( result == EOK )
+        {
+            memcpy( pSlot->data, pData, len );
+            pSlot->len = len;
+            pSlot->hash = hash;
+            pSlot->generation = generation;
+            pSlot->flags |= FVSHM_SLOT_VALID;
+        }
+        else
+        {
+            pSlot->flags &= ~FVSHM_SLOT_VALID;
+        }
+
+        WriteEnd( pSlot );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FVSHM_Invalidate                                                          */
+/*!
+    Invalidate a slot
+
+    The FVSHM_Invalidate function marks the specified slot as no
+    longer holding current output.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       slot
+            index of the slot to invalidate
+
+    @retval EOK - the slot was invalidated
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int FVSHM_Invalidate( FVShm *pShm, uint32_t slot )
+{
+    int result = EINVAL;
+    FVShmSlot *pSlot;
+
+    pSlot = GetSlot( pShm, slot );
+    if( pSlot != NULL )
+    {
+        WriteBegin( pSlot );
+        pSlot->flags &= ~FVSHM_SLOT_VALID;
+        WriteEnd( pSlot );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FVSHM_Open                                                                */
+/*!
+    Open a shared render cache segment for reading
+
+    The FVSHM_Open function maps an existing shared render cache segment
+    read-only.
+
+    @param[in]
+       pName
+            name of the shared memory segment
+
+    @retval pointer to the shared render cache mapping
+    @retval NULL if the segment is not available
+
+==============================================================================*/
+FVShm *FVSHM_Open( char *pName )
+{
+    FVShm *pShm = NULL;
+    FVShmHeader *pHeader;
+    struct stat sb;
+    uint32_t magic;
+    void *p;
+    int fd;
+
+    if( pName != NULL )
+    {
+        fd = shm_open( pName, O_RDONLY, 0 );
+        if( fd >= 0 )
+        {
+            if( ( fstat( fd, &sb ) == 0 ) &&
+                ( (size_t)sb.st_size >= sizeof( FVShmHeader ) ) )
+            {
+                p = mmap( NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+                if( p != MAP_FAILED )
+                {
+                    pHeader = p;
+                    magic = __atomic_load_n( &pHeader->magic,
+                                             __ATOMIC_ACQUIRE );
+                    if( ( magic == FVSHM_MAGIC ) &&
+                        ( pHeader->version == FVSHM_VERSION ) &&
+                        ( FVSHM_SLOT_ALIGN +
+                          (size_t)pHeader->nSlots * pHeader->stride <=
+                          (size_t)sb.st_size ) )
+                    {
+                        pShm = calloc( 1, sizeof( FVShm ) );
+                    }
+
+                    if( pShm != NULL )
+                    {
+                        pShm->pName = strdup( pName );
+                        pShm->pHeader = pHeader;
+                        pShm->size = sb.st_size;
+                    }
+                    else
+                    {
+                        munmap( p, sb.st_size );
+                    }
+                }
+            }
+
+            close( fd );
+        }
+    }
+
+    return pShm;
+}
+
+/*============================================================================*/
+/*  FVSHM_Read                                                                */
+/*!
+    Read rendered output from the shared render cache
+
+    The FVSHM_Read function looks up the slot for the named file
+    variable and copies its rendered output into the caller's buffer.
+    The copy is retried until a consistent copy is obtained.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       pName
+            name of the file variable to read
+
+    @param[out]
+       pBuf
+            pointer to the buffer to copy the output into
+
+    @param[in]
+       size
+            size of the output buffer
+
+    @param[out]
+       pLen
+            pointer to a location to store the output length
+
+    @retval EOK - the output was read
+    @retval ENOENT - the file variable has no slot
+    @retval ESTALE - the slot does not hold current output
+    @retval E2BIG - the output buffer is too small
+    @retval EAGAIN - a consistent copy could not be obtained
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int FVSHM_Read( FVShm *pShm,
+                char *pName,
+                char *pBuf,
+                size_t size,
+                size_t *pLen )
+{
+    int result = EINVAL;
+    FVShmSlot *pSlot = NULL;
+    uint32_t seq;
+    uint32_t len;
+    uint32_t i;
+    int retries;
+
+    if( ( pShm != NULL ) &&
+        ( pName != NULL ) &&
+        ( pBuf != NULL ) &&
+        ( pLen != NULL ) )
+    {
+        result = ENOENT;
+
+        for( i = 0; i < pShm->pHeader->nSlots; i++ )
+        {
+            pSlot = GetSlot( pShm, i );
+            if( strncmp( pSlot->name, pName, FVSHM_NAME_LEN ) == 0 )
+            {
+                result = EAGAIN;
+                break;
+            }
+        }
+
+        for( retries = 0;
+             ( result == EAGAIN ) && ( retries < FVSHM_READ_RETRIES );
+             retries++ )
+        {
+            seq = __atomic_load_n( &pSlot->seq, __ATOMIC_ACQUIRE );
+            if( seq & 1 )
+            {
+                /* a write is in progress */
+                continue;
+            }
+
+            len = pSlot->len;
+            if( ( pSlot->flags & FVSHM_SLOT_VALID ) == 0 )
+            {
+                result = ESTALE;
+            }
+            else if( len > size )
+            {
+                result = E2BIG;
+            }
+            else if( len <= pShm->pHeader->slotSize )
+            {
+                memcpy( pBuf, pSlot->data, len );
+                *pLen = len;
+                result = EOK;
+            }
+
+            __atomic_thread_fence( __ATOMIC_ACQUIRE );
+            if( __atomic_load_n( &pSlot->seq, __ATOMIC_RELAXED ) != seq )
+            {
+                /* the slot changed while it was being read */
+                result = EAGAIN;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FVSHM_Close                                                               */
+/*!
+    Close a shared render cache mapping
+
+    The FVSHM_Close function unmaps the shared render cache segment.
+    If the calling process owns the segment, all slots are invalidated
+    and the segment is removed so clients fall back to printing.
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+==============================================================================*/
+void FVSHM_Close( FVShm *pShm )
+{
+    uint32_t i;
+
+    if( pShm != NULL )
+    {
+        if( pShm->owner == true )
+        {
+            for( i = 0; i < pShm->pHeader->nSlots; i++ )
+            {
+                FVSHM_Invalidate( pShm, i );
+            }
+
+            shm_unlink( pShm->pName );
+        }
+
+        munmap( pShm->pHeader, pShm->size );
+        free( pShm->pName );
+        free( pShm );
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  InUse                                                                     */
+/*!
+    Check if a shared render cache segment is in use
+
+    The InUse function maps the header of an existing shared render
+    cache segment and checks whether the process which owns it is
+    still running.  A segment which does not exist, is not fully
+    initialized, or whose owner has exited is stale, and may be
+    replaced.
+
+    @param[in]
+       pName
+            name of the shared memory segment
+
+    @retval true - the segment is owned by a running process
+    @retval false - there is no segment, or it is stale
+
+==============================================================================*/
+static bool InUse( char *pName )
+{
+    bool result = false;
+    const FVShmHeader *pHeader;
+    struct stat sb;
+    pid_t pid = 0;
+    void *p;
+    int fd;
+
+    fd = shm_open( pName, O_RDONLY, 0 );
+    if( fd >= 0 )
+    {
+        if( ( fstat( fd, &sb ) == 0 ) &&
+            ( (size_t)sb.st_size >= sizeof( FVShmHeader ) ) )
+        {
+            p = mmap( NULL,
+                      sizeof( FVShmHeader ),
+                      PROT_READ,
+                      MAP_SHARED,
+                      fd,
+                      0 );
+            if( p != MAP_FAILED )
+            {
+                pHeader = p;
+                if( __atomic_load_n( &pHeader->magic,
+                                     __ATOMIC_ACQUIRE ) == FVSHM_MAGIC )
+                {
+                    pid = (pid_t)pHeader->pid;
+                }
+
+                munmap( p, sizeof( FVShmHeader ) );
+            }
+        }
+
+        close( fd );
+    }
+
+    if( ( pid > 0 ) &&
+        ( pid != getpid() ) &&
+        ( ( kill( pid, 0 ) == 0 ) || ( errno == EPERM ) ) )
+    {
+        result = true;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  GetSlot                                                                   */
+/*!
+    Get a pointer to a slot
+
+    @param[in]
+       pShm
+            pointer to the shared render cache mapping
+
+    @param[in]
+       slot
+            index of the slot
+
+    @retval pointer to the slot
+    @retval NULL if the slot index is out of range
+
+==============================================================================*/
+static FVShmSlot *GetSlot( FVShm *pShm, uint32_t slot )
+{
+    FVShmSlot *pSlot = NULL;
+
+    if( ( pShm != NULL ) &&
+        ( slot < pShm->pHeader->nSlots ) )
+    {
+        pSlot = (FVShmSlot *)( (char *)pShm->pHeader +
+                               FVSHM_SLOT_ALIGN +
+                               (size_t)slot * pShm->pHeader->stride );
+    }
+
+    return pSlot;
+}
+
+/*============================================================================*/
+/*  WriteBegin                                                                */
+/*!
+    Begin a slot update
+
+    The WriteBegin function makes the slot sequence number odd to
+    signal to readers that an update is in progress.
+
+    @param[in]
+       pSlot
+            pointer to the slot to update
+
+==============================================================================*/
+static void WriteBegin( FVShmSlot *pSlot )
+{
+    __atomic_store_n( &pSlot->seq, pSlot->seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+/*============================================================================*/
+/*  WriteEnd                                                                  */
+/*!
+    End a slot update
+
+    The WriteEnd function makes the slot sequence number even again
+    once the slot update is complete.
+
+    @param[in]
+       pSlot
+            pointer to the slot to update
+
+==============================================================================*/
+static void WriteEnd( FVShmSlot *pSlot )
+{
+    __atomic_store_n( &pSlot->seq, pSlot->seq + 1, __ATOMIC_RELEASE );
+}
+
+/*! @}
+ * end of fvshm group */
@@ -0,0 +1,268 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup hash hash
+ * @brief Fast content hashing
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file hash.c
+
+    Content Hash
+
+    The Content Hash module provides a fast non-cryptographic 64-bit
+    hash (XXH64) used to detect changes in rendered output and
+    template content.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdint.h>
+#include <string.h>
+#include "hash.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! XXH64 prime constants */
+#define PRIME64_1   ( 0x9E3779B185EBCA87ULL )
+#define PRIME64_2   ( 0xC2B2AE3D27D4EB4FULL )
+#define PRIME64_3   ( 0x165667B19E3779F9ULL )
+#define PRIME64_4   ( 0x85EBCA77C2B2AE63ULL )
+#define PRIME64_5   ( 0x27D4EB2F165667C5ULL )
+
+/*! rotate a 64-bit value left */
+#define ROTL64( x, r )  ( ( (x) << (r) ) | ( (x) >> ( 64 - (r) ) ) )
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static uint64_t Round( uint64_t acc, uint64_t input );
+static uint64_t MergeRound( uint64_t acc, uint64_t val );
+static uint64_t Read64( const uint8_t *p );
+static uint32_t Read32( const uint8_t *p );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  HASH_Compute                                                              */
+/*!
+    Compute the hash of a buffer
+
+    The HASH_Compute function calculates the XXH64 hash of the
+    specified buffer.  Multi-byte words are read in host byte order,
+    so hashes are only comparable between processes on the same host.
+
+    @param[in]
+       pData
+            pointer to the data to hash
+
+    @param[in]
+       len
+            number of bytes to hash
+
+    @param[in]
+       seed
+            hash seed
+
+    @retval the 64-bit hash of the data
+
+==============================================================================*/
+uint64_t HASH_Compute( const void *pData, size_t len, uint64_t seed )
+{
+    const uint8_t *p = (const uint8_t *)pData;
+    const uint8_t *pEnd = p + len;
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    uint64_t v4;
+    uint64_t h;
+
+    if( len >= 32 )
+    {
+        v1 = seed + PRIME64_1 + PRIME64_2;
+        v2 = seed + PRIME64_2;
+        v3 = seed;
+        v4 = seed - PRIME64_1;
+
+        do
+        {
+            v1 = Round( v1, Read64( p ) );
+            v2 = Round( v2, Read64( p + 8 ) );
+            v3 = Round( v3, Read64( p + 16 ) );
+            v4 = Round( v4, Read64( p + 24 ) );
+            p += 32;
+        } while( p + 32 <= pEnd );
+
+        h = ROTL64( v1, 1 ) + ROTL64( v2, 7 ) +
+            ROTL64( v3, 12 ) + ROTL64( v4, 18 );
+        h = MergeRound( h, v1 );
+        h = MergeRound( h, v2 );
+        h = MergeRound( h, v3 );
+        h = MergeRound( h, v4 );
+    }
+    else
+    {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)len;
+
+    while( p + 8 <= pEnd )
+    {
+        h ^= Round( 0, Read64( p ) );
+        h = ROTL64( h, 27 ) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if( p + 4 <= pEnd )
+    {
+        h ^= (uint64_t)Read32( p ) * PRIME64_1;
+        h = ROTL64( h, 23 ) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while( p < pEnd )
+    {
+        h ^= (*p++) * PRIME64_5;
+        h = ROTL64( h, 11 ) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  Round                                                                     */
+/*!
+    Accumulate one 64-bit lane
+
+    @param[in]
+       acc
+            lane accumulator
+
+    @param[in]
+       input
+            input word
+
+    @retval updated lane accumulator
+
+==============================================================================*/
+static uint64_t Round( uint64_t acc, uint64_t input )
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64( acc, 31 );
+    acc *= PRIME64_1;
+
+    return acc;
+}
+
+/*============================================================================*/
+/*  MergeRound                                                                */
+/*!
+    Merge a lane accumulator into the hash
+
+    @param[in]
+       acc
+            hash accumulator
+
+    @param[in]
+       val
+            lane accumulator to merge
+
+    @retval updated hash accumulator
+
+==============================================================================*/
+static uint64_t MergeRound( uint64_t acc, uint64_t val )
+{
+    acc ^= Round( 0, val );
+    acc = acc * PRIME64_1 + PRIME64_4;
+
+    return acc;
+}
+
+/*============================================================================*/
+/*  Read64                                                                    */
+/*!
+    Read an unaligned 64-bit word
+
+    @param[in]
+       p
+            pointer to the word to read
+
+    @retval the 64-bit word
+
+==============================================================================*/
+static uint64_t Read64( const uint8_t *p )
+{
+    uint64_t val;
+
+    memcpy( &val, p, sizeof( val ) );
+
+    return val;
+}
+
+/*============================================================================*/
+/*  Read32                                                                    */
+/*!
+    Read an unaligned 32-bit word
+
+    @param[in]
+       p
+            pointer to the word to read
+
+    @retval the 32-bit word
+
+==============================================================================*/
+static uint32_t Read32( const uint8_t *p )
+{
+    uint32_t val;
+
+    memcpy( &val, p, sizeof( val ) );
+
+    return val;
+}
+
+/*! @}
+ * end of hash group */
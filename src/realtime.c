@@ -0,0 +1,523 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup realtime realtime
+ * @brief Deterministic latency support
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file realtime.c
+
+    Deterministic Latency Support
+
+    The Deterministic Latency Support module locks the address space of
+    the process into memory and prefaults its stacks, heap arena and
+    mapped templates, so rendering never waits for a page fault once
+    the process has warmed up.  It also pins threads to CPUs and sets
+    their realtime scheduling policy, so they are not delayed by other
+    work on a partitioned multicore system.
+
+    The heap arena is grown to the requested size and never trimmed,
+    and large allocations are served from the arena rather than from
+    fresh mappings, so allocations made after startup re-use memory
+    which is already resident.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <varserver/varserver.h>
+#include "realtime.h"
+
+/*============================================================================
+        Private file scoped variables
+============================================================================*/
+
+/*! CPUs which the process could run on before it was pinned */
+static cpu_set_t allowed;
+
+/*! flag to indicate that the CPUs allowed before pinning were saved */
+static bool saved = false;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static int ParseCPUList( char *pCPUList, cpu_set_t *pCPUs );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  REALTIME_LimitArenas                                                      */
+/*!
+    Serve every thread from the main heap arena
+
+    The REALTIME_LimitArenas function stops the allocator from creating
+    a separate heap arena for each thread, so the allocations of the
+    fetch and compile threads are served from the main arena which
+    REALTIME_LockMemory prefaults.  It must be called before any thread
+    is created.
+
+==============================================================================*/
+void REALTIME_LimitArenas( void )
+{
+    mallopt( M_ARENA_MAX, 1 );
+}
+
+/*============================================================================*/
+/*  REALTIME_LockMemory                                                       */
+/*!
+    Lock the process memory
+
+    The REALTIME_LockMemory function locks all current and future
+    mappings of the calling process into memory, prefaults the stack
+    of the calling thread, and grows the heap arena by the specified
+    number of bytes so later allocations are served from resident
+    memory.  Memory locks are not inherited across fork(), so each
+    worker process must lock its own memory.
+
+    @param[in]
+       heapSize
+            number of bytes of heap arena to prefault
+
+    @retval EOK - the process memory is locked
+    @retval ENOMEM - the heap arena could not be grown
+    @retval other error from mlockall
+
+==============================================================================*/
+int REALTIME_LockMemory( size_t heapSize )
+{
+    int result = EOK;
+    char *p;
+
+    /* keep freed memory in the arena, and serve large allocations
+       from the arena instead of from new mappings */
+    mallopt( M_TRIM_THRESHOLD, -1 );
+    mallopt( M_MMAP_MAX, 0 );
+
+    if( mlockall( MCL_CURRENT | MCL_FUTURE ) != 0 )
+    {
+        result = errno;
+    }
+    else
+    {
+        REALTIME_PrefaultStack();
+
+        if( heapSize > 0 )
+        {
+            p = malloc( heapSize );
+            if( p != NULL )
+            {
+                memset( p, 0, heapSize );
+                free( p );
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REALTIME_PrefaultStack                                                    */
+/*!
+    Prefault the stack of the calling thread
+
+    The REALTIME_PrefaultStack function writes REALTIME_STACK_SIZE bytes
+    below the current stack frame of the calling thread, so the stack
+    pages are resident and locked before they are needed.
+
+==============================================================================*/
+void __attribute__((noinline)) REALTIME_PrefaultStack( void )
+{
+    volatile char stack[REALTIME_STACK_SIZE];
+    size_t i;
+    long pageSize = sysconf( _SC_PAGESIZE );
+
+    for( i = 0; i < sizeof( stack ); i += pageSize )
+    {
+        stack[i] = 0;
+    }
+}
+
+/*============================================================================*/
+/*  REALTIME_Touch                                                            */
+/*!
+    Touch every page of a memory region
+
+    The REALTIME_Touch function reads one byte from every page of the
+    specified memory region, so pages which are mapped but not yet
+    resident are faulted in.
+
+    @param[in]
+       p
+            pointer to the memory region
+
+    @param[in]
+       len
+            length of the memory region
+
+    @retval number of bytes in the pages spanned by the region
+
+==============================================================================*/
+size_t REALTIME_Touch( const void *p, size_t len )
+{
+    const volatile char *pStart;
+    const volatile char *pEnd;
+    uintptr_t pageSize = sysconf( _SC_PAGESIZE );
+    size_t n = 0;
+
+    if( ( p != NULL ) &&
+        ( len > 0 ) )
+    {
+        pStart = (const volatile char *)( (uintptr_t)p & ~( pageSize - 1 ) );
+        pEnd = (const volatile char *)p + len;
+
+        while( pStart < pEnd )
+        {
+            (void)*pStart;
+            pStart += pageSize;
+            n += pageSize;
+        }
+    }
+
+    return n;
+}
+
+/*============================================================================*/
+/*  REALTIME_GetCPU                                                           */
+/*!
+    Get a CPU from a CPU list
+
+    The REALTIME_GetCPU function gets the CPU at the specified index of
+    a CPU list such as "2,3" or "4-7,10".  The index wraps around the
+    end of the list, so a short list can be shared by many workers.
+
+    @param[in]
+       pCPUList
+            pointer to the CPU list
+
+    @param[in]
+       index
+            index of the CPU in the CPU list
+
+    @retval CPU number
+    @retval -1 if the CPU list is empty or invalid
+
+==============================================================================*/
+int REALTIME_GetCPU( char *pCPUList, int index )
+{
+    int cpu = -1;
+    int n = 0;
+    int pass;
+    long first;
+    long last;
+    char *p;
+
+    /* the first pass counts the CPUs, and the second pass finds one */
+    for( pass = 0; ( pass < 2 ) && ( pCPUList != NULL ); pass++ )
+    {
+        if( pass == 1 )
+        {
+            if( n == 0 )
+            {
+                break;
+            }
+
+            index %= n;
+            n = 0;
+        }
+
+        p = pCPUList;
+        while( *p != '\0' )
+        {
+            first = strtol( p, &p, 10 );
+            last = ( *p == '-' ) ? strtol( p + 1, &p, 10 ) : first;
+            if( ( first < 0 ) ||
+                ( last < first ) ||
+                ( ( *p != ',' ) && ( *p != '\0' ) ) )
+            {
+                /* invalid CPU list */
+                n = 0;
+                break;
+            }
+
+            if( ( pass == 1 ) &&
+                ( index < n + ( last - first + 1 ) ) )
+            {
+                cpu = first + ( index - n );
+                break;
+            }
+
+            n += last - first + 1;
+            p += ( *p == ',' ) ? 1 : 0;
+        }
+    }
+
+    return cpu;
+}
+
+/*============================================================================*/
+/*  REALTIME_SetAffinity                                                      */
+/*!
+    Pin the calling thread to a CPU
+
+    The REALTIME_SetAffinity function restricts the calling thread to
+    run on the specified CPU.  Threads created by the calling thread
+    afterwards inherit its CPU affinity, unless they call
+    REALTIME_SetAffinityList.  The CPUs which the process could run on
+    before it was first pinned are remembered for
+    REALTIME_SetAffinityList.
+
+    @param[in]
+       cpu
+            CPU to run on
+
+    @retval EOK - the CPU affinity was set
+    @retval EINVAL - invalid CPU
+    @retval other error from pthread_setaffinity_np
+
+==============================================================================*/
+int REALTIME_SetAffinity( int cpu )
+{
+    int result = EINVAL;
+    cpu_set_t cpus;
+
+    if( ( cpu >= 0 ) &&
+        ( cpu < CPU_SETSIZE ) )
+    {
+        if( saved == false )
+        {
+            saved = ( sched_getaffinity( 0,
+                                         sizeof( allowed ),
+                                         &allowed ) == 0 );
+        }
+
+        CPU_ZERO( &cpus );
+        CPU_SET( cpu, &cpus );
+        result = pthread_setaffinity_np( pthread_self(),
+                                         sizeof( cpus ),
+                                         &cpus );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REALTIME_SetAffinityList                                                  */
+/*!
+    Let the calling thread run on a list of CPUs
+
+    The REALTIME_SetAffinityList function lets the calling thread run
+    on any CPU in a CPU list such as "2,3" or "4-7,10".  Without a CPU
+    list, the calling thread may run on any CPU which the process could
+    run on before it was pinned with REALTIME_SetAffinity, and is left
+    unchanged if the process was never pinned.  It is called by threads
+    which must not share the CPU of the thread which created them.
+
+    @param[in]
+       pCPUList
+            pointer to the CPU list, or NULL
+
+    @retval EOK - the CPU affinity was set
+    @retval EINVAL - invalid CPU list
+    @retval other error from pthread_setaffinity_np
+
+==============================================================================*/
+int REALTIME_SetAffinityList( char *pCPUList )
+{
+    int result = EOK;
+    cpu_set_t cpus = allowed;
+
+    if( pCPUList != NULL )
+    {
+        result = ParseCPUList( pCPUList, &cpus );
+    }
+
+    /* a thread of a process which was never pinned is left alone */
+    if( ( result == EOK ) &&
+        ( ( pCPUList != NULL ) || ( saved == true ) ) )
+    {
+        result = pthread_setaffinity_np( pthread_self(),
+                                         sizeof( cpus ),
+                                         &cpus );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  REALTIME_GetPolicy                                                        */
+/*!
+    Get a scheduling policy by name
+
+    The REALTIME_GetPolicy function gets the scheduling policy with the
+    specified name, which is one of "fifo", "rr" or "other".
+
+    @param[in]
+       pName
+            name of the scheduling policy
+
+    @retval SCHED_FIFO, SCHED_RR or SCHED_OTHER
+    @retval -1 if the scheduling policy name is not known
+
+==============================================================================*/
+int REALTIME_GetPolicy( char *pName )
+{
+    int policy = -1;
+
+    if( pName != NULL )
+    {
+        if( strcmp( pName, "fifo" ) == 0 )
+        {
+            policy = SCHED_FIFO;
+        }
+        else if( strcmp( pName, "rr" ) == 0 )
+        {
+            policy = SCHED_RR;
+        }
+        else if( strcmp( pName, "other" ) == 0 )
+        {
+            policy = SCHED_OTHER;
+        }
+    }
+
+    return policy;
+}
+
+/*============================================================================*/
+/*  REALTIME_SetScheduler                                                     */
+/*!
+    Set the scheduling policy of the calling thread
+
+    The REALTIME_SetScheduler function sets the scheduling policy and
+    priority of the calling thread.  Threads created by the calling
+    thread afterwards inherit its scheduling policy and priority.
+    The realtime policies require the CAP_SYS_NICE capability or a
+    sufficient RLIMIT_RTPRIO limit.
+
+    @param[in]
+       policy
+            SCHED_FIFO, SCHED_RR or SCHED_OTHER
+
+    @param[in]
+       priority
+            scheduling priority, which must be 0 for SCHED_OTHER
+
+    @retval EOK - the scheduling policy was set
+    @retval other error from pthread_setschedparam
+
+==============================================================================*/
+int REALTIME_SetScheduler( int policy, int priority )
+{
+    struct sched_param param;
+
+    memset( &param, 0, sizeof( param ) );
+    param.sched_priority = priority;
+
+    return pthread_setschedparam( pthread_self(), policy, &param );
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  ParseCPUList                                                              */
+/*!
+    Convert a CPU list to a CPU set
+
+    The ParseCPUList function adds every CPU in a CPU list such as "2,3"
+    or "4-7,10" to a CPU set.
+
+    @param[in]
+       pCPUList
+            pointer to the CPU list
+
+    @param[out]
+       pCPUs
+            pointer to the CPU set to fill in
+
+    @retval EOK - the CPU list was converted
+    @retval EINVAL - the CPU list is empty or invalid
+
+==============================================================================*/
+static int ParseCPUList( char *pCPUList, cpu_set_t *pCPUs )
+{
+    int result = EINVAL;
+    long first;
+    long last;
+    char *p = pCPUList;
+
+    CPU_ZERO( pCPUs );
+
+    while( *p != '\0' )
+    {
+        first = strtol( p, &p, 10 );
+        last = ( *p == '-' ) ? strtol( p + 1, &p, 10 ) : first;
+        if( ( first < 0 ) ||
+            ( last < first ) ||
+            ( last >= CPU_SETSIZE ) ||
+            ( ( *p != ',' ) && ( *p != '\0' ) ) )
+        {
+            result = EINVAL;
+            break;
+        }
+
+        while( first <= last )
+        {
+            CPU_SET( first++, pCPUs );
+        }
+
+        result = EOK;
+        p += ( *p == ',' ) ? 1 : 0;
+    }
+
+    return result;
+}
+
+/*! @}
+ * end of realtime group */
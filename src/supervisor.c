@@ -0,0 +1,530 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+
+/*!
+ * @defgroup supervisor supervisor
+ * @brief Worker process supervisor
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file supervisor.c
+
+    Worker Process Supervisor
+
+    The Worker Process Supervisor forks a fixed number of worker
+    processes and restarts any worker which exits.  Each worker is
+    identified by its worker index, which it keeps across restarts.
+    SIGHUP and SIGUSR2 received by the supervisor are forwarded to the
+    workers.  SIGUSR2 hands the service over to a new instance, so the
+    workers are not restarted once it has been received.  SIGTERM and
+    SIGINT stop the workers, and the supervisor returns once all of
+    them have exited.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <varserver/varserver.h>
+#include "supervisor.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! minimum worker run time in seconds before it is restarted immediately */
+#define SUPERVISOR_MIN_UPTIME   ( 1 )
+
+/*! worker process */
+typedef struct worker
+{
+    /*! worker process identifier, or 0 if the worker is not running */
+    pid_t pid;
+
+    /*! time the worker was started */
+    time_t started;
+
+} Worker;
+
+/*============================================================================
+        Private file scoped variables
+============================================================================*/
+
+/*! array of worker processes */
+static Worker *workers = NULL;
+
+/*! number of worker processes */
+static int nWorkers = 0;
+
+/*! flags set by the workers once they are ready, shared with the workers
+    because concurrent SIGUSR1 notifications are merged into one */
+static volatile bool *ready = NULL;
+
+/*! index of this worker process, or -1 in the supervisor */
+static int workerIndex = -1;
+
+/*! signal mask of the caller, which is restored in the workers */
+static sigset_t workerMask;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static pid_t StartWorker( int idx );
+static int HandleExits( bool draining );
+static int FindWorker( pid_t pid );
+static void ForwardSignal( int signum );
+static bool AllReady( void );
+static int Running( void );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  SUPERVISOR_Run                                                            */
+/*!
+    Run the worker process supervisor
+
+    The SUPERVISOR_Run function forks the requested number of worker
+    processes, and then waits for workers to exit and restarts them.
+    The function only returns in the worker processes, and in the
+    supervisor if the workers cannot be started, have exited after
+    handing the service over, or have been stopped by SIGTERM or
+    SIGINT.  Workers are sent SIGTERM if the supervisor dies.
+
+    The workers are expected to have SIGHUP, SIGUSR2, SIGTERM and
+    SIGINT blocked, and the supervisor forwards those signals to them.
+    The ready callback is invoked once, when every worker has called
+    SUPERVISOR_Ready.
+
+    @param[in]
+       n
+            number of worker processes to run
+
+    @param[in]
+       pfnReady
+            pointer to the function to call when all workers are ready,
+            or NULL
+
+    @retval index of the worker, in the worker process
+    @retval SUPERVISOR_FAILED if the worker processes could not be started
+    @retval SUPERVISOR_HANDED_OVER if the workers handed over and exited
+    @retval SUPERVISOR_STOPPED if the workers were stopped and exited
+
+==============================================================================*/
+int SUPERVISOR_Run( int n, void (*pfnReady)( void ) )
+{
+    int result = SUPERVISOR_FAILED;
+    bool draining = false;
+    bool stopping = false;
+    bool notified = false;
+    siginfo_t info;
+    sigset_t sigset;
+    int sig;
+    int i;
+
+    workers = calloc( n, sizeof( Worker ) );
+    ready = mmap( NULL,
+                  n * sizeof( bool ),
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS,
+                  -1,
+                  0 );
+    if( ready == MAP_FAILED )
+    {
+        ready = NULL;
+    }
+
+    if( ( workers != NULL ) &&
+        ( ready != NULL ) )
+    {
+        nWorkers = n;
+
+        /* the supervisor waits for its signals synchronously */
+        sigemptyset( &sigset );
+        sigaddset( &sigset, SIGCHLD );
+        sigaddset( &sigset, SIGHUP );
+        sigaddset( &sigset, SIGUSR1 );
+        sigaddset( &sigset, SIGUSR2 );
+        sigaddset( &sigset, SIGTERM );
+        sigaddset( &sigset, SIGINT );
+        sigprocmask( SIG_BLOCK, &sigset, &workerMask );
+
+        for( i = 0; ( i < n ) && ( result < 0 ); i++ )
+        {
+            if( StartWorker( i ) == 0 )
+            {
+                result = i;
+            }
+        }
+
+        while( ( result < 0 ) && ( Running() > 0 ) )
+        {
+            sig = sigwaitinfo( &sigset, &info );
+            if( sig == SIGCHLD )
+            {
+                result = HandleExits( draining || stopping );
+            }
+            else if( sig == SIGUSR1 )
+            {
+                if( ( notified == false ) && ( AllReady() == true ) )
+                {
+                    notified = true;
+                    if( pfnReady != NULL )
+                    {
+                        pfnReady();
+                    }
+                }
+            }
+            else if( ( sig == SIGHUP ) || ( sig == SIGUSR2 ) )
+            {
+                if( sig == SIGUSR2 )
+                {
+                    /* the workers hand over to a new instance and exit */
+                    draining = true;
+                }
+
+                ForwardSignal( sig );
+            }
+            else if( ( sig == SIGTERM ) || ( sig == SIGINT ) )
+            {
+                /* the workers checkpoint and exit, and are not restarted */
+                stopping = true;
+                ForwardSignal( SIGTERM );
+            }
+            else if( ( sig < 0 ) && ( errno != EINTR ) )
+            {
+                break;
+            }
+        }
+
+        if( ( result < 0 ) && ( stopping == true ) )
+        {
+            result = SUPERVISOR_STOPPED;
+        }
+        else if( ( result < 0 ) && ( draining == true ) )
+        {
+            result = SUPERVISOR_HANDED_OVER;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  SUPERVISOR_Ready                                                          */
+/*!
+    Report that a worker is ready
+
+    The SUPERVISOR_Ready function is called by a worker process once
+    it is serving its shard, and notifies the supervisor with SIGUSR1.
+    It does nothing if this process is not a worker process.
+
+==============================================================================*/
+void SUPERVISOR_Ready( void )
+{
+    if( workerIndex >= 0 )
+    {
+        __atomic_store_n( &ready[workerIndex], true, __ATOMIC_RELEASE );
+        kill( getppid(), SIGUSR1 );
+    }
+}
+
+/*============================================================================*/
+/*  SUPERVISOR_Stop                                                           */
+/*!
+    Stop the worker processes
+
+    The SUPERVISOR_Stop function sends SIGTERM to all of the worker
+    processes.  It is called from the main loop once a termination
+    signal has been received synchronously, and does nothing in a
+    worker process.
+
+==============================================================================*/
+void SUPERVISOR_Stop( void )
+{
+    int n = nWorkers;
+    int i;
+
+    nWorkers = 0;
+
+    for( i = 0; ( workers != NULL ) && ( i < n ); i++ )
+    {
+        if( workers[i].pid > 0 )
+        {
+            kill( workers[i].pid, SIGTERM );
+        }
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  StartWorker                                                               */
+/*!
+    Start a worker process
+
+    The StartWorker function forks a worker process for the specified
+    worker index.
+
+    @param[in]
+       idx
+            index of the worker to start
+
+    @retval 0 in the worker process
+    @retval process identifier of the worker, in the supervisor
+    @retval -1 if the worker could not be forked
+
+==============================================================================*/
+static pid_t StartWorker( int idx )
+{
+    pid_t pid;
+
+    ready[idx] = false;
+
+    pid = fork();
+    if( pid == 0 )
+    {
+        /* the worker does not supervise anything */
+        nWorkers = 0;
+        free( workers );
+        workers = NULL;
+        workerIndex = idx;
+
+        /* restore the signal mask the caller set up */
+        sigprocmask( SIG_SETMASK, &workerMask, NULL );
+
+        /* terminate the worker if the supervisor dies */
+        prctl( PR_SET_PDEATHSIG, SIGTERM );
+    }
+    else
+    {
+        workers[idx].pid = ( pid > 0 ) ? pid : 0;
+        workers[idx].started = time( NULL );
+
+        if( pid < 0 )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot start worker %d: %s",
+                    idx,
+                    strerror( errno ) );
+        }
+    }
+
+    return pid;
+}
+
+/*============================================================================*/
+/*  HandleExits                                                               */
+/*!
+    Handle worker process exits
+
+    The HandleExits function reaps every worker process which has
+    exited, and restarts it unless the workers are handing over to
+    a new instance.
+
+    @param[in]
+       draining
+            true if the workers are handing over to a new instance
+
+    @retval index of the worker, in a restarted worker process
+    @retval -1 in the supervisor
+
+==============================================================================*/
+static int HandleExits( bool draining )
+{
+    int result = -1;
+    int status;
+    pid_t pid;
+    int i;
+
+    while( ( result < 0 ) &&
+           ( ( pid = waitpid( -1, &status, WNOHANG ) ) > 0 ) )
+    {
+        i = FindWorker( pid );
+        if( i >= 0 )
+        {
+            syslog( LOG_ERR,
+                    "filevars: worker %d (pid %d) exited (%d)",
+                    i,
+                    pid,
+                    status );
+
+            workers[i].pid = 0;
+
+            if( draining == false )
+            {
+                if( time( NULL ) - workers[i].started <
+                    SUPERVISOR_MIN_UPTIME )
+                {
+                    /* don't spin on a worker which fails at startup */
+                    sleep( SUPERVISOR_MIN_UPTIME );
+                }
+
+                if( StartWorker( i ) == 0 )
+                {
+                    result = i;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  FindWorker                                                                */
+/*!
+    Find a worker process
+
+    The FindWorker function gets the index of the worker process with
+    the specified process identifier.
+
+    @param[in]
+       pid
+            process identifier of the worker
+
+    @retval index of the worker
+    @retval -1 if the process is not a worker
+
+==============================================================================*/
+static int FindWorker( pid_t pid )
+{
+    int result = -1;
+    int i;
+
+    for( i = 0; ( i < nWorkers ) && ( result < 0 ); i++ )
+    {
+        if( ( pid > 0 ) && ( workers[i].pid == pid ) )
+        {
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ForwardSignal                                                             */
+/*!
+    Forward a signal to the worker processes
+
+    The ForwardSignal function sends the specified signal on to every
+    running worker process.
+
+    @param[in]
+       signum
+            the signal to forward
+
+==============================================================================*/
+static void ForwardSignal( int signum )
+{
+    int i;
+
+    for( i = 0; ( workers != NULL ) && ( i < nWorkers ); i++ )
+    {
+        if( workers[i].pid > 0 )
+        {
+            kill( workers[i].pid, signum );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  AllReady                                                                  */
+/*!
+    Check whether all workers are ready
+
+    The AllReady function checks whether every worker process has
+    reported that it is ready.
+
+    @retval true if all of the workers are ready
+    @retval false if one or more workers are not ready
+
+==============================================================================*/
+static bool AllReady( void )
+{
+    bool result = true;
+    int i;
+
+    for( i = 0; i < nWorkers; i++ )
+    {
+        if( __atomic_load_n( &ready[i], __ATOMIC_ACQUIRE ) == false )
+        {
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  Running                                                                   */
+/*!
+    Count the running workers
+
+    The Running function counts the worker processes which are running.
+
+    @retval number of running worker processes
+
+==============================================================================*/
+static int Running( void )
+{
+    int n = 0;
+    int i;
+
+    for( i = 0; i < nWorkers; i++ )
+    {
+        if( workers[i].pid > 0 )
+        {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/*! @}
+ * end of supervisor group */
@@ -0,0 +1,332 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup tcache tcache
+ * @brief Persistent compiled template cache
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file tcache.c
+
+    Persistent Compiled Template Cache
+
+    The Persistent Compiled Template Cache module keeps serialized
+    compiled templates in a cache directory, so templates compiled by
+    a previous run are loaded with mmap() instead of being parsed
+    again.  Cache files are named after the hash of the template
+    content and the compiled template version, so a modified template
+    or a change to the compiled template representation never loads
+    a stale image.  Serialized images hold the names of the referenced
+    variables rather than their handles, which are resolved at run time.
+
+    Cache files are written to a temporary file and renamed into place,
+    so a cache file is always complete, and concurrent instances can
+    safely share the cache directory.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <varserver/varserver.h>
+#include "tcache.h"
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static char *GetPath( char *pDir, uint64_t contentHash );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  TCACHE_Map                                                                */
+/*!
+    Map a compiled template from the cache directory
+
+    The TCACHE_Map function maps the cache file for the template with
+    the specified content hash read-only into memory.  The returned
+    image must remain mapped for the lifetime of any compiled template
+    loaded from it, and is released with TCACHE_Unmap.
+
+    @param[in]
+       pDir
+            name of the cache directory
+
+    @param[in]
+       contentHash
+            hash of the template file content
+
+    @param[out]
+       pLen
+            pointer to a location to store the length of the image
+
+    @retval pointer to the read-only serialized template image
+    @retval NULL if the template is not in the cache
+
+==============================================================================*/
+const CTemplateImage *TCACHE_Map( char *pDir,
+                                  uint64_t contentHash,
+                                  size_t *pLen )
+{
+    const CTemplateImage *pImage = NULL;
+    struct stat sb;
+    char *pPath;
+    void *p;
+    int fd;
+
+    pPath = GetPath( pDir, contentHash );
+    if( ( pPath != NULL ) &&
+        ( pLen != NULL ) )
+    {
+        fd = open( pPath, O_RDONLY | O_CLOEXEC );
+        if( fd >= 0 )
+        {
+            if( ( fstat( fd, &sb ) == 0 ) &&
+                ( (size_t)sb.st_size >= sizeof( CTemplateImage ) ) )
+            {
+                p = mmap( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if( p != MAP_FAILED )
+                {
+                    pImage = p;
+                    if( ( pImage->magic != CTEMPLATE_MAGIC ) ||
+                        ( pImage->version != CTEMPLATE_VERSION ) ||
+                        ( pImage->contentHash != contentHash ) ||
+                        ( (size_t)sb.st_size <
+                          sizeof( CTemplateImage ) +
+                          (size_t)pImage->nSegments *
+                          sizeof( CTemplateImageSegment ) +
+                          pImage->textLen ) )
+                    {
+                        syslog( LOG_ERR,
+                                "filevars: invalid template cache file %s",
+                                pPath );
+                        munmap( p, sb.st_size );
+                        pImage = NULL;
+                    }
+                    else
+                    {
+                        *pLen = sb.st_size;
+                    }
+                }
+            }
+
+            close( fd );
+        }
+    }
+
+    free( pPath );
+
+    return pImage;
+}
+
+/*============================================================================*/
+/*  TCACHE_Save                                                               */
+/*!
+    Save a compiled template to the cache directory
+
+    The TCACHE_Save function writes a serialized compiled template into
+    the cache directory, under the name derived from its content hash.
+    The image is written to a temporary file which is then renamed
+    over the cache file, so readers never map a partial image.
+
+    @param[in]
+       pDir
+            name of the cache directory
+
+    @param[in]
+       pImage
+            pointer to the serialized template image
+
+    @param[in]
+       len
+            length of the serialized template image
+
+    @retval EOK - the compiled template was saved
+    @retval EINVAL - invalid arguments
+    @retval ENOMEM - memory allocation failure
+    @retval other error from mkstemp, write or rename
+
+==============================================================================*/
+int TCACHE_Save( char *pDir, const CTemplateImage *pImage, size_t len )
+{
+    int result = EINVAL;
+    char *pPath = NULL;
+    char *pTempName = NULL;
+    size_t n;
+    int fd;
+
+    if( pImage != NULL )
+    {
+        result = ENOMEM;
+        pPath = GetPath( pDir, pImage->contentHash );
+    }
+
+    if( pPath != NULL )
+    {
+        n = strlen( pPath ) + sizeof( ".XXXXXX" );
+        pTempName = malloc( n );
+    }
+
+    if( pTempName != NULL )
+    {
+        snprintf( pTempName, n, "%s.XXXXXX", pPath );
+
+        fd = mkstemp( pTempName );
+        if( fd >= 0 )
+        {
+            fchmod( fd, 0644 );
+
+            result = CTEMPLATE_Write( fd, (const char *)pImage, len );
+            close( fd );
+
+            if( ( result == EOK ) &&
+                ( rename( pTempName, pPath ) != 0 ) )
+            {
+                result = errno;
+            }
+
+            if( result != EOK )
+            {
+                unlink( pTempName );
+            }
+        }
+        else
+        {
+            result = errno;
+        }
+
+        if( result != EOK )
+        {
+            syslog( LOG_ERR,
+                    "filevars: cannot write %s: %s",
+                    pPath,
+                    strerror( result ) );
+        }
+    }
+
+    free( pTempName );
+    free( pPath );
+
+    return result;
+}
+
+/*============================================================================*/
+/*  TCACHE_Unmap                                                              */
+/*!
+    Unmap a compiled template image
+
+    The TCACHE_Unmap function releases an image mapped by TCACHE_Map.
+
+    @param[in]
+       pImage
+            pointer to the serialized template image
+
+    @param[in]
+       len
+            length of the serialized template image
+
+==============================================================================*/
+void TCACHE_Unmap( const CTemplateImage *pImage, size_t len )
+{
+    if( pImage != NULL )
+    {
+        munmap( (void *)pImage, len );
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  GetPath                                                                   */
+/*!
+    Get the path of a cache file
+
+    The GetPath function builds the path of the cache file for the
+    template with the specified content hash.  The path includes the
+    compiled template version, so images written by a different
+    version of the template compiler are never loaded.
+
+    @param[in]
+       pDir
+            name of the cache directory
+
+    @param[in]
+       contentHash
+            hash of the template file content
+
+    @retval pointer to the cache file path allocated on the heap
+    @retval NULL if the path could not be allocated
+
+==============================================================================*/
+static char *GetPath( char *pDir, uint64_t contentHash )
+{
+    char *pPath = NULL;
+    int len;
+
+    if( pDir != NULL )
+    {
+        len = snprintf( NULL,
+                        0,
+                        "%s/%016" PRIx64 "-%d" TCACHE_SUFFIX,
+                        pDir,
+                        contentHash,
+                        CTEMPLATE_VERSION );
+
+        pPath = malloc( len + 1 );
+        if( pPath != NULL )
+        {
+            snprintf( pPath,
+                      len + 1,
+                      "%s/%016" PRIx64 "-%d" TCACHE_SUFFIX,
+                      pDir,
+                      contentHash,
+                      CTEMPLATE_VERSION );
+        }
+    }
+
+    return pPath;
+}
+
+/*! @}
+ * end of tcache group */
@@ -0,0 +1,514 @@
+/*============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*!
+ * @defgroup tstore tstore
+ * @brief Shared template store
+ * @{
+ */
+
+/*==========================================================================*/
+/*!
+@file tstore.c
+
+    Shared Template Store
+
+    The Shared Template Store module keeps serialized compiled templates
+    in a POSIX shared memory segment which is shared by all filevars
+    instances on the host.  Templates are keyed by their path and the
+    hash of their content, so a template compiled by one instance can be
+    loaded by every other instance without being parsed again.
+
+    The segment is an append-only log of entries.  Every instance maps
+    the segment read-only, and new entries are appended with pwrite()
+    while holding an exclusive lock on the segment.  The segment is
+    opened for each append, so the lock also excludes other threads
+    and forked processes which share the mapping.  The used size in
+    the header is only advanced once an entry is complete, so readers
+    never see a partially written entry.
+
+*/
+/*==========================================================================*/
+
+/*============================================================================
+        Includes
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <varserver/varserver.h>
+#include "tstore.h"
+#include "hash.h"
+
+/*============================================================================
+        Private definitions
+============================================================================*/
+
+/*! shared template store magic number ( 'FVTS' ) */
+#define TSTORE_MAGIC    ( 0x46565453 )
+
+/*! shared template store layout version */
+#define TSTORE_VERSION  ( 1 )
+
+/*! alignment of the shared template store entries */
+#define TSTORE_ALIGN( x )   ( ( (x) + 7 ) & ~( (size_t)7 ) )
+
+/*! shared template store header */
+typedef struct tStoreHeader
+{
+    /*! magic number */
+    uint32_t magic;
+
+    /*! layout version */
+    uint32_t version;
+
+    /*! size of the segment */
+    uint64_t size;
+
+    /*! number of bytes of the segment in use */
+    uint64_t used;
+
+} TStoreHeader;
+
+/*! shared template store entry */
+typedef struct tStoreEntry
+{
+    /*! total length of the entry including padding */
+    uint32_t entryLen;
+
+    /*! length of the template path including the NUL terminator */
+    uint32_t pathLen;
+
+    /*! hash of the template path */
+    uint64_t pathHash;
+
+    /*! hash of the template content */
+    uint64_t contentHash;
+
+    /*! length of the serialized template image */
+    uint64_t imageLen;
+
+    /*! template path followed by the aligned serialized template image */
+    char path[];
+
+} TStoreEntry;
+
+/*============================================================================
+        Private function declarations
+============================================================================*/
+
+static const TStoreEntry *Find( TStore *pStore,
+                                char *pPath,
+                                uint64_t pathHash,
+                                uint64_t contentHash );
+static const CTemplateImage *GetImage( const TStoreEntry *pEntry );
+
+/*============================================================================
+        Public function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  TSTORE_Open                                                               */
+/*!
+    Open the shared template store
+
+    The TSTORE_Open function opens the shared template store segment,
+    creating and initializing it if this is the first instance to use
+    it, and maps it read-only.
+
+    @param[in]
+       pName
+            name of the shared memory segment
+
+    @param[in]
+       size
+            size of the segment if it has to be created
+
+    @retval pointer to the shared template store
+    @retval NULL if the shared template store is not available
+
+==============================================================================*/
+TStore *TSTORE_Open( char *pName, size_t size )
+{
+    TStore *pStore = NULL;
+    TStoreHeader header;
+    struct stat sb;
+    void *p;
+    int fd;
+
+    if( pName != NULL )
+    {
+        fd = shm_open( pName, O_CREAT | O_RDWR | O_CLOEXEC, 0644 );
+        if( fd >= 0 )
+        {
+            flock( fd, LOCK_EX );
+
+            if( ( fstat( fd, &sb ) == 0 ) &&
+                ( sb.st_size == 0 ) &&
+                ( ftruncate( fd, size ) == 0 ) )
+            {
+                /* we are the first instance, initialize the store */
+                memset( &header, 0, sizeof( header ) );
+                header.magic = TSTORE_MAGIC;
+                header.version = TSTORE_VERSION;
+                header.size = size;
+                header.used = TSTORE_ALIGN( sizeof( TStoreHeader ) );
+                pwrite( fd, &header, sizeof( header ), 0 );
+            }
+
+            if( ( pread( fd, &header, sizeof( header ), 0 ) ==
+                        sizeof( header ) ) &&
+                ( header.magic == TSTORE_MAGIC ) &&
+                ( header.version == TSTORE_VERSION ) &&
+                ( fstat( fd, &sb ) == 0 ) &&
+                ( (uint64_t)sb.st_size >= header.size ) )
+            {
+                p = mmap( NULL, header.size, PROT_READ, MAP_SHARED, fd, 0 );
+                if( p != MAP_FAILED )
+                {
+                    pStore = calloc( 1, sizeof( TStore ) );
+                    if( pStore != NULL )
+                    {
+                        pStore->pName = strdup( pName );
+                        pStore->pBase = p;
+                        pStore->size = header.size;
+                    }
+                    else
+                    {
+                        munmap( p, header.size );
+                    }
+                }
+            }
+
+            flock( fd, LOCK_UN );
+            close( fd );
+        }
+    }
+
+    return pStore;
+}
+
+/*============================================================================*/
+/*  TSTORE_Find                                                               */
+/*!
+    Find a compiled template in the shared template store
+
+    The TSTORE_Find function searches the shared template store for a
+    compiled template with the specified path and content hash.
+
+    @param[in]
+       pStore
+            pointer to the shared template store
+
+    @param[in]
+       pPath
+            path of the template file
+
+    @param[in]
+       contentHash
+            hash of the template file content
+
+    @param[out]
+       pLen
+            pointer to a location to store the length of the image
+
+    @retval pointer to the read-only serialized template image
+    @retval NULL if the template is not in the store
+
+==============================================================================*/
+const CTemplateImage *TSTORE_Find( TStore *pStore,
+                                   char *pPath,
+                                   uint64_t contentHash,
+                                   size_t *pLen )
+{
+    const CTemplateImage *pImage = NULL;
+    const TStoreEntry *pEntry;
+    uint64_t pathHash;
+
+    if( ( pStore != NULL ) &&
+        ( pPath != NULL ) &&
+        ( pLen != NULL ) )
+    {
+        pathHash = HASH_Compute( pPath, strlen( pPath ), 0 );
+        pEntry = Find( pStore, pPath, pathHash, contentHash );
+        if( pEntry != NULL )
+        {
+            pImage = GetImage( pEntry );
+            *pLen = pEntry->imageLen;
+        }
+    }
+
+    return pImage;
+}
+
+/*============================================================================*/
+/*  TSTORE_Add                                                                */
+/*!
+    Add a compiled template to the shared template store
+
+    The TSTORE_Add function appends a serialized compiled template to
+    the shared template store.  If another instance has added the same
+    template in the meantime, its entry is used instead.
+
+    @param[in]
+       pStore
+            pointer to the shared template store
+
+    @param[in]
+       pPath
+            path of the template file
+
+    @param[in]
+       pImage
+            pointer to the serialized template image
+
+    @param[in]
+       len
+            length of the serialized template image
+
+    @retval pointer to the read-only serialized template image in the store
+    @retval NULL if the template could not be added
+
+==============================================================================*/
+const CTemplateImage *TSTORE_Add( TStore *pStore,
+                                  char *pPath,
+                                  const CTemplateImage *pImage,
+                                  size_t len )
+{
+    const CTemplateImage *pStored = NULL;
+    const TStoreEntry *pEntry;
+    const TStoreHeader *pHeader;
+    TStoreEntry entry;
+    uint64_t used;
+    size_t offset;
+    int result = EOK;
+    int fd = -1;
+
+    if( ( pStore != NULL ) &&
+        ( pPath != NULL ) &&
+        ( pImage != NULL ) )
+    {
+        fd = shm_open( pStore->pName, O_RDWR | O_CLOEXEC, 0 );
+    }
+
+    if( fd >= 0 )
+    {
+        pHeader = (const TStoreHeader *)pStore->pBase;
+
+        memset( &entry, 0, sizeof( entry ) );
+        entry.pathLen = strlen( pPath ) + 1;
+        entry.pathHash = HASH_Compute( pPath, entry.pathLen - 1, 0 );
+        entry.contentHash = pImage->contentHash;
+        entry.imageLen = len;
+        offset = TSTORE_ALIGN( sizeof( TStoreEntry ) + entry.pathLen );
+        entry.entryLen = TSTORE_ALIGN( offset + len );
+
+        flock( fd, LOCK_EX );
+
+        pEntry = Find( pStore, pPath, entry.pathHash, entry.contentHash );
+        if( pEntry == NULL )
+        {
+            used = __atomic_load_n( &pHeader->used, __ATOMIC_ACQUIRE );
+            if( used + entry.entryLen > pStore->size )
+            {
+                result = ENOSPC;
+            }
+
+            if( ( result == EOK ) &&
+                ( ( pwrite( fd,
+                            &entry,
+                            sizeof( entry ),
+                            used ) != sizeof( entry ) ) ||
+                  ( pwrite( fd,
+                            pPath,
+                            entry.pathLen,
+                            used + sizeof( entry ) ) !=
+                                (ssize_t)entry.pathLen ) ||
+                  ( pwrite( fd,
+                            pImage,
+                            len,
+                            used + offset ) != (ssize_t)len ) ) )
+            {
+                result = errno;
+            }
+
+            if( result == EOK )
+            {
+                /* publish the entry */
+                pEntry = (const TStoreEntry *)( pStore->pBase + used );
+                used += entry.entryLen;
+                pwrite( fd,
+                        &used,
+                        sizeof( used ),
+                        offsetof( TStoreHeader, used ) );
+            }
+        }
+
+        flock( fd, LOCK_UN );
+        close( fd );
+
+        if( pEntry != NULL )
+        {
+            pStored = GetImage( pEntry );
+        }
+    }
+
+    return pStored;
+}
+
+/*============================================================================*/
+/*  TSTORE_Close                                                              */
+/*!
+    Close the shared template store
+
+    The TSTORE_Close function unmaps the shared template store.  The
+    segment itself is left in place for the other instances.  Compiled
+    templates loaded from the store must be freed before it is closed.
+
+    @param[in]
+       pStore
+            pointer to the shared template store
+
+==============================================================================*/
+void TSTORE_Close( TStore *pStore )
+{
+    if( pStore != NULL )
+    {
+        munmap( (void *)pStore->pBase, pStore->size );
+        free( pStore->pName );
+        free( pStore );
+    }
+}
+
+/*============================================================================
+        Private function definitions
+============================================================================*/
+
+/*============================================================================*/
+/*  Find                                                                      */
+/*!
+    Find a shared template store entry
+
+    The Find function scans the published entries of the shared
+    template store for the entry with the specified path and content.
+    The store may be written by other processes, so the path of an
+    entry is compared within its recorded length, and an entry only
+    matches if its path and image fit inside it.
+
+    @param[in]
+       pStore
+            pointer to the shared template store
+
+    @param[in]
+       pPath
+            path of the template file
+
+    @param[in]
+       pathHash
+            hash of the template file path
+
+    @param[in]
+       contentHash
+            hash of the template file content
+
+    @retval pointer to the matching entry
+    @retval NULL if no entry matches
+
+==============================================================================*/
+static const TStoreEntry *Find( TStore *pStore,
+                                char *pPath,
+                                uint64_t pathHash,
+                                uint64_t contentHash )
+{
+    const TStoreHeader *pHeader = (const TStoreHeader *)pStore->pBase;
+    const TStoreEntry *pEntry;
+    const TStoreEntry *pMatch = NULL;
+    uint64_t offset = TSTORE_ALIGN( sizeof( TStoreHeader ) );
+    uint64_t used;
+    size_t pathLen = strlen( pPath ) + 1;
+
+    used = __atomic_load_n( &pHeader->used, __ATOMIC_ACQUIRE );
+    if( used > pStore->size )
+    {
+        used = pStore->size;
+    }
+
+    while( ( pMatch == NULL ) &&
+           ( offset + sizeof( TStoreEntry ) <= used ) )
+    {
+        pEntry = (const TStoreEntry *)( pStore->pBase + offset );
+        if( ( pEntry->entryLen < sizeof( TStoreEntry ) ) ||
+            ( offset + pEntry->entryLen > used ) )
+        {
+            break;
+        }
+
+        if( ( pEntry->pathHash == pathHash ) &&
+            ( pEntry->contentHash == contentHash ) &&
+            ( pEntry->pathLen == pathLen ) &&
+            ( TSTORE_ALIGN( sizeof( TStoreEntry ) + pathLen ) <=
+              pEntry->entryLen ) &&
+            ( pEntry->imageLen <=
+              pEntry->entryLen -
+                  TSTORE_ALIGN( sizeof( TStoreEntry ) + pathLen ) ) &&
+            ( memcmp( pEntry->path, pPath, pathLen ) == 0 ) )
+        {
+            pMatch = pEntry;
+        }
+
+        offset += pEntry->entryLen;
+    }
+
+    return pMatch;
+}
+
+/*============================================================================*/
+/*  GetImage                                                                  */
+/*!
+    Get the serialized template image of an entry
+
+    @param[in]
+       pEntry
+            pointer to the shared template store entry
+
+    @retval pointer to the serialized template image
+
+==============================================================================*/
+static const CTemplateImage *GetImage( const TStoreEntry *pEntry )
+{
+    size_t offset = TSTORE_ALIGN( sizeof( TStoreEntry ) + pEntry->pathLen );
+
+    return (const CTemplateImage *)( (const uint8_t *)pEntry + offset );
+}
+
+/*! @}
+ * end of tstore group */